@@ -0,0 +1,397 @@
+"""Columnar binary archive of recorded shots.
+
+JSON shot files are convenient to inspect but slow to load in bulk, since every
+file has to be parsed into Python lists before it can be used. The archive
+stores the same information in a format that can be memory-mapped and viewed
+as numpy arrays without parsing or copying anything.
+
+An archive is made of two files sharing a path prefix:
+
+- `<prefix>.dat` holds one block per shot. A block starts with a fixed-size
+  header (`SHOT_HEADER_DTYPE`) followed by the shot's columns, each stored
+  contiguously as little-endian float32 values.
+- `<prefix>.idx` holds one fixed-size record per shot (`INDEX_DTYPE`) pointing
+  to the shot's block in the data file.
+
+Both files are append-only. The data block is written before its index record,
+so an interrupted write never leaves the index pointing to a partial block.
+
+Every archive is paired with a downsampled tier, itself an archive (at
+`<prefix>.lttb`), holding each shot's temperature series reduced to at most
+`DOWNSAMPLED_POINTS` points with the Largest-Triangle-Three-Buckets algorithm.
+LTTB keeps the points that contribute most to the series' visual shape, so
+overlays of many shots can be plotted from the tier without visible loss, and
+the full-resolution columns only need to be read when zooming in. The tier is
+written along with every appended shot.
+
+Example usage (convert existing JSON shot files):
+
+    $ python archive.py convert data/*.json
+
+Example usage (downsample shots archived before the tier existed):
+
+    $ python archive.py downsample
+"""
+import argparse
+import glob
+import json
+import os
+
+import numpy as np
+
+# Path prefix of the default archive.
+DEFAULT_PATH = 'data/shots'
+
+MAGIC = b'SHOT'
+FORMAT_VERSION = 1
+
+# Maximum number of columns that a shot can hold, and maximum length of a
+# column name in bytes.
+MAX_COLUMNS = 8
+MAX_COLUMN_NAME_LENGTH = 32
+
+# Shot blocks are aligned to 8 bytes so that header fields are naturally
+# aligned when viewed in place.
+ALIGNMENT = 8
+
+SHOT_HEADER_DTYPE = np.dtype([
+    ('magic', 'S4'),
+    ('version', '<u2'),
+    ('num_columns', '<u2'),
+    ('num_samples', '<u4'),
+    ('calibration_version', '<u4'),
+    ('posix_time', '<f8'),
+    ('description', 'S128'),
+    ('columns', 'S{}'.format(MAX_COLUMN_NAME_LENGTH), (MAX_COLUMNS,)),
+])
+
+INDEX_DTYPE = np.dtype([
+    ('offset', '<u8'),
+    ('num_samples', '<u4'),
+    ('num_columns', '<u4'),
+    ('posix_time', '<f8'),
+])
+
+COLUMN_DTYPE = np.dtype('<f4')
+
+# Keys of the JSON shot file layout that are stored in the shot header rather
+# than as columns. Shots recorded before calibration versions were introduced
+# have a calibration version of 0.
+METADATA_KEYS = ('posix time', 'description', 'calibration version')
+
+# Path suffix of the downsampled tier, and maximum number of points per
+# downsampled series, which is about the width in pixels of a notebook plot.
+DOWNSAMPLED_SUFFIX = '.lttb'
+DOWNSAMPLED_POINTS = 500
+
+# Temperature series stored in the downsampled tier. Each one is downsampled
+# independently, so the tier holds a time column for each of them.
+DOWNSAMPLED_SERIES = ('basket_temperature', 'group_temperature')
+
+
+def lttb(x, y, num_points):
+  """Selects points of a series with the Largest-Triangle-Three-Buckets method.
+
+  The first and last points are always selected. The points in between are
+  split into `num_points - 2` buckets, and each bucket contributes the point
+  forming the largest triangle with the point selected in the previous bucket
+  and the average of the points in the next bucket.
+
+  Args:
+    x: numpy array, the series' x coordinates, in increasing order.
+    y: numpy array, the series' y coordinates.
+    num_points: int, number of points to select.
+
+  Returns:
+    numpy array of the selected points' indices, in increasing order.
+  """
+  num_samples = len(x)
+  if num_points >= num_samples or num_points < 3:
+    return np.arange(num_samples)
+
+  x = np.asarray(x, dtype=np.float64)
+  y = np.asarray(y, dtype=np.float64)
+  edges = np.linspace(1, num_samples - 1, num_points - 1).astype(int)
+  indices = np.empty(num_points, dtype=int)
+  indices[0] = 0
+  indices[-1] = num_samples - 1
+  selected = 0
+  for bucket in range(num_points - 2):
+    start, stop = edges[bucket], edges[bucket + 1]
+    if bucket + 2 < len(edges):
+      next_start, next_stop = stop, edges[bucket + 2]
+    else:
+      next_start, next_stop = num_samples - 1, num_samples
+    next_x = x[next_start:next_stop].mean()
+    next_y = y[next_start:next_stop].mean()
+    # Twice the areas of the triangles, which doesn't change their ordering.
+    areas = np.abs((x[selected] - next_x) * (y[start:stop] - y[selected]) -
+                   (x[selected] - x[start:stop]) * (next_y - y[selected]))
+    selected = start + int(np.argmax(areas))
+    indices[bucket + 1] = selected
+  return indices
+
+
+def downsample(shot_data, num_points=DOWNSAMPLED_POINTS):
+  """Computes a shot's downsampled tier entry.
+
+  Args:
+    shot_data: dict in the JSON shot file layout.
+    num_points: int, maximum number of points per downsampled series.
+
+  Returns:
+    dict in the JSON shot file layout with the shot's metadata and, for every
+    series in `DOWNSAMPLED_SERIES`, the selected points' values and times (in
+    a column named after the series' location, e.g. 'basket_time').
+  """
+  downsampled_data = {key: shot_data[key] for key in METADATA_KEYS
+                      if key in shot_data}
+  elapsed_time = np.asarray(shot_data['time'], dtype=COLUMN_DTYPE)
+  for name in DOWNSAMPLED_SERIES:
+    values = np.asarray(shot_data[name], dtype=COLUMN_DTYPE)
+    indices = lttb(elapsed_time, values, num_points)
+    downsampled_data[name.split('_')[0] + '_time'] = elapsed_time[indices]
+    downsampled_data[name] = values[indices]
+  return downsampled_data
+
+
+def _memmap(path, dtype, mode='r'):
+  """Memory-maps a file as an array, which is empty if the file is."""
+  if not os.path.exists(path) or os.path.getsize(path) == 0:
+    return np.zeros(0, dtype=dtype)
+  return np.memmap(path, dtype=dtype, mode=mode)
+
+
+class Archive:
+  """Columnar binary archive of recorded shots.
+
+  Shots are returned as dictionaries with the same keys as JSON shot files,
+  except that columns are numpy arrays viewing the memory-mapped data file.
+  """
+
+  def __init__(self, path=DEFAULT_PATH, mode='r',
+               downsampled_points=DOWNSAMPLED_POINTS):
+    """Opens the archive at `path`, which does not need to exist yet.
+
+    Args:
+      path: str, path prefix of the archive's data and index files.
+      mode: str, 'r' to return read-only shots, or 'r+' to return shots whose
+        headers and columns can be modified in place.
+      downsampled_points: int, maximum number of points per series in the
+        downsampled tier, or 0 for an archive without a downsampled tier.
+    """
+    self._data_path = path + '.dat'
+    self._index_path = path + '.idx'
+    self._mode = mode
+    self._data = None
+    self._index = None
+    self._downsampled_points = downsampled_points
+    self._downsampled = None
+    if downsampled_points:
+      self._downsampled = Archive(path + DOWNSAMPLED_SUFFIX, mode,
+                                  downsampled_points=0)
+
+  def __len__(self):
+    return len(self.index)
+
+  @property
+  def index(self):
+    """Structured array of `INDEX_DTYPE` records, one per shot."""
+    if self._index is None:
+      self._index = _memmap(self._index_path, INDEX_DTYPE)
+    return self._index
+
+  @property
+  def downsampled(self):
+    """Downsampled tier, as an `Archive` whose i-th shot is this one's."""
+    return self._downsampled
+
+  def header(self, i):
+    """Returns the header of the `i`-th shot as a `SHOT_HEADER_DTYPE` record."""
+    offset = int(self.index[i]['offset'])
+    return self._data_bytes()[
+        offset:offset + SHOT_HEADER_DTYPE.itemsize].view(SHOT_HEADER_DTYPE)[0]
+
+  def shot(self, i):
+    """Returns the `i`-th shot.
+
+    Args:
+      i: int, index of the shot in the archive.
+
+    Returns:
+      dict with the shot's 'posix time', 'description' and 'calibration
+      version' along with one float32 array per column.
+    """
+    header = self.header(i)
+    if header['magic'] != MAGIC:
+      raise ValueError('corrupted archive: bad magic for shot {}.'.format(i))
+
+    num_samples = int(header['num_samples'])
+    column_size = num_samples * COLUMN_DTYPE.itemsize
+    offset = int(self.index[i]['offset']) + SHOT_HEADER_DTYPE.itemsize
+
+    shot_data = {
+        'posix time': float(header['posix_time']),
+        'description': header['description'].decode('utf-8', 'ignore'),
+        'calibration version': int(header['calibration_version']),
+    }
+    data = self._data_bytes()
+    for name in header['columns'][:header['num_columns']]:
+      shot_data[name.decode('utf-8')] = data[
+          offset:offset + column_size].view(COLUMN_DTYPE)
+      offset += column_size
+    return shot_data
+
+  def append(self, shot_data):
+    """Appends a shot to the archive.
+
+    Args:
+      shot_data: dict in the JSON shot file layout, i.e. with a 'posix time',
+        a 'description', an optional 'calibration version' and equal-length
+        lists (or arrays) of samples for every other key.
+    """
+    columns = [(name, np.asarray(values, dtype=COLUMN_DTYPE))
+               for name, values in shot_data.items()
+               if name not in METADATA_KEYS]
+    if len(columns) > MAX_COLUMNS:
+      raise ValueError('a shot cannot hold more than {} columns.'.format(
+          MAX_COLUMNS))
+    num_samples = len(columns[0][1]) if columns else 0
+    if any(len(values) != num_samples for _, values in columns):
+      raise ValueError('all columns of a shot must have the same length.')
+
+    header = np.zeros(1, dtype=SHOT_HEADER_DTYPE)
+    header['magic'] = MAGIC
+    header['version'] = FORMAT_VERSION
+    header['num_columns'] = len(columns)
+    header['num_samples'] = num_samples
+    header['posix_time'] = shot_data['posix time']
+    header['calibration_version'] = shot_data.get('calibration version', 0)
+    header['description'] = shot_data['description'].encode('utf-8')[:128]
+    for i, (name, _) in enumerate(columns):
+      encoded_name = name.encode('utf-8')
+      if len(encoded_name) > MAX_COLUMN_NAME_LENGTH:
+        raise ValueError('column name too long: {}.'.format(name))
+      header['columns'][0, i] = encoded_name
+
+    with open(self._data_path, 'ab') as f:
+      offset = f.tell()
+      padding = -offset % ALIGNMENT
+      f.write(b'\0' * padding)
+      offset += padding
+      f.write(header.tobytes())
+      for _, values in columns:
+        f.write(values.tobytes())
+
+    record = np.zeros(1, dtype=INDEX_DTYPE)
+    record['offset'] = offset
+    record['num_samples'] = num_samples
+    record['num_columns'] = len(columns)
+    record['posix_time'] = shot_data['posix time']
+    with open(self._index_path, 'ab') as f:
+      f.write(record.tobytes())
+
+    # The files grew, so existing memory maps no longer cover them.
+    self._data = None
+    self._index = None
+
+    # Shots archived before the tier existed are downsampled along the way.
+    if self._downsampled is not None:
+      self.sync_downsampled()
+
+  def sync_downsampled(self):
+    """Adds the downsampled tier entries of shots that are missing from it.
+
+    Returns:
+      int, number of shots downsampled.
+    """
+    num_downsampled = len(self._downsampled)
+    for i in range(num_downsampled, len(self)):
+      self._downsampled.append(downsample(self.shot(i),
+                                          self._downsampled_points))
+    return len(self) - num_downsampled
+
+  def refresh_downsampled(self, i):
+    """Recomputes the `i`-th shot's downsampled tier entry in place.
+
+    This is needed after modifying the shot's temperatures in place, and
+    requires the archive to be opened in 'r+' mode.
+
+    Args:
+      i: int, index of the shot in the archive.
+    """
+    downsampled_data = self._downsampled.shot(i)
+    for name, values in downsample(self.shot(i),
+                                   self._downsampled_points).items():
+      if name not in METADATA_KEYS:
+        downsampled_data[name][:] = values
+    self._downsampled.header(i)['calibration_version'] = (
+        self.header(i)['calibration_version'])
+
+  def flush(self):
+    """Writes in-place modifications of shots to disk."""
+    if isinstance(self._data, np.memmap):
+      self._data.flush()
+    if self._downsampled is not None:
+      self._downsampled.flush()
+
+  def _data_bytes(self):
+    if self._data is None:
+      self._data = _memmap(self._data_path, np.uint8, self._mode)
+    return self._data
+
+
+def convert(file_paths, shot_archive):
+  """Appends JSON shot files to an archive in chronological order.
+
+  Shots whose POSIX time is already present in the archive are skipped, which
+  makes it safe to convert the same files more than once.
+
+  Args:
+    file_paths: sequence of str, paths to JSON shot files.
+    shot_archive: Archive, archive to append shots to.
+
+  Returns:
+    int, number of shots appended.
+  """
+  archived_times = set(shot_archive.index['posix_time'].tolist())
+  shots = []
+  for file_path in file_paths:
+    with open(file_path, 'r') as f:
+      shots.append(json.load(f))
+
+  num_appended = 0
+  for shot_data in sorted(shots, key=lambda s: s['posix time']):
+    if shot_data['posix time'] not in archived_times:
+      shot_archive.append(shot_data)
+      archived_times.add(shot_data['posix time'])
+      num_appended += 1
+  return num_appended
+
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser(
+      description='Manage the columnar binary shot archive.')
+  parser.add_argument(
+      '--path', type=str, default=DEFAULT_PATH,
+      help='Path prefix of the archive files.')
+  subparsers = parser.add_subparsers(dest='command', required=True)
+  convert_parser = subparsers.add_parser(
+      'convert', help='Convert JSON shot files to the archive.')
+  convert_parser.add_argument(
+      'file_paths', type=str, nargs='*',
+      help='JSON shot files to convert (default: data/*.json).')
+  subparsers.add_parser(
+      'downsample',
+      help='Add shots that are missing from the downsampled tier to it.')
+  args = parser.parse_args()
+
+  if args.command == 'convert':
+    file_paths = args.file_paths or sorted(glob.glob('data/*.json'))
+    num_appended = convert(file_paths, Archive(args.path))
+    print('Appended {} of {} shots to {}.'.format(
+        num_appended, len(file_paths), args.path))
+  elif args.command == 'downsample':
+    num_downsampled = Archive(args.path).sync_downsampled()
+    print('Downsampled {} shots in {}{}.'.format(
+        num_downsampled, args.path, DOWNSAMPLED_SUFFIX))
@@ -0,0 +1,308 @@
+"""Benchmark of the host's measurement ingestion paths.
+
+Streams measurements from the device simulator (`host/simulator.cpp`) at
+stepped sample rates through each of the ways the host consumes them:
+
+- 'decode': reading and unpacking measurements from the serial port.
+- 'view': decoding, plus the running averages and terminal view of
+  `espresso-shot.py` (drawn into an off-screen window).
+- 'record': decoding, plus `espresso-shot.py`'s shot recorder writing JSON
+  files, the archive and the catalog in a temporary directory.
+
+For every path and rate, the benchmark records the sustained throughput, the
+99th percentile latency between the simulator emitting a measurement and the
+host finishing processing it, the host's CPU time per sample and the fraction
+of measurements lost because the host fell behind. Results are written to a
+JSON file, and comparing them to a previous run's results flags regressions.
+
+Latencies are measured against the simulator's emission schedule, relative to
+the least delayed measurement (which is assumed to be processed immediately);
+they are only meaningful while no measurements are lost.
+
+Example usage:
+
+    $ python benchmark.py --rates 100 1000 10000 --output benchmark.json
+    $ python benchmark.py --baseline benchmark.json
+"""
+import argparse
+import curses
+import datetime
+import importlib
+import json
+import os
+import platform
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+import numpy as np
+import serial
+
+import archive
+import catalog
+import host
+import utils
+
+PATHS = ('decode', 'view', 'record')
+
+# The device's sampling frequency, which the simulator's speed-up multiplies.
+with open(utils.CONSTANTS_PATH, 'r') as f:
+  SENSING_FREQUENCY = float(re.search(r'^#define\s+SENSING_FREQUENCY\s+(\S+)',
+                                      f.read(), re.M).group(1))
+
+# espresso-shot.py can't be imported with an import statement.
+espresso_shot = importlib.import_module('espresso-shot')
+
+
+class OffscreenWindow:
+  """Stands in for a curses window, so that the view can be drawn headless."""
+
+  def getmaxyx(self):
+    return 24, 80
+
+  def addstr(self, row, col, text, attributes=curses.A_NORMAL):
+    pass
+
+  def clear(self):
+    pass
+
+  def refresh(self):
+    pass
+
+
+def make_consumer(path, directory):
+  """Makes a function that processes a measurement along a path.
+
+  Args:
+    path: str, one of `PATHS`.
+    directory: str, directory that the 'record' path can write to.
+
+  Returns:
+    function taking a measurement tuple as returned by `utils.read_measurement`.
+  """
+  if path == 'decode':
+    return lambda measurement: None
+
+  if path == 'view':
+    basket_temperatures = utils.RunningMean(maxlen=100)
+    group_temperatures = utils.RunningMean(maxlen=100)
+    view = espresso_shot.TerminalView(OffscreenWindow(), frame_rate=10.0)
+
+    def consume(measurement):
+      basket_temperatures.append(measurement[3])
+      group_temperatures.append(measurement[4])
+      if view.due():
+        view.draw(measurement[0], group_temperatures.mean,
+                  basket_temperatures.mean, measurement[5], True)
+    return consume
+
+  if path == 'record':
+    recorder = espresso_shot.ShotRecorder(
+        archive.Archive(os.path.join(directory, 'shots')),
+        catalog.Catalog(os.path.join(directory, 'catalog.bin')),
+        device='simulator', data_directory=directory)
+    # The benchmark doesn't ask the simulator for its history, but builds it
+    # from this tree's constants.h.
+    calibration_version, _ = utils.read_calibration()
+    recorder.set_calibration_version(calibration_version)
+    return lambda measurement: recorder.update(measurement, True)
+
+  raise ValueError('unknown path: {}.'.format(path))
+
+
+def run(path, rate, duration, directory):
+  """Streams simulated measurements through a path at a given rate.
+
+  Args:
+    path: str, one of `PATHS`.
+    rate: float, number of measurements per second.
+    duration: float, duration of the run in seconds.
+    directory: str, directory that the 'record' path can write to.
+
+  Returns:
+    dict of results.
+  """
+  speed = rate / SENSING_FREQUENCY
+  # Shots are shortened so that the recorder finishes several of them.
+  simulator = subprocess.Popen(
+      [host.build_simulator(), '--speed', str(speed),
+       '--duration', str(duration * speed), '--shot_duration', '20',
+       '--idle_duration', '5'],
+      stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+  port = simulator.stdout.readline().split()[-1]
+  serial_port = serial.Serial(port=port, baudrate=9600, timeout=1.0)
+  consume = make_consumer(path, directory)
+
+  delays = []
+  start_time = None
+  start_cpu_time = time.process_time()
+  while True:
+    try:
+      measurement = utils.read_measurement(serial_port)
+    except (serial.SerialException, struct.error):
+      # The simulator exited.
+      break
+    consume(measurement)
+    now = time.perf_counter()
+    if start_time is None:
+      start_time = now
+    delays.append(now - start_time - len(delays) / rate)
+  end_time = time.perf_counter()
+  cpu_time = time.process_time() - start_cpu_time
+  serial_port.close()
+
+  # The simulator reports how many measurements it emitted and how many were
+  # lost.
+  _, statistics = simulator.communicate()
+  num_frames, _, num_overflowed = map(int, re.search(
+      r'(\d+) frames, (\d+) dropped, (\d+) overflowed', statistics).groups())
+
+  num_samples = len(delays)
+  latencies = np.asarray(delays) - min(delays, default=0.0)
+  return {
+      'path': path,
+      'rate': rate,
+      'num_samples': num_samples,
+      'throughput': (num_samples / (end_time - start_time)
+                     if num_samples > 1 else 0.0),
+      'p99_latency': (float(np.percentile(latencies, 99))
+                      if num_samples else float('nan')),
+      'cpu_time_per_sample': cpu_time / max(num_samples, 1),
+      'loss': num_overflowed / max(num_frames, 1),
+  }
+
+
+def sustained_rates(results, max_latency):
+  """Finds the highest rate each path sustains without loss or excess latency.
+
+  Args:
+    results: sequence of result dicts as returned by `run`.
+    max_latency: float, maximum acceptable p99 latency in seconds.
+
+  Returns:
+    dict mapping paths to rates (0 if no rate is sustained).
+  """
+  rates = {}
+  for result in results:
+    sustained = result['loss'] == 0 and result['p99_latency'] <= max_latency
+    rates.setdefault(result['path'], 0.0)
+    if sustained:
+      rates[result['path']] = max(rates[result['path']], result['rate'])
+  return rates
+
+
+def find_regressions(report, baseline, tolerance):
+  """Compares a report to a baseline report.
+
+  Args:
+    report: dict, benchmark report.
+    baseline: dict, benchmark report to compare to.
+    tolerance: float, relative increase in CPU time per sample that is
+      tolerated.
+
+  Returns:
+    list of str, descriptions of the regressions.
+  """
+  regressions = []
+  tested = {(result['path'], result['rate']) for result in report['results']}
+  for path, rate in baseline['sustained_rates'].items():
+    # Sustained rates are only comparable if this run stepped through the
+    # baseline's sustained rate.
+    if (path, rate) in tested and report['sustained_rates'][path] < rate:
+      regressions.append('{}: sustained rate dropped from {:g} to {:g}/s'.format(
+          path, rate, report['sustained_rates'][path]))
+
+  baseline_results = {(result['path'], result['rate']): result
+                      for result in baseline['results']}
+  for result in report['results']:
+    baseline_result = baseline_results.get((result['path'], result['rate']))
+    if baseline_result is None:
+      continue
+    ratio = (result['cpu_time_per_sample'] /
+             baseline_result['cpu_time_per_sample'])
+    if ratio > 1.0 + tolerance:
+      regressions.append(
+          '{} at {:g}/s: CPU time per sample went from {:.1f} to {:.1f} us '
+          '(+{:.0%})'.format(
+              result['path'], result['rate'],
+              1e6 * baseline_result['cpu_time_per_sample'],
+              1e6 * result['cpu_time_per_sample'], ratio - 1.0))
+  return regressions
+
+
+def git_revision():
+  """Returns the current git revision, or None outside of a git checkout."""
+  try:
+    return subprocess.run(
+        ['git', 'rev-parse', 'HEAD'], cwd=host.ROOT, capture_output=True,
+        text=True, check=True).stdout.strip()
+  except (OSError, subprocess.CalledProcessError):
+    return None
+
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser(
+      description='Benchmark the host\'s measurement ingestion paths.')
+  parser.add_argument(
+      '--paths', type=str, nargs='+', choices=PATHS, default=list(PATHS),
+      help='Ingestion paths to benchmark.')
+  parser.add_argument(
+      '--rates', type=float, nargs='+', default=[100, 1000, 5000, 10000, 20000],
+      help='Measurement rates (per second) to step through.')
+  parser.add_argument(
+      '--duration', type=float, default=5.0,
+      help='Duration of each run in seconds.')
+  parser.add_argument(
+      '--max_latency', type=float, default=0.1,
+      help='Maximum p99 latency (in seconds) of a sustained rate.')
+  parser.add_argument(
+      '--output', type=str, default=None,
+      help='Path to the JSON file the results are written to.')
+  parser.add_argument(
+      '--baseline', type=str, default=None,
+      help='Path to the JSON results of a previous run to compare to.')
+  parser.add_argument(
+      '--tolerance', type=float, default=0.2,
+      help=('Relative increase in CPU time per sample tolerated before '
+            'reporting a regression.'))
+  args = parser.parse_args()
+
+  results = []
+  print('{:<8}  {:>8}  {:>10}  {:>10}  {:>10}  {:>6}'.format(
+      'Path', 'Rate', 'Throughput', 'p99 (ms)', 'CPU (us)', 'Loss'))
+  for path in args.paths:
+    for rate in args.rates:
+      with tempfile.TemporaryDirectory() as directory:
+        result = run(path, rate, args.duration, directory)
+      results.append(result)
+      print('{:<8}  {:>8g}  {:>10.0f}  {:>10.2f}  {:>10.1f}  {:>6.1%}'.format(
+          path, rate, result['throughput'], 1e3 * result['p99_latency'],
+          1e6 * result['cpu_time_per_sample'], result['loss']))
+
+  report = {
+      'date': datetime.datetime.now().isoformat(timespec='seconds'),
+      'revision': git_revision(),
+      'platform': platform.platform(),
+      'python': platform.python_version(),
+      'duration': args.duration,
+      'max_latency': args.max_latency,
+      'results': results,
+      'sustained_rates': sustained_rates(results, args.max_latency),
+  }
+  for path, rate in report['sustained_rates'].items():
+    print('{} sustains {:g} measurements per second.'.format(path, rate))
+
+  if args.output is not None:
+    with open(args.output, 'w') as f:
+      json.dump(report, f, indent=2)
+
+  if args.baseline is not None:
+    with open(args.baseline, 'r') as f:
+      regressions = find_regressions(report, json.load(f), args.tolerance)
+    for regression in regressions:
+      print('Regression: ' + regression)
+    if regressions:
+      sys.exit(1)
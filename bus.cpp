@@ -0,0 +1,78 @@
+/*
+  Scheduler of the I2C bus shared by the ADC and the display.
+*/
+#include "bus.h"
+
+BusScheduler::BusScheduler() {
+  memset(transactions_, 0, sizeof(transactions_));
+  reset_usage();
+}
+
+void BusScheduler::enqueue(BusDevice device, BusStep step, void* context,
+                           uint8_t priority) {
+  Transaction& transaction = transactions_[device];
+  if (transaction.queued) {
+    ++usage_[device].num_merged;
+    return;
+  }
+  transaction.step = step;
+  transaction.context = context;
+  transaction.priority = priority;
+  transaction.queued = true;
+  transaction.started = false;
+  transaction.queue_time = monotonic_micros();
+}
+
+bool BusScheduler::run() {
+  int next = -1;
+  for (int device = 0; device < NUM_BUS_DEVICES; ++device) {
+    if (transactions_[device].queued &&
+        (next < 0 ||
+         transactions_[device].priority > transactions_[next].priority))
+      next = device;
+  }
+  if (next < 0)
+    return false;
+
+  Transaction& transaction = transactions_[next];
+  BusUsage& usage = usage_[next];
+  Timestamp start_time = monotonic_micros();
+  if (!transaction.started) {
+    transaction.started = true;
+    usage.max_wait = max(
+        usage.max_wait,
+        (unsigned long) elapsed_micros(transaction.queue_time, start_time));
+  }
+  bool more_steps = transaction.step(transaction.context);
+  unsigned long step_time = elapsed_micros(start_time, monotonic_micros());
+
+  usage.time += step_time;
+  usage.max_step_time = max(usage.max_step_time, step_time);
+  ++usage.num_steps;
+  if (!more_steps) {
+    transaction.queued = false;
+    ++usage.num_transactions;
+  }
+  return true;
+}
+
+void BusScheduler::reset_usage() {
+  memset(usage_, 0, sizeof(usage_));
+}
+
+void write_bus_usage(BusScheduler& bus, unsigned long clock) {
+  const BusUsage& adc = bus.usage(ADC_DEVICE);
+  const BusUsage& display = bus.usage(DISPLAY_DEVICE);
+  BusUsageFrame frame = {
+      uptime_millis(),
+      uint32_t(adc.time),
+      uint32_t(display.time),
+      uint16_t(min(adc.max_wait, 0xFFFFUL)),
+      uint16_t(min(display.max_step_time, 0xFFFFUL)),
+      uint16_t(min(adc.num_merged, 0xFFFFUL)),
+      uint16_t(clock / 1000),
+      BUS_USAGE_MARKER
+  };
+  Serial.write((byte *) &frame, sizeof(frame));
+  bus.reset_usage();
+}
@@ -0,0 +1,81 @@
+/*
+  Scheduler of the I2C bus shared by the ADC and the display.
+
+  Without coordination, sensing has to wait for a whole display refresh
+  (up to 1 KB at the bus clock) whenever the two are due at the same time.
+  Instead, bus transactions are queued with a priority and run in steps (e.g.
+  one display page per step) from the main loop, highest priority first, so
+  that ADC reads go between display steps. The scheduler also accounts for the
+  bus time used by every device.
+*/
+#ifndef ESPRESSO_SHOT_BUS_H_
+#define ESPRESSO_SHOT_BUS_H_
+
+#include <Arduino.h>
+
+#include "data_structures.h"
+#include "timebase.h"
+
+// Devices on the I2C bus.
+enum BusDevice {ADC_DEVICE, DISPLAY_DEVICE, NUM_BUS_DEVICES};
+
+// Transaction priorities. Higher priorities run first.
+constexpr uint8_t ADC_PRIORITY = 1;
+constexpr uint8_t DISPLAY_PRIORITY = 0;
+
+// Runs the next step of a bus transaction and returns whether the transaction
+// has more steps.
+typedef bool (*BusStep)(void* context);
+
+// Bus usage of a device since the usage was last reset. Times are in
+// microseconds, and include the work done by the transactions' steps besides
+// bus transfers (e.g. rendering a display page).
+struct BusUsage {
+  unsigned long time;
+  // Longest step, which is how long a higher priority transaction may have to
+  // wait for this device.
+  unsigned long max_step_time;
+  // Longest wait between queuing a transaction and running its first step.
+  unsigned long max_wait;
+  unsigned long num_steps;
+  unsigned long num_transactions;
+  // Transactions queued while the device already had one queued, which are
+  // merged with the queued one (e.g. a sensing period that was missed).
+  unsigned long num_merged;
+};
+
+class BusScheduler {
+ public:
+  BusScheduler();
+
+  // Queues a transaction for a device. A device has at most one queued
+  // transaction, which new transactions for that device are merged into.
+  void enqueue(BusDevice device, BusStep step, void* context,
+               uint8_t priority);
+
+  // Runs a step of the highest priority queued transaction, and returns
+  // whether there was one.
+  bool run();
+
+  const BusUsage& usage(BusDevice device) const { return usage_[device]; }
+  void reset_usage();
+
+ private:
+  struct Transaction {
+    BusStep step;
+    void* context;
+    uint8_t priority;
+    bool queued;
+    bool started;
+    Timestamp queue_time;
+  };
+
+  Transaction transactions_[NUM_BUS_DEVICES];
+  BusUsage usage_[NUM_BUS_DEVICES];
+};
+
+// Writes a bus usage frame to the serial port, given the bus clock (in Hz),
+// and resets the bus usage.
+void write_bus_usage(BusScheduler& bus, unsigned long clock);
+
+#endif  // ESPRESSO_SHOT_BUS_H_
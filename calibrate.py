@@ -1,21 +1,33 @@
 """Script to calibrate the basket and group thermistors.
 
 The script listens to the serial port for measurements and records resistances
-along with user-specified temperatures for three separate temperatures, then
-computes the group and (optionally) basket Steinhart-Hart model coefficients.
+along with user-specified temperatures for three or more separate temperatures,
+then fits the group and (optionally) basket Steinhart-Hart model coefficients by
+least squares (see `calibration.h`) and reports the fit's residuals.
 
 Example usage (group-only calibration):
 
     $ python calibrate.py --fqbn <FQBN> -p <UPLOAD PORT> --group_only
+
+With `--reference`, the script instead reads a reference thermometer's stream
+(from a second serial port or a log file) and captures pairs automatically
+whenever all readings are stable, e.g. while a water bath goes through a series
+of temperature steps:
+
+    $ python calibrate.py -p <UPLOAD PORT> [<UPLOAD PORT> ...] \\
+        --reference <THERMOMETER PORT OR LOG FILE> --num_points 8
 """
 import argparse
 import collections
+import os
+import re
 import threading
 import time
 
 import numpy as np
 import serial
 
+import host
 import utils
 
 
@@ -37,30 +49,40 @@ def read_resistances(serial_port, basket_resistances, group_resistances):
     group_resistances.append(group_resistance)
 
 
-def compute_coefficients(temperature_resistance_pairs):
-  """Computes Steinhart-Hart model coefficients.
-
-  Equations taken from
-  https://www.dataloggerinc.com/wp-content/uploads/2016/10/self-calibrate-thermistors.pdf.
+def print_fit(thermistor_name, temperatures, resistances):
+  """Fits and prints a thermistor's Steinhart-Hart model coefficients.
 
   Args:
-    temperature_resistance_pairs: sequence of three (temperature, resistance)
-      tuples.
-
-  Returns:
-    tuple (sh_a, sh_b, shc_c) of Steinhart-Hart coefficients.
+    thermistor_name: str, name of the thermistor.
+    temperatures: sequence of float, reference temperatures.
+    resistances: sequence of float, thermistor resistances at the reference
+      temperatures.
   """
-  l_1, l_2, l_3 = [np.log(p[1]) for p in temperature_resistance_pairs]
-  y_1, y_2, y_3 = [1.0 / (p[0] + 273.15) for p in temperature_resistance_pairs]
+  (sh_a, sh_b, sh_c), diagnostics = host.fit_steinhart_hart(
+      temperatures, resistances)
+  print('{} coefficients:\n  A = {}\n  B = {}\n  C = {}'.format(
+      thermistor_name, sh_a, sh_b, sh_c
+  ))
+  print('  Fitted on {} points: RMS residual = {:.3f}C, max residual = '
+        '{:.3f}C (point {}).'.format(
+            diagnostics['num_points'], diagnostics['rms_residual'],
+            diagnostics['max_residual'], diagnostics['worst_point'] + 1))
 
-  gamma_2 = (y_2 - y_1) / (l_2 - l_1)
-  gamma_3 = (y_3 - y_1) / (l_3 - l_1)
 
-  sh_c = ((gamma_3 - gamma_2) / (l_3 - l_2)) / (l_1 + l_2 + l_3)
-  sh_b = gamma_2 - sh_c * (l_1 ** 2 + l_1 * l_2 + l_2 ** 2)
-  sh_a = y_1 - (sh_b + l_1 ** 2 * sh_c) * l_1
+def print_fits(thermistors, temperature_resistance_pairs):
+  """Fits and prints Steinhart-Hart model coefficients for every thermistor.
 
-  return (sh_a, sh_b, sh_c)
+  Args:
+    thermistors: list of thermistors as returned by `thermistor_names`.
+    temperature_resistance_pairs: list of (temperature, resistances) tuples,
+      where resistances holds one resistance per thermistor.
+  """
+  for k, (_, _, thermistor_name) in enumerate(thermistors):
+    print_fit(thermistor_name,
+              [t for t, _ in temperature_resistance_pairs],
+              [r[k] for _, r in temperature_resistance_pairs])
+  print('After updating constants.h, increment CALIBRATION_VERSION and run '
+        'recalibrate.py to recompute the temperatures of recorded shots.')
 
 
 def initialize(port):
@@ -92,23 +114,143 @@ def initialize(port):
   return (basket_resistances, group_resistances)
 
 
-def calibrate(port, group_only):
+def thermistor_names(ports, group_only):
+  """Returns the names of the thermistors to calibrate on each device.
+
+  Args:
+    ports: sequence of str, upload ports of the devices.
+    group_only: bool, only calibrate the group thermistors if True.
+
+  Returns:
+    list of (device index, thermistor index, thermistor name) tuples, where
+    thermistor index 0 is the basket thermistor and 1 the group thermistor.
+  """
+  thermistors = [(1, 'Group')] if group_only else [(0, 'Basket'), (1, 'Group')]
+  return [(d, i, name if len(ports) == 1 else '{} {}'.format(port, name))
+          for d, port in enumerate(ports) for i, name in thermistors]
+
+
+def read_reference_temperatures(reference, baudrate, column):
+  """Generator yielding readings from a reference thermometer.
+
+  Readings are text lines holding one or more fields separated by commas,
+  semicolons or whitespace, one of which is the temperature. Lines that don't
+  parse are skipped.
+
+  Args:
+    reference: str, serial port the thermometer is connected to, or path to a
+      file the thermometer's software logs readings to. The file is followed
+      as it grows from its current end, like `tail -f` would, since readings
+      logged before can't be paired with the thermistors' current
+      resistances.
+    baudrate: int, baud rate of the reference serial port.
+    column: int, index of the temperature field in each line.
+
+  Yields:
+    float, reference temperatures.
+  """
+  if os.path.isfile(reference):
+    stream = open(reference, 'r')
+    stream.seek(0, os.SEEK_END)
+  else:
+    stream = serial.Serial(port=reference, baudrate=baudrate)
+
+  while True:
+    line = stream.readline()
+    if not line:
+      # End of the file for now; wait for the thermometer to log more.
+      time.sleep(0.1)
+      continue
+    if isinstance(line, bytes):
+      line = line.decode('utf-8', 'ignore')
+    fields = re.split(r'[,;\s]+', line.strip())
+    try:
+      yield float(fields[column])
+    except (IndexError, ValueError):
+      continue
+
+
+class PlateauDetector:
+  """Detects plateaus where the reference and thermistor readings are stable.
+
+  The detector keeps a window of the most recent readings. A plateau is
+  detected when the window is full and the standard deviation of the reference
+  temperature and of every thermistor's temperature over the window are all
+  below a threshold. Consecutive plateaus must be some distance apart in
+  temperature, so that a long plateau only yields a single point.
+  """
+
+  def __init__(self, window_size, max_standard_deviation, min_separation):
+    """Instantiates the detector.
+
+    Args:
+      window_size: int, number of reference readings a plateau must span.
+      max_standard_deviation: float, stability threshold in degrees Celsius.
+      min_separation: float, minimum reference temperature difference between
+        captured points in degrees Celsius.
+    """
+    self._max_standard_deviation = max_standard_deviation
+    self._min_separation = min_separation
+    self._references = collections.deque(maxlen=window_size)
+    self._temperatures = collections.deque(maxlen=window_size)
+    self._resistances = collections.deque(maxlen=window_size)
+    self._captured_references = []
+
+  def update(self, reference, temperatures, resistances):
+    """Adds readings to the window and checks whether they form a plateau.
+
+    Args:
+      reference: float, reference temperature.
+      temperatures: sequence of float, the thermistors' temperatures according
+        to their current calibration, used to measure stability.
+      resistances: sequence of float, the thermistors' resistances.
+
+    Returns:
+      tuple (reference temperature, resistances) averaged over the plateau if
+      a new plateau was detected, None otherwise.
+    """
+    self._references.append(reference)
+    self._temperatures.append(temperatures)
+    self._resistances.append(resistances)
+    if len(self._references) < self._references.maxlen:
+      return None
+
+    # Disconnected thermistors have non-finite temperatures and never count as
+    # stable.
+    if (np.std(self._references) > self._max_standard_deviation or
+        not np.all(np.std(self._temperatures, axis=0) <=
+                   self._max_standard_deviation)):
+      return None
+
+    mean_reference = np.mean(self._references)
+    if any(abs(mean_reference - captured) < self._min_separation
+           for captured in self._captured_references):
+      return None
+
+    self._captured_references.append(mean_reference)
+    return mean_reference, np.mean(self._resistances, axis=0)
+
+
+def calibrate(ports, group_only, num_points):
   """Performs thermistor calibration.
 
-  Prompts the user for three separate temperature readings from a reference
+  Prompts the user for separate temperature readings from a reference
   thermometer, and infers the basket and thermistor's Steinhart-Hart model
   coefficients using the thermistors' corresponding resistances at those
-  temperatures.
+  temperatures. Using more than three points averages out noise in individual
+  readings.
 
   Args:
-    port: str, upload port.
-    group_only: bool, only calibrate the group thermistor if True.
+    ports: sequence of str, upload ports of the devices to calibrate.
+    group_only: bool, only calibrate the group thermistors if True.
+    num_points: int, number of temperature-resistance pairs to acquire.
   """
-  basket_resistances, group_resistances = initialize(port)
+  devices = [initialize(port) for port in ports]
+  thermistors = thermistor_names(ports, group_only)
 
-  # Acquire three separate temperature-resistance pairs.
+  # Acquire separate temperature-resistance pairs.
   temperature_resistance_pairs = []
-  while len(temperature_resistance_pairs) < 3:
+  while len(temperature_resistance_pairs) < num_points:
     temperature_string = input(
         'Temperature {}: '.format(len(temperature_resistance_pairs) + 1))
     try:
@@ -117,19 +259,56 @@ def calibrate(port, group_only):
       print('Please enter a floating point value.')
       continue
     temperature_resistance_pairs.append((
-        temperature, (np.mean(basket_resistances), np.mean(group_resistances))
-    ))
-  
-  # Compute and print Steinhart-Hart model coefficients. If `group_only`, we
-  # do so only for the group thermistor.
-  thermistors = [(1, 'Group')] if group_only else [(0, 'Basket'), (1, 'Group')]
-  for i, thermistor_name in thermistors:
-    sh_a, sh_b, sh_c = compute_coefficients(
-        [(t, r[i]) for t, r in temperature_resistance_pairs])
-    print('{} coefficients:\n  A = {}\n  B = {}\n  C = {}'.format(
-        thermistor_name, sh_a, sh_b, sh_c
+        temperature, [np.mean(devices[d][i]) for d, i, _ in thermistors]
     ))
 
+  print_fits(thermistors, temperature_resistance_pairs)
+
+
+def auto_calibrate(ports, group_only, num_points, reference, baudrate, column,
+                   window_size, max_standard_deviation, min_separation):
+  """Performs hands-off thermistor calibration.
+
+  Reads a reference thermometer's stream and automatically captures a
+  temperature-resistance pair whenever the reference and all thermistors are
+  stable (see `PlateauDetector`), e.g. while a water bath holding all probes
+  goes through a series of temperature steps.
+
+  Args:
+    ports: sequence of str, upload ports of the devices to calibrate.
+    group_only: bool, only calibrate the group thermistors if True.
+    num_points: int, number of temperature-resistance pairs to acquire.
+    reference: str, reference thermometer serial port or log file.
+    baudrate: int, baud rate of the reference serial port.
+    column: int, index of the temperature field in the reference's lines.
+    window_size: int, number of reference readings a plateau must span.
+    max_standard_deviation: float, stability threshold in degrees Celsius.
+    min_separation: float, minimum temperature difference between points.
+  """
+  devices = [initialize(port) for port in ports]
+  thermistors = thermistor_names(ports, group_only)
+  _, coefficients = utils.read_calibration()
+  thermistor_coefficients = [coefficients['basket' if i == 0 else 'group']
+                             for _, i, _ in thermistors]
+  detector = PlateauDetector(window_size, max_standard_deviation,
+                             min_separation)
+
+  temperature_resistance_pairs = []
+  for reference_temperature in read_reference_temperatures(reference, baudrate,
+                                                           column):
+    resistances = [np.mean(devices[d][i]) for d, i, _ in thermistors]
+    temperatures = [utils.resistance_to_temperature(r, *c)
+                    for r, c in zip(resistances, thermistor_coefficients)]
+    point = detector.update(reference_temperature, temperatures, resistances)
+    if point is not None:
+      temperature_resistance_pairs.append(point)
+      print('Captured point {} at {:.2f}C.'.format(
+          len(temperature_resistance_pairs), point[0]))
+      if len(temperature_resistance_pairs) >= num_points:
+        break
+
+  print_fits(thermistors, temperature_resistance_pairs)
+
 
 if __name__ == '__main__':
   parser = argparse.ArgumentParser(
@@ -138,24 +317,55 @@ if __name__ == '__main__':
       '--fqbn', type=str, default='arduino:mbed:nano33ble',
       help='Fully Qualified Board Name.')
   parser.add_argument(
-      '-p', dest='port', type=str, default=None,
-      help='Upload port, e.g.: COM10 or /dev/ttyACM0')
+      '-p', dest='ports', type=str, nargs='+', default=None,
+      help=('Upload port(s), e.g.: COM10 or /dev/ttyACM0. Several devices can '
+            'be calibrated at once.'))
   parser.add_argument(
       '--recompile', action='store_true',
       help='Recompile the program and upload it to the Arduino device.')
   parser.add_argument(
       '--group_only', action='store_true',
       help='Only calibrate the group thermistor.')
+  parser.add_argument(
+      '--num_points', type=int, default=3,
+      help='Number of reference temperatures to acquire (at least 3).')
+  parser.add_argument(
+      '--reference', type=str, default=None,
+      help=('Serial port or log file of a reference thermometer. If specified, '
+            'points are captured automatically when readings are stable.'))
+  parser.add_argument(
+      '--reference_baudrate', type=int, default=9600,
+      help='Baud rate of the reference thermometer serial port.')
+  parser.add_argument(
+      '--reference_column', type=int, default=-1,
+      help='Index of the temperature field in reference readings.')
+  parser.add_argument(
+      '--window_size', type=int, default=30,
+      help='Number of reference readings a plateau must span.')
+  parser.add_argument(
+      '--max_standard_deviation', type=float, default=0.05,
+      help='Maximum standard deviation (C) of readings over a plateau.')
+  parser.add_argument(
+      '--min_separation', type=float, default=2.0,
+      help='Minimum temperature difference (C) between captured points.')
   args = parser.parse_args()
 
   fqbn = args.fqbn
   recompile = args.recompile
   group_only = args.group_only
-  port = utils.find_port_if_not_specified(fqbn, args.port)
+  num_points = max(args.num_points, 3)
+  ports = args.ports or [utils.find_port_if_not_specified(fqbn, None)]
 
   if recompile:
-    utils.compile_and_upload(fqbn=fqbn, port=port)
+    for port in ports:
+      utils.compile_and_upload(fqbn=fqbn, port=port)
     # Give the Arduino device some time to become operational.
     time.sleep(2.0)
 
-  calibrate(port, group_only)
+  if args.reference is None:
+    calibrate(ports, group_only, num_points)
+  else:
+    auto_calibrate(ports, group_only, num_points, args.reference,
+                   args.reference_baudrate, args.reference_column,
+                   args.window_size, args.max_standard_deviation,
+                   args.min_separation)
@@ -0,0 +1,155 @@
+/*
+  Least-squares Steinhart-Hart calibration.
+*/
+#include "calibration.h"
+
+#include <math.h>
+
+namespace {
+
+constexpr double KELVIN_OFFSET = 273.15;
+
+// Whether a point can take part in a fit.
+bool is_usable(const CalibrationPoint& point) {
+  return point.weight > 0.0 && point.resistance > 0.0 &&
+         isfinite(point.resistance) && isfinite(point.temperature) &&
+         point.temperature > -KELVIN_OFFSET;
+}
+
+double predict_temperature(double resistance, double sh_a, double sh_b,
+                           double sh_c) {
+  double log_resistance = log(resistance);
+  return 1.0 / (sh_a + log_resistance * (
+      sh_b + sh_c * log_resistance * log_resistance)) - KELVIN_OFFSET;
+}
+
+}  // namespace
+
+void reset_accumulator(SteinhartHartAccumulator& accumulator) {
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j)
+      accumulator.normal_matrix[i][j] = 0.0;
+    accumulator.normal_vector[i] = 0.0;
+  }
+  accumulator.total_weight = 0.0;
+  accumulator.num_points = 0;
+}
+
+void accumulate_calibration_point(SteinhartHartAccumulator& accumulator,
+                                  const CalibrationPoint& point) {
+  if (!is_usable(point))
+    return;
+
+  double temperature_kelvin = point.temperature + KELVIN_OFFSET;
+  double log_resistance = log(point.resistance);
+  double basis[3] = {
+      1.0, log_resistance, log_resistance * log_resistance * log_resistance};
+  double squared_temperature = temperature_kelvin * temperature_kelvin;
+  double weight = point.weight * squared_temperature * squared_temperature;
+
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j)
+      accumulator.normal_matrix[i][j] += weight * basis[i] * basis[j];
+    accumulator.normal_vector[i] += weight * basis[i] / temperature_kelvin;
+  }
+  accumulator.total_weight += point.weight;
+  accumulator.num_points += 1;
+}
+
+bool solve_steinhart_hart(const SteinhartHartAccumulator& accumulator,
+                          double& sh_a, double& sh_b, double& sh_c) {
+  if (accumulator.num_points < 3)
+    return false;
+
+  // The basis functions differ by several orders of magnitude (ln(R)^3 is in
+  // the hundreds), so we equilibrate the system by scaling it with the inverse
+  // square root of its diagonal before eliminating.
+  double scale[3];
+  for (int i = 0; i < 3; ++i) {
+    if (!(accumulator.normal_matrix[i][i] > 0.0))
+      return false;
+    scale[i] = 1.0 / sqrt(accumulator.normal_matrix[i][i]);
+  }
+
+  double system[3][4];
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j)
+      system[i][j] = accumulator.normal_matrix[i][j] * scale[i] * scale[j];
+    system[i][3] = accumulator.normal_vector[i] * scale[i];
+  }
+
+  // Gaussian elimination with partial pivoting.
+  for (int column = 0; column < 3; ++column) {
+    int pivot = column;
+    for (int row = column + 1; row < 3; ++row) {
+      if (fabs(system[row][column]) > fabs(system[pivot][column]))
+        pivot = row;
+    }
+    // The equilibrated diagonal is one, so a vanishing pivot means that the
+    // points are (numerically) degenerate.
+    if (fabs(system[pivot][column]) < 1e-12)
+      return false;
+    if (pivot != column) {
+      for (int j = 0; j < 4; ++j) {
+        double swap = system[column][j];
+        system[column][j] = system[pivot][j];
+        system[pivot][j] = swap;
+      }
+    }
+    for (int row = column + 1; row < 3; ++row) {
+      double factor = system[row][column] / system[column][column];
+      for (int j = column; j < 4; ++j)
+        system[row][j] -= factor * system[column][j];
+    }
+  }
+
+  double solution[3];
+  for (int row = 2; row >= 0; --row) {
+    double sum = system[row][3];
+    for (int j = row + 1; j < 3; ++j)
+      sum -= system[row][j] * solution[j];
+    solution[row] = sum / system[row][row];
+  }
+
+  sh_a = solution[0] * scale[0];
+  sh_b = solution[1] * scale[1];
+  sh_c = solution[2] * scale[2];
+  return true;
+}
+
+bool fit_steinhart_hart(const CalibrationPoint* points, size_t num_points,
+                        SteinhartHartFit& fit, float* residuals) {
+  SteinhartHartAccumulator accumulator;
+  reset_accumulator(accumulator);
+  for (size_t i = 0; i < num_points; ++i)
+    accumulate_calibration_point(accumulator, points[i]);
+
+  if (!solve_steinhart_hart(accumulator, fit.sh_a, fit.sh_b, fit.sh_c))
+    return false;
+
+  // Residual diagnostics need the fitted coefficients, hence a second pass.
+  double weighted_squared_residuals = 0.0;
+  fit.max_residual = 0.0;
+  fit.worst_point = 0;
+  fit.num_points = accumulator.num_points;
+  for (size_t i = 0; i < num_points; ++i) {
+    if (!is_usable(points[i])) {
+      if (residuals != nullptr)
+        residuals[i] = NAN;
+      continue;
+    }
+    double residual = predict_temperature(
+        points[i].resistance, fit.sh_a, fit.sh_b, fit.sh_c) -
+        points[i].temperature;
+    if (residuals != nullptr)
+      residuals[i] = residual;
+    weighted_squared_residuals += points[i].weight * residual * residual;
+    if (fabs(residual) > fabs(fit.max_residual)) {
+      fit.max_residual = residual;
+      fit.worst_point = i;
+    }
+  }
+  fit.rms_residual = sqrt(weighted_squared_residuals /
+                          accumulator.total_weight);
+  return true;
+}
@@ -0,0 +1,69 @@
+/*
+  Least-squares Steinhart-Hart calibration.
+
+  This code has no dependency on the Arduino core so that it can run both on
+  the device and on the host (see host.py for its Python bindings).
+*/
+#ifndef ESPRESSO_SHOT_CALIBRATION_H_
+#define ESPRESSO_SHOT_CALIBRATION_H_
+
+#include <stddef.h>
+
+// A temperature-resistance pair captured during calibration. The weight
+// expresses the confidence in the pair, e.g. the inverse variance of the
+// reference temperature.
+struct CalibrationPoint {
+  float temperature;
+  float resistance;
+  float weight;
+};
+
+// Weighted normal equations of the Steinhart-Hart model, accumulated one
+// calibration point at a time. Points don't need to be stored, which lets the
+// device calibrate itself from an arbitrarily long stream of points.
+//
+// The model 1 / T = A + B ln(R) + C ln(R)^3 is linear in its coefficients, so
+// we fit it by least squares on inverse temperatures. Each point's weight is
+// multiplied by T^4 so that the fit approximately minimizes squared errors in
+// temperature rather than in inverse temperature.
+struct SteinhartHartAccumulator {
+  double normal_matrix[3][3];
+  double normal_vector[3];
+  double total_weight;
+  unsigned long num_points;
+};
+
+// Steinhart-Hart coefficients fitted by least squares along with residual
+// diagnostics. Residuals are differences between the temperatures predicted by
+// the fitted model and the reference temperatures, in degrees Celsius.
+struct SteinhartHartFit {
+  double sh_a;
+  double sh_b;
+  double sh_c;
+  double rms_residual;
+  double max_residual;
+  size_t worst_point;
+  size_t num_points;
+};
+
+// Resets an accumulator to zero calibration points.
+void reset_accumulator(SteinhartHartAccumulator& accumulator);
+
+// Adds a calibration point to an accumulator. Points with non-finite or
+// non-positive resistances (e.g. disconnected thermistors) are ignored.
+void accumulate_calibration_point(SteinhartHartAccumulator& accumulator,
+                                  const CalibrationPoint& point);
+
+// Solves an accumulator's normal equations. Returns false if the points don't
+// determine the coefficients, e.g. if there are fewer than three distinct
+// resistances.
+bool solve_steinhart_hart(const SteinhartHartAccumulator& accumulator,
+                          double& sh_a, double& sh_b, double& sh_c);
+
+// Fits Steinhart-Hart coefficients to calibration points and computes residual
+// diagnostics. If residuals is not null, it receives each point's residual
+// (NaN for ignored points). Returns false if the fit fails.
+bool fit_steinhart_hart(const CalibrationPoint* points, size_t num_points,
+                        SteinhartHartFit& fit, float* residuals);
+
+#endif  // ESPRESSO_SHOT_CALIBRATION_H_
@@ -0,0 +1,255 @@
+"""Catalog of per-shot summaries for fast queries across the shot archive.
+
+The catalog holds one fixed-size record per archived shot (`CATALOG_DTYPE`)
+with summary columns such as the shot's duration and its start, minimum and
+maximum temperatures. Queries are evaluated on the memory-mapped catalog with
+vectorized numpy operations and never touch the shots' samples.
+
+The catalog is append-only and kept in step with the archive: the recorder adds
+a record whenever it archives a shot, and `sync` adds records for archived
+shots that are missing from the catalog (e.g. after converting JSON files).
+
+Example usage (March shots where the group started above 93°C):
+
+    $ python catalog.py query --since 2021-03-01 --until 2021-04-01 \\
+        --where 'group_start > 93'
+"""
+import argparse
+import datetime
+import operator
+import os
+import re
+
+import numpy as np
+
+import archive
+
+# Default catalog location.
+DEFAULT_PATH = 'data/catalog.bin'
+
+CATALOG_DTYPE = np.dtype([
+    ('posix_time', '<f8'),
+    ('shot', '<u4'),
+    ('duration', '<f4'),
+    ('basket_start', '<f4'),
+    ('basket_min', '<f4'),
+    ('basket_max', '<f4'),
+    ('group_start', '<f4'),
+    ('group_min', '<f4'),
+    ('group_max', '<f4'),
+    ('device', 'S32'),
+    ('description', 'S128'),
+])
+
+# Predicates are of the form '<column> <operator> <value>'.
+PREDICATE_PATTERN = re.compile(r'^\s*(\w+)\s*(<=|>=|==|!=|<|>)\s*(.+?)\s*$')
+OPERATORS = {
+    '<': operator.lt,
+    '<=': operator.le,
+    '>': operator.gt,
+    '>=': operator.ge,
+    '==': operator.eq,
+    '!=': operator.ne,
+}
+
+
+def summarize(shot_data, shot, device=''):
+  """Computes a shot's catalog record.
+
+  Args:
+    shot_data: dict in the JSON shot file layout.
+    shot: int, index of the shot in the archive.
+    device: str, name of the device that recorded the shot.
+
+  Returns:
+    numpy record of `CATALOG_DTYPE`.
+  """
+  record = np.zeros(1, dtype=CATALOG_DTYPE)[0]
+  record['posix_time'] = shot_data['posix time']
+  record['shot'] = shot
+  record['device'] = device.encode('utf-8')[:32]
+  record['description'] = shot_data['description'].encode('utf-8')[:128]
+
+  elapsed_time = np.asarray(shot_data['time'], dtype=np.float32)
+  record['duration'] = elapsed_time[-1] if len(elapsed_time) else 0.0
+  for location in ('basket', 'group'):
+    temperatures = np.asarray(shot_data[location + '_temperature'],
+                              dtype=np.float32)
+    if len(temperatures):
+      record[location + '_start'] = temperatures[0]
+      record[location + '_min'] = temperatures.min()
+      record[location + '_max'] = temperatures.max()
+    else:
+      record[location + '_start'] = np.nan
+      record[location + '_min'] = np.nan
+      record[location + '_max'] = np.nan
+  return record
+
+
+def parse_predicate(predicate):
+  """Parses a '<column> <operator> <value>' predicate string.
+
+  Args:
+    predicate: str, predicate to parse, e.g. 'group_start > 93'.
+
+  Returns:
+    tuple (column, operator function, value).
+
+  Raises:
+    ValueError, if the predicate is malformed or refers to an unknown column.
+  """
+  match = PREDICATE_PATTERN.match(predicate)
+  if match is None:
+    raise ValueError('malformed predicate: {}.'.format(predicate))
+  column, operator_string, value = match.groups()
+  if column not in CATALOG_DTYPE.names:
+    raise ValueError('unknown column: {}.'.format(column))
+  if CATALOG_DTYPE[column].kind == 'S':
+    value = value.strip('\'"').encode('utf-8')
+  else:
+    value = float(value)
+  return column, OPERATORS[operator_string], value
+
+
+class Catalog:
+  """Catalog of per-shot summaries."""
+
+  def __init__(self, path=DEFAULT_PATH, mode='r'):
+    """Opens the catalog at `path`, which does not need to exist yet.
+
+    Args:
+      path: str, path to the catalog file.
+      mode: str, 'r' for read-only records, or 'r+' for records that can be
+        modified in place.
+    """
+    self._path = path
+    self._mode = mode
+    self._records = None
+
+  def __len__(self):
+    return len(self.records)
+
+  @property
+  def records(self):
+    """Structured array of `CATALOG_DTYPE` records, one per archived shot."""
+    if self._records is None:
+      if os.path.exists(self._path) and os.path.getsize(self._path) > 0:
+        self._records = np.memmap(self._path, dtype=CATALOG_DTYPE,
+                                  mode=self._mode)
+      else:
+        self._records = np.zeros(0, dtype=CATALOG_DTYPE)
+    return self._records
+
+  def add(self, shot_data, shot, device=''):
+    """Adds a shot's summary to the catalog.
+
+    Args:
+      shot_data: dict in the JSON shot file layout.
+      shot: int, index of the shot in the archive.
+      device: str, name of the device that recorded the shot.
+    """
+    with open(self._path, 'ab') as f:
+      f.write(summarize(shot_data, shot, device).tobytes())
+    # The file grew, so the existing memory map no longer covers it.
+    self._records = None
+
+  def sync(self, shot_archive):
+    """Adds records for archived shots that are missing from the catalog.
+
+    Args:
+      shot_archive: archive.Archive, archive the catalog summarizes.
+
+    Returns:
+      int, number of records added.
+    """
+    num_records = len(self)
+    for shot in range(num_records, len(shot_archive)):
+      self.add(shot_archive.shot(shot), shot)
+    return len(shot_archive) - num_records
+
+  def query(self, since=None, until=None, predicates=()):
+    """Returns the records matching a time range and a set of predicates.
+
+    Args:
+      since: float or None, inclusive lower bound on the shots' POSIX time.
+      until: float or None, exclusive upper bound on the shots' POSIX time.
+      predicates: sequence of str, predicates that all matching records must
+        satisfy (see `parse_predicate`).
+
+    Returns:
+      structured array of matching `CATALOG_DTYPE` records.
+    """
+    records = self.records
+    posix_times = records['posix_time']
+
+    # Shots are normally cataloged in chronological order, in which case time
+    # ranges reduce to a binary search.
+    if np.all(posix_times[1:] >= posix_times[:-1]):
+      start = 0 if since is None else np.searchsorted(posix_times, since)
+      stop = (len(records) if until is None
+              else np.searchsorted(posix_times, until))
+      records = records[start:stop]
+      mask = np.ones(len(records), dtype=bool)
+    else:
+      mask = np.ones(len(records), dtype=bool)
+      if since is not None:
+        mask &= posix_times >= since
+      if until is not None:
+        mask &= posix_times < until
+
+    for column, compare, value in map(parse_predicate, predicates):
+      mask &= compare(records[column], value)
+    return np.array(records[mask])
+
+
+def parse_date(date_string):
+  """Converts an ISO 8601 local date (and optional time) to a POSIX time."""
+  return datetime.datetime.fromisoformat(date_string).timestamp()
+
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser(
+      description='Query the catalog of archived shots.')
+  parser.add_argument(
+      '--path', type=str, default=DEFAULT_PATH,
+      help='Path to the catalog file.')
+  parser.add_argument(
+      '--archive_path', type=str, default=archive.DEFAULT_PATH,
+      help='Path prefix of the archive files.')
+  subparsers = parser.add_subparsers(dest='command', required=True)
+  subparsers.add_parser(
+      'sync', help='Catalog archived shots that are missing from the catalog.')
+  query_parser = subparsers.add_parser(
+      'query', help='List the shots matching a time range and predicates.')
+  query_parser.add_argument(
+      '--since', type=parse_date, default=None,
+      help='Inclusive start date, e.g. 2021-03-01 or 2021-03-01T08:00.')
+  query_parser.add_argument(
+      '--until', type=parse_date, default=None,
+      help='Exclusive end date, e.g. 2021-04-01.')
+  query_parser.add_argument(
+      '--where', type=str, action='append', default=[],
+      help=('Predicate on a summary column, e.g. "group_start > 93". Can be '
+            'repeated.'))
+  args = parser.parse_args()
+
+  catalog = Catalog(args.path)
+  if args.command == 'sync':
+    num_added = catalog.sync(archive.Archive(args.archive_path))
+    print('Added {} records to {}.'.format(num_added, args.path))
+  elif args.command == 'query':
+    records = catalog.query(args.since, args.until, args.where)
+    print('{:<19}  {:>5}  {:>8}  {:>7}  {:>7}  {:>8}  {:>8}  {}'.format(
+        'Date', 'Shot', 'Duration', 'Group', 'Basket', 'Group', 'Basket',
+        'Description'))
+    print('{:<19}  {:>5}  {:>8}  {:>7}  {:>7}  {:>8}  {:>8}'.format(
+        '', '', '(s)', 'start', 'start', 'max', 'max'))
+    for record in records:
+      date = datetime.datetime.fromtimestamp(record['posix_time'])
+      print('{:<19}  {:>5}  {:>8.1f}  {:>7.2f}  {:>7.2f}  {:>8.2f}  {:>8.2f}  '
+            '{}'.format(date.isoformat(' ', timespec='seconds'),
+                        record['shot'], record['duration'],
+                        record['group_start'], record['basket_start'],
+                        record['group_max'], record['basket_max'],
+                        record['description'].decode('utf-8', 'ignore')))
+    print('{} matching shots.'.format(len(records)))
@@ -0,0 +1,80 @@
+/*
+  Compile-time device configuration.
+*/
+#ifndef ESPRESSO_SHOT_CONFIG_H_
+#define ESPRESSO_SHOT_CONFIG_H_
+
+#include <stdint.h>
+
+#include "constants.h"
+
+// Device configuration, passed as a template parameter to DeviceState and to
+// the functions that use it. Since all of its members are compile-time
+// constants, several configurations can coexist in the same build (e.g. to
+// benchmark them side by side on the host), and code for disabled features
+// compiles away.
+//
+// DefaultConfig holds the device's configuration from constants.h. Other
+// configurations derive from it and hide the members they change, e.g.
+//
+//   struct LongWindowConfig : DefaultConfig {
+//     static constexpr int buffer_size = 4 * DefaultConfig::buffer_size;
+//   };
+struct DefaultConfig {
+  // Task periods, in milliseconds. The sensing period must be changed along
+  // with the sensing frequency.
+  static constexpr unsigned short default_task_period = DEFAULT_TASK_PERIOD;
+  static constexpr unsigned short sensing_frequency = SENSING_FREQUENCY;
+  static constexpr unsigned short sensing_period = 1000 / SENSING_FREQUENCY;
+  static constexpr unsigned short display_period = 1000 / DISPLAY_FREQUENCY;
+  static constexpr unsigned short diagnostics_period = DIAGNOSTICS_PERIOD;
+
+  // I2C bus clock, in Hz.
+  static constexpr unsigned long i2c_clock = I2C_CLOCK;
+
+  // Number of resistance measurements averaged into temperatures.
+  static constexpr int buffer_size = BUFFER_SIZE;
+
+  // ADC channels and voltage divider resistances. Without a basket
+  // thermistor, its channel is never read and its temperature reads as
+  // absolute zero, like a disconnected thermistor's.
+  static constexpr bool has_basket_thermistor = true;
+  static constexpr uint8_t reference_voltage_channel =
+      REFERENCE_VOLTAGE_CHANNEL;
+  static constexpr uint8_t basket_voltage_channel = BASKET_VOLTAGE_CHANNEL;
+  static constexpr double basket_known_resistance = BASKET_KNOWN_RESISTANCE;
+  static constexpr uint8_t group_voltage_channel = GROUP_VOLTAGE_CHANNEL;
+  static constexpr double group_known_resistance = GROUP_KNOWN_RESISTANCE;
+
+  // Pins.
+  static constexpr uint8_t fan_pin = FAN_PIN;
+  static constexpr uint8_t target_temperature_increase_pin =
+      TARGET_TEMPERATURE_INCREASE_PIN;
+  static constexpr uint8_t target_temperature_decrease_pin =
+      TARGET_TEMPERATURE_DECREASE_PIN;
+  static constexpr uint8_t tilt_pin = TILT_PIN;
+
+  // Whether the fan's tachometer output is wired (see tachometer.h), and its
+  // pin. Without it, the fan is assumed to turn at its nominal speed whenever
+  // it is switched on.
+  static constexpr bool has_fan_tachometer = FAN_TACHOMETER;
+  static constexpr uint8_t tachometer_pin = TACHOMETER_PIN;
+
+  // Target temperature range and adjustment, in degrees Celsius.
+  static constexpr double target_temperature_min = TARGET_TEMPERATURE_MIN;
+  static constexpr double target_temperature_max = TARGET_TEMPERATURE_MAX;
+  static constexpr double target_temperature_default =
+      TARGET_TEMPERATURE_DEFAULT;
+  static constexpr double target_temperature_increment =
+      TARGET_TEMPERATURE_INCREMENT;
+
+  // Number of milliseconds to display the target temperature for when it
+  // changes.
+  static constexpr unsigned long target_display_time = TARGET_DISPLAY_TIME;
+
+  // Whether the fan controls the estimated puck temperature (see
+  // puck_estimator.h) rather than the group temperature.
+  static constexpr bool control_puck_temperature = CONTROL_PUCK_TEMPERATURE;
+};
+
+#endif  // ESPRESSO_SHOT_CONFIG_H_
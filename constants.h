@@ -4,6 +4,18 @@
 #ifndef ESPRESSO_SHOT_CONSTANTS_H_
 #define ESPRESSO_SHOT_CONSTANTS_H_
 
+// Boards without a floating point unit (e.g. ATmega-based boards) use
+// fixed-point arithmetic from sensing to display (see fixed_point.h), and other
+// boards use floats. This can be overridden per board by defining
+// USE_FIXED_POINT as 0 or 1 at compile time.
+#ifndef USE_FIXED_POINT
+#ifdef __AVR__
+#define USE_FIXED_POINT 1
+#else
+#define USE_FIXED_POINT 0
+#endif
+#endif
+
 // Default period for device tasks, such as updating the timer or controlling
 // the fan.
 #define DEFAULT_TASK_PERIOD 10
@@ -13,9 +25,15 @@
 
 // Temperatures are averaged over a certain time horizon to reduce noise. By
 // default we set it to the sensing frequency so that we get an average over the
-// previous second.
+// previous second. On ATmega328P boards (e.g. the Uno), two buffers of a
+// second's fixed-point resistances (800 bytes) don't leave enough of the 2 KB
+// of RAM for the stack, so they average the previous 32 samples instead (see
+// "Monitoring RAM usage" in README.md to size it against the free RAM).
+#if defined(__AVR_ATmega328P__)
+#define BUFFER_SIZE 32
+#else
 #define BUFFER_SIZE SENSING_FREQUENCY
-constexpr unsigned short SENSING_PERIOD = 1000.0 / SENSING_FREQUENCY;
+#endif
 
 // We use the Steinhart-Hart model to characterize the relationship between
 // thermistor resistance and temperature. The coefficients A, B, and C are
@@ -30,6 +48,11 @@ constexpr unsigned short SENSING_PERIOD = 1000.0 / SENSING_FREQUENCY;
 #define GROUP_SH_B 2.052737727e-4
 #define GROUP_SH_C 1.427250141e-7
 
+// Version of the Steinhart-Hart coefficients above. It is recorded alongside
+// raw resistances in shot files so that past shots can be recalibrated with
+// recalibrate.py, and must be incremented whenever the coefficients change.
+#define CALIBRATION_VERSION 1
+
 // The basket and group thermistors and the shot timer switch are connected to
 // an ADS1115's channels 1 and 2 (respectively) using a pull-up resistor
 // configuration. The known resistance values for the basket and group voltage
@@ -54,13 +77,104 @@ constexpr unsigned short SENSING_PERIOD = 1000.0 / SENSING_FREQUENCY;
 // The tilt switch determines the brew lever position.
 #define TILT_PIN 4
 
-// Number of times per second that we refresh the display.
-#define DISPLAY_FREQUENCY 4
-constexpr unsigned short DISPLAY_PERIOD = 1000.0 / DISPLAY_FREQUENCY;
+// Whether the fan's tachometer output is wired to TACHOMETER_PIN, which must be
+// able to trigger an external interrupt (the sketch doesn't compile otherwise
+// on AVR boards). On ATmega328P-based boards, only pins 2 and 3 can, so the
+// tachometer takes one of the buttons' pins: set
+// TARGET_TEMPERATURE_DECREASE_PIN to 7 and TACHOMETER_PIN to 3, and move the
+// button's wire to pin 7 accordingly. The fan's speed is then measured (see
+// tachometer.h) and the fan is stalled when it turns slower than
+// TACHOMETER_STALL_RPM after TACHOMETER_SPIN_UP milliseconds on. The airflow is
+// taken as proportional to the speed, and is nominal at TACHOMETER_NOMINAL_RPM
+// (the fan's rated speed).
+#define FAN_TACHOMETER 0
+#define TACHOMETER_PIN 7
+#define TACHOMETER_PULSES_PER_REVOLUTION 2
+#define TACHOMETER_NOMINAL_RPM 3000UL
+#define TACHOMETER_STALL_RPM 300UL
+#define TACHOMETER_SPIN_UP 2000UL
+
+// Shots are also detected from the temperatures (see shot_detection.h), which
+// times the shots that the tilt switch misses. The detector takes a step every
+// SHOT_DETECTION_STEP milliseconds and measures slopes over a one-second window
+// of SHOT_DETECTION_WINDOW steps. Slopes are in hundredths of degrees per
+// second, and times in milliseconds. The thresholds can be evaluated offline
+// against the recorded shots with shot_detection.py.
+#define SHOT_DETECTION_STEP 100
+#define SHOT_DETECTION_WINDOW 10
+#define SHOT_DETECTION_ONSET_RISE 30
+#define SHOT_DETECTION_RISE 100
+#define SHOT_DETECTION_GROUP_SLOPE_CHANGE 3
+#define SHOT_DETECTION_END_FALL 10
+#define SHOT_DETECTION_HOLD_STEPS 3
+#define SHOT_DETECTION_LAG 300
+#define SHOT_DETECTION_MAX_DURATION 120000UL
+
+// The puck temperature is estimated from the group temperature (see
+// puck_estimator.h) with an ARX model that takes a step every PUCK_MODEL_STEP
+// milliseconds:
+//   puck[k] = A1 puck[k-1] + A2 puck[k-2] + B0 group[k] + B1 group[k-1] + C
+// with temperatures in degrees Celsius. Like the Steinhart-Hart coefficients,
+// the coefficients depend on the machine and need to be fitted on shots pulled
+// with the basket thermistor (see host/system_identification.cpp). These ones
+// follow the group temperature with a three-second lag, 1.5C below it.
+#define PUCK_MODEL_STEP 100
+#define PUCK_MODEL_A1 0.9672161
+#define PUCK_MODEL_A2 0.0
+#define PUCK_MODEL_B0 0.0327839
+#define PUCK_MODEL_B1 0.0
+#define PUCK_MODEL_C -0.04917585
+
+// Whether the fan cools the grouphead until the estimated puck temperature
+// (rather than the group temperature) reaches the target temperature.
+#define CONTROL_PUCK_TEMPERATURE 0
+
+// While the controlled temperature is more than READY_BAND hundredths of
+// degrees away from the target, the display counts down the time predicted
+// until it is within that band (see ready_predictor.h), from the temperature's
+// slope over steps of READY_STEP milliseconds.
+#define READY_BAND 25
+#define READY_STEP 1000UL
+
+// Number of times per second that we refresh the display. Refreshes only
+// transfer the digits that changed (see refresh_display), so the timer can
+// show every tenth of a second.
+#define DISPLAY_FREQUENCY 10
 
 // Number of milliseconds to display the target temperature for when it changes.
 #define TARGET_DISPLAY_TIME 1000
 
+// I2C bus clock (in Hz) shared by the ADC and the display. The SSD1306 and the
+// ADS1115 are specified up to 400 kHz (the ADS1115 only goes faster in its
+// high-speed mode, which the Wire library doesn't support), so faster clocks
+// need to be tried on the actual hardware.
+#define I2C_CLOCK 400000UL
+
+// Number of milliseconds between diagnostics frames, which report RAM usage
+// (see diagnostics.h).
+#define DIAGNOSTICS_PERIOD 10000
+
+// The device keeps a history of its latest shots in non-volatile storage (see
+// history.h). Every shot's temperature curves have HISTORY_CURVE_SIZE points,
+// which start HISTORY_SAMPLE_PERIOD milliseconds apart and get twice as far
+// apart whenever a shot outlasts its curve. Shots shorter than
+// HISTORY_MIN_SHOT_DURATION milliseconds (e.g. cleaning flushes) aren't kept.
+#define HISTORY_CURVE_SIZE 32
+#define HISTORY_SAMPLE_PERIOD 250
+#define HISTORY_MIN_SHOT_DURATION 5000
+
+// Bytes of non-volatile storage used by the history on boards without an
+// EEPROM: the last sectors of the flash memory on Mbed-based boards, and RAM
+// (which doesn't survive resets) on others.
+#define HISTORY_FLASH_SIZE 8192
+#define HISTORY_RAM_SIZE 1024
+
+// Byte that the host sends over the serial port to download the history, and
+// milliseconds after which a download that can't send anything (e.g. because
+// the host stopped reading) is abandoned.
+#define HISTORY_COMMAND 'H'
+#define HISTORY_SEND_TIMEOUT 2000
+
 // Size of the character buffer used to receive the string representation of
 // floating point numbers. The size required to represent a temperature is 8
 // (VWXY.ZC plus the null termination character), since we don't expect basket
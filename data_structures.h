@@ -4,42 +4,182 @@
 #ifndef ESPRESSO_SHOT_DATA_STRUCTURES_H_
 #define ESPRESSO_SHOT_DATA_STRUCTURES_H_
 
+#include <stdint.h>
+
+#include "config.h"
 #include "constants.h"
+#include "fixed_point.h"
+#include "puck_estimator.h"
+#include "ready_predictor.h"
+#include "shot_detection.h"
+#include "tachometer.h"
+#include "timebase.h"
+
+// Resistances (in Ohms) and temperatures (in degrees Celsius) are fixed-point
+// numbers on boards that use fixed-point arithmetic, and floats otherwise.
+#if USE_FIXED_POINT
+typedef FixedResistance Resistance;
+typedef FixedTemperature Temperature;
+#else
+typedef float Resistance;
+typedef float Temperature;
+#endif
+
+// Steinhart-Hart model coefficients for fixed-point conversions. Their formats
+// cover the usual range of NTC thermistor coefficients (A up to 3.9e-3, B up to
+// 9.7e-4 and C up to 9.5e-7 in absolute value).
+struct FixedSteinhartHart {
+  Fixed<39> sh_a;
+  Fixed<41> sh_b;
+  Fixed<51> sh_c;
+
+  constexpr FixedSteinhartHart(double a, double b, double c)
+      : sh_a(Fixed<39>::from_double(a)), sh_b(Fixed<41>::from_double(b)),
+        sh_c(Fixed<51>::from_double(c)) {}
+};
 
 // Machine state.
 enum MachineState {START, RUNNING, STOP, STOPPED};
 
-// Device state.
+// Text field on the display: the text to display, and the characters currently
+// displayed at each position (cleared when the whole screen is redrawn).
+struct DisplayField {
+  char text[FORMAT_BUFFER_SIZE];
+  char displayed[FORMAT_BUFFER_SIZE];
+};
+
+// What the display should show and what it currently shows, so that refreshes
+// only redraw what changed. Refreshes are drawn in steps (one page of the
+// screen or one glyph at a time), so that ADC reads can go between them on the
+// I2C bus (see bus.h).
+struct DisplayContents {
+  // Whether the header should show the target temperature, whether it is
+  // drawn, and whether the drawn header shows the target temperature.
+  bool target;
+  bool initialized;
+  bool displayed_target;
+  // Whether the header should show the estimated puck temperature instead of
+  // the basket temperature, and whether the drawn header shows it.
+  bool puck;
+  bool displayed_puck;
+  // Whether the header should count down the time until the controlled
+  // temperature is ready instead of showing the group temperature's label, and
+  // whether the drawn header does.
+  bool countdown;
+  bool displayed_countdown;
+  // Whether the header should report a stalled fan, and whether the drawn
+  // header does.
+  bool stall;
+  bool displayed_stall;
+  // Next page to draw while the whole screen is redrawn, and 0 otherwise.
+  uint8_t page;
+
+  DisplayField group_temperature;
+  DisplayField basket_temperature;
+  DisplayField elapsed_time;
+  DisplayField time_to_ready;
+};
+
+// CPU usage of a task since the usage was last reset. Times are in
+// microseconds.
+struct TaskUsage {
+  unsigned long time;
+  unsigned long max_time;
+  unsigned long num_runs;
+};
+
+// How the main loop spent its time since the usage was last reset: the time the
+// CPU slept between tasks (in microseconds, see power.h), and the longest delays
+// between when the control tick and the sensing task were due and when they
+// started (in milliseconds), which sleeping must keep short.
+struct SchedulerUsage {
+  unsigned long idle_time;
+  unsigned long max_control_delay;
+  unsigned long max_sensing_delay;
+};
+
+// How the shots detected from the temperatures (see shot_detection.h) compare
+// with the lever's since the device started, and what the cross-check needs
+// to remember between control ticks. Times are in milliseconds since the device
+// started.
+struct ShotCrossCheck {
+  // Lever and detector states at the previous control tick.
+  bool lever_up;
+  bool detector_in_shot;
+  // Whether the current (or last) shot was timed from the temperatures because
+  // the lever missed it.
+  bool detected_shot;
+  // Whether the last lever shot was also detected, and when it started and
+  // ended.
+  bool lever_shot_detected;
+  uint32_t lever_shot_start;
+  uint32_t lever_shot_end;
+
+  // Shots timed with the lever, shots detected, lever shots that were also
+  // detected, and detected shots that the lever missed.
+  uint16_t num_lever_shots;
+  uint16_t num_detected_shots;
+  uint16_t num_confirmed_shots;
+  uint16_t num_fallback_shots;
+  // For the last lever shot that was also detected, the detector's back-dated
+  // start minus the lever's, and the delay from the lever to the detection.
+  int16_t last_start_error;
+  uint16_t last_detection_delay;
+};
+
+// Device state, for a given device configuration (see config.h).
+template <typename Config>
 struct DeviceState {
   // Espresso machine state.
   MachineState machine_state;
 
   // We use circular buffers to compute basket and group resistance averages
-  // over a certain time horizon determined by SENSOR_FREQUENCY and BUFFER_SIZE.
+  // over a certain time horizon determined by the configuration's sensing
+  // frequency and buffer size.
   // We work with resistances instead of temperatures because converting from
   // resistance to temperature is straightforward and being able to send
   // resistance information over serial is useful for thermistor calibration.
   int latest_buffer_index;
-  float basket_resistance_buffer[BUFFER_SIZE];
-  float group_resistance_buffer[BUFFER_SIZE];
+  Resistance basket_resistance_buffer[Config::buffer_size];
+  Resistance group_resistance_buffer[Config::buffer_size];
 
   // Resistance buffer averages' corresponding temperatures.
-  float current_basket_temperature;
-  float current_group_temperature;
+  Temperature current_basket_temperature;
+  Temperature current_group_temperature;
 
   // Selected target group temperature.
-  float target_group_temperature;
+  Temperature target_group_temperature;
 
-  // The start time is used with millis() to determine the elapsed time. When
-  // the machine is not running we display the previous shot time that was
-  // recorded into elapsed_time.
-  unsigned long start_time;
-  float elapsed_time;
+  // The start time is used with the clock (see timebase.h) to determine the
+  // elapsed time (in milliseconds). When the machine is not running we display
+  // the previous shot time that was recorded into elapsed_time.
+  Timestamp start_time;
+  unsigned long elapsed_time;
 
   // Historical device state.
-  unsigned long last_resistance_measurement;
-  unsigned long last_display_refresh;
-  unsigned long last_target_change;
+  Timestamp last_target_change;
+
+  // Shot detection from the averaged temperatures, which times the shots that
+  // the lever misses, and its cross-check with the lever.
+  ShotDetector shot_detector;
+  ShotCrossCheck shot_cross_check;
+
+  // Puck temperature estimated from the averaged group temperature.
+  PuckEstimator puck_estimator;
+
+  // Whether the fan is on, and its measured speed (if its tachometer is wired).
+  bool fan_on;
+  typename TachometerType<Config::has_fan_tachometer>::type tachometer;
+
+  // Prediction of the time until the controlled temperature is ready.
+  ReadyPredictor ready_predictor;
+
+  // Display contents.
+  DisplayContents display;
+
+  // CPU usage of the control tick (see control_tick), and of the main loop.
+  TaskUsage control_usage;
+  SchedulerUsage scheduler_usage;
 };
 
 // Struct used to send measurements over the serial port.
@@ -51,11 +191,207 @@ struct Measurement {
   float group_temperature;
   // The type int is 2 bytes long for ATmega based boards
   // (https://www.arduino.cc/reference/en/language/variables/data-types/int/),
-  // in contrast with the usual 4 bytes, but the type long is 4 bytes long
-  // (https://www.arduino.cc/reference/en/language/variables/data-types/long/),
-  // so we represent the machine state as a long that can be decoded by Python's
-  // struct library as an int.
-  long state;
+  // in contrast with the usual 4 bytes, and the type long is 8 bytes long when
+  // the sketch is built natively for the simulator (host/simulator.cpp), so we
+  // represent the machine state as an int32_t that can be decoded by Python's
+  // struct library as an int. Its MEASUREMENT_FAN_ON bit is set while the fan
+  // is switched on.
+  int32_t state;
 };
 
+// Bit of a measurement's state that is set while the fan is switched on, above
+// the machine state's values.
+constexpr int32_t MEASUREMENT_FAN_ON = INT32_C(0x100);
+
+// Value of the last field of diagnostics frames ("DIAG" in ASCII, read as a
+// little-endian integer). Diagnostics frames have the same size as
+// measurements, and this field is where measurements hold the machine state, so
+// the host tells frames apart without any change to how measurements are sent.
+constexpr int32_t DIAGNOSTICS_MARKER = INT32_C(0x47414944);
+
+// Struct used to send diagnostics over the serial port. Memory sizes are in
+// bytes, and are all zero on boards where they can't be measured.
+struct Diagnostics {
+  // Milliseconds since the device started.
+  uint32_t uptime;
+  // Total RAM, and RAM taken by static variables (.data and .bss).
+  uint16_t ram_size;
+  uint16_t static_ram;
+  // RAM taken by the heap, and free RAM between the heap and the stack when
+  // the diagnostics are sent.
+  uint16_t heap_used;
+  uint16_t free_ram;
+  // Deepest stack usage since the device started, and the smallest free RAM
+  // it left between the heap and the stack (the stack's high-water mark).
+  uint16_t max_stack_used;
+  uint16_t min_free_ram;
+  // Cause of the last reset (the MCU status register's flags).
+  uint8_t reset_flags;
+  // Bytes taken by each entry of the resistance buffers (basket and group
+  // combined) and number of entries, so that the host can size the buffers
+  // against min_free_ram.
+  uint8_t buffer_entry_size;
+  uint16_t buffer_size;
+  int32_t marker;
+};
+
+static_assert(sizeof(Diagnostics) == sizeof(Measurement),
+              "diagnostics and measurement frames must have the same size");
+
+// Value of the last field of bus usage frames ("BUSU" in ASCII, read as a
+// little-endian integer).
+constexpr int32_t BUS_USAGE_MARKER = INT32_C(0x55535542);
+
+// Struct used to send the I2C bus usage (see bus.h) over the serial port, sent
+// along with diagnostics. Times are in microseconds, and cover the time since
+// the previous bus usage frame.
+struct BusUsageFrame {
+  // Milliseconds since the device started.
+  uint32_t uptime;
+  // Bus time used by the ADC and the display.
+  uint32_t adc_time;
+  uint32_t display_time;
+  // Longest wait of an ADC read for the bus, and longest display step (which
+  // bounds how long ADC reads wait for the display).
+  uint16_t max_adc_wait;
+  uint16_t max_display_step;
+  // Sensing periods missed because the previous ADC read hadn't run yet.
+  uint16_t num_missed_adc_reads;
+  // Bus clock, in kHz.
+  uint16_t clock;
+  int32_t marker;
+};
+
+static_assert(sizeof(BusUsageFrame) == sizeof(Measurement),
+              "bus usage and measurement frames must have the same size");
+
+// Value of the last field of task usage frames ("TASK" in ASCII, read as a
+// little-endian integer).
+constexpr int32_t TASK_USAGE_MARKER = INT32_C(0x4B534154);
+
+// Struct used to send the tasks' CPU usage over the serial port, sent along
+// with diagnostics. Times are in microseconds, and cover the time since the
+// previous task usage frame.
+struct TaskUsageFrame {
+  // Milliseconds since the device started.
+  uint32_t uptime;
+  // Time spent in control ticks, and the longest control tick.
+  uint32_t control_time;
+  uint16_t max_control_time;
+  uint16_t num_control_ticks;
+  // Time the CPU slept.
+  uint32_t idle_time;
+  // Longest delays of the control tick and the sensing task, in milliseconds.
+  uint16_t max_control_delay;
+  uint16_t max_sensing_delay;
+  int32_t marker;
+};
+
+static_assert(sizeof(TaskUsageFrame) == sizeof(Measurement),
+              "task usage and measurement frames must have the same size");
+
+// Value of the last field of shot detection frames ("SHOT" in ASCII, read as a
+// little-endian integer).
+constexpr int32_t SHOT_DETECTION_MARKER = INT32_C(0x544F4853);
+
+// Struct used to send the shot detection's cross-check with the lever (see
+// ShotCrossCheck) over the serial port, sent along with diagnostics. Counts are
+// since the device started.
+struct ShotDetectionFrame {
+  // Milliseconds since the device started.
+  uint32_t uptime;
+  uint16_t num_lever_shots;
+  uint16_t num_detected_shots;
+  uint16_t num_confirmed_shots;
+  uint16_t num_fallback_shots;
+  // In milliseconds.
+  int16_t last_start_error;
+  uint16_t last_detection_delay;
+  uint8_t reserved[4];
+  int32_t marker;
+};
+
+static_assert(sizeof(ShotDetectionFrame) == sizeof(Measurement),
+              "shot detection and measurement frames must have the same size");
+
+// Value of the last field of fan frames ("FANS" in ASCII, read as a
+// little-endian integer).
+constexpr int32_t FAN_MARKER = INT32_C(0x534E4146);
+
+// Struct used to send the fan's measured speed (see tachometer.h) over the
+// serial port, sent along with diagnostics when the fan has a tachometer.
+struct FanFrame {
+  // Milliseconds since the device started.
+  uint32_t uptime;
+  uint16_t rpm;
+  // Stalls since the device started.
+  uint16_t num_stalls;
+  // Percentage of the nominal airflow.
+  uint8_t airflow;
+  uint8_t fan_on;
+  uint8_t stalled;
+  uint8_t reserved[9];
+  int32_t marker;
+};
+
+static_assert(sizeof(FanFrame) == sizeof(Measurement),
+              "fan and measurement frames must have the same size");
+
+// Version of the shot record layout, which also tells records apart from
+// erased storage.
+constexpr uint8_t SHOT_RECORD_VERSION = 1;
+
+// Summary and decimated temperature curves of a shot, as kept in the shot
+// history (see history.h) and sent to the host. Temperatures are in tenths of
+// degrees Celsius, or INT16_MIN for a disconnected thermistor, and curve points
+// in half degrees Celsius, or 0xFF for a disconnected thermistor.
+struct ShotRecord {
+  uint8_t version;
+  uint8_t num_points;
+  // CRC-16-CCITT of the record with this field set to 0.
+  uint16_t checksum;
+  // Shot number, which increases by one with every shot kept.
+  uint16_t sequence;
+  // Shot duration, in tenths of seconds.
+  uint16_t duration;
+  // Milliseconds between curve points.
+  uint16_t curve_period;
+  int16_t target_temperature;
+  int16_t start_group_temperature;
+  int16_t min_group_temperature;
+  int16_t max_group_temperature;
+  int16_t max_basket_temperature;
+  uint8_t group_curve[HISTORY_CURVE_SIZE];
+  uint8_t basket_curve[HISTORY_CURVE_SIZE];
+};
+
+// Flash memory is programmed in words (of 4 bytes on the Nano 33 BLE).
+static_assert(sizeof(ShotRecord) % 4 == 0,
+              "shot records must be a whole number of flash words");
+
+// Value of the last field of history headers ("HIST" in ASCII, read as a
+// little-endian integer).
+constexpr int32_t HISTORY_MARKER = INT32_C(0x54534948);
+
+// Struct sent over the serial port before the shot history, which follows as
+// `num_records` records of `record_size` bytes, oldest first.
+struct HistoryHeader {
+  // Milliseconds since the device started.
+  uint32_t uptime;
+  uint16_t num_records;
+  uint16_t record_size;
+  // Number of records the storage holds.
+  uint16_t capacity;
+  uint8_t version;
+  uint8_t curve_size;
+  // CALIBRATION_VERSION of the coefficients the device converts resistances
+  // with, which the host records along with the shots it receives.
+  uint16_t calibration_version;
+  uint8_t reserved[6];
+  int32_t marker;
+};
+
+static_assert(sizeof(HistoryHeader) == sizeof(Measurement),
+              "history headers and measurement frames must have the same size");
+
 #endif  // ESPRESSO_SHOT_DATA_STRUCTURES_H_
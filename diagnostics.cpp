@@ -0,0 +1,94 @@
+/*
+  RAM usage diagnostics.
+*/
+#include "diagnostics.h"
+
+#ifdef __AVR__
+
+#include <avr/io.h>
+
+// Symbols defined by the linker script and avr-libc's malloc.
+extern uint8_t __data_start;
+extern uint8_t __bss_end;
+extern uint8_t __heap_start;
+extern char* __brkval;
+
+namespace {
+
+// Byte that free RAM is painted with at boot.
+constexpr uint8_t STACK_PAINT = 0xC5;
+
+// Reset cause, saved before anything else runs. It lives outside of .bss so
+// that the C runtime doesn't clear it afterwards.
+uint8_t reset_flags __attribute__((section(".noinit")));
+
+}  // namespace
+
+// Runs as part of the C runtime's initialization, after the stack pointer is
+// set up and before static variables are initialized or any function is called,
+// so that nothing lives on the stack yet. Init sections are jumped through
+// rather than called, so the function must be naked (no prologue or return).
+void initialize_diagnostics() __attribute__((naked, used,
+                                             section(".init3")));
+
+void initialize_diagnostics() {
+  // Optiboot clears the MCU status register before starting the sketch, and
+  // passes its value in r2 instead.
+  uint8_t bootloader_flags;
+  __asm__ __volatile__("mov %0, r2" : "=r"(bootloader_flags));
+  reset_flags = MCUSR ? MCUSR : bootloader_flags;
+  MCUSR = 0;
+
+  // Paint everything from the start of the heap to the top of RAM. This is
+  // written in assembly so that it can't use the stack it is painting.
+  __asm__ __volatile__(
+      "    ldi r30, lo8(__heap_start)\n"
+      "    ldi r31, hi8(__heap_start)\n"
+      "    ldi r24, %0\n"
+      "    ldi r25, hi8(%1)\n"
+      "    rjmp 2f\n"
+      "1:  st Z+, r24\n"
+      "2:  cpi r30, lo8(%1)\n"
+      "    cpc r31, r25\n"
+      "    brlo 1b\n"
+      "    breq 1b\n"
+      :
+      : "M"(STACK_PAINT), "i"(RAMEND)
+      : "r24", "r25", "r30", "r31", "memory");
+}
+
+void measure_memory(Diagnostics& diagnostics) {
+  uint8_t* heap_end = __brkval ? reinterpret_cast<uint8_t*>(__brkval) :
+                                 &__heap_start;
+  uint8_t* stack_pointer = reinterpret_cast<uint8_t*>(SP);
+
+  // The heap may have grown over painted bytes, so the scan starts at its end.
+  // The first byte that isn't painted anymore is the deepest the stack has
+  // ever reached.
+  uint8_t* deepest = heap_end;
+  while (deepest < stack_pointer && *deepest == STACK_PAINT)
+    ++deepest;
+
+  diagnostics.ram_size = RAMEND - RAMSTART + 1;
+  diagnostics.static_ram = &__bss_end - &__data_start;
+  diagnostics.heap_used = heap_end - &__heap_start;
+  diagnostics.free_ram = stack_pointer - heap_end;
+  diagnostics.max_stack_used = reinterpret_cast<uint8_t*>(RAMEND) + 1 -
+                               deepest;
+  diagnostics.min_free_ram = deepest - heap_end;
+  diagnostics.reset_flags = reset_flags;
+}
+
+#else
+
+void measure_memory(Diagnostics& diagnostics) {
+  diagnostics.ram_size = 0;
+  diagnostics.static_ram = 0;
+  diagnostics.heap_used = 0;
+  diagnostics.free_ram = 0;
+  diagnostics.max_stack_used = 0;
+  diagnostics.min_free_ram = 0;
+  diagnostics.reset_flags = 0;
+}
+
+#endif
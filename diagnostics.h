@@ -0,0 +1,21 @@
+/*
+  RAM usage diagnostics.
+
+  On ATmega-based boards, the RAM between the heap and the stack is painted with
+  a known byte at boot, before anything else runs. The stack overwrites that
+  byte as it grows, so the painted bytes left over tell how deep the stack has
+  ever grown (its high-water mark), which is what decides whether the device
+  runs out of RAM.
+*/
+#ifndef ESPRESSO_SHOT_DIAGNOSTICS_H_
+#define ESPRESSO_SHOT_DIAGNOSTICS_H_
+
+#include "data_structures.h"
+
+// Fills in the diagnostics' RAM usage and reset cause. Scans the painted RAM,
+// which takes time proportional to the free RAM (about 1 ms per KB on a 16 MHz
+// ATmega), so this is meant to be called every few seconds at most. Boards
+// other than ATmega-based ones report zeros.
+void measure_memory(Diagnostics& diagnostics);
+
+#endif  // ESPRESSO_SHOT_DIAGNOSTICS_H_
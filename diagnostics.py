@@ -0,0 +1,564 @@
+"""Log and report of the device's RAM usage diagnostics.
+
+The device sends a diagnostics frame every few seconds (see `Diagnostics` in
+the sketch's data_structures.h) with its static RAM, heap and free RAM, and the
+stack's high-water mark measured by painting free RAM at boot. The host tools
+append them to a CSV log (`DEFAULT_PATH`), so that RAM headroom can be tracked
+across firmware changes and over long uptimes.
+
+The report summarizes the log per device: the smallest free RAM ever left
+between the heap and the stack, the resets seen in the log (with their cause,
+when the board reports it), and how many more resistance buffer entries
+(`BUFFER_SIZE` in constants.h) fit in that headroom while keeping a safety
+margin. The high-water mark only covers the code paths that have run since the
+device started, so the margin should allow for rarely exercised ones.
+
+Bus usage frames, sent along with diagnostics frames, are logged to a separate
+CSV log (`DEFAULT_BUS_PATH`). The report also summarizes them per device: the
+share of time the ADC and the display occupy the I2C bus, the longest an ADC
+read waited for the bus and the longest display step (which bounds that wait),
+and the sensing periods missed because the previous read hadn't run yet.
+Task usage frames are logged to a third CSV log (`DEFAULT_TASK_PATH`), and
+summarized as the control tick's average and longest run time and its share
+of the CPU, the share of time the CPU slept, and how late the control tick and
+the sensing task started at worst (which sleeping must not make late enough to
+miss sensing periods).
+
+Shot detection frames, which compare the shots detected from the temperatures
+with the tilt switch's (see shot_detection.h), are logged to a fourth CSV log
+(`DEFAULT_DETECTION_PATH`), and summarized as the share of lever shots that
+were also detected and the shots that only the detector saw (which point to a
+failing tilt switch).
+
+Fan frames, sent by devices whose fan has a tachometer (see tachometer.h), are
+logged to a fifth CSV log (`DEFAULT_FAN_PATH`), and summarized as the fan's
+speed and airflow while switched on and the stalls seen, which point to a
+jammed or worn fan.
+
+Example usage:
+
+    $ python diagnostics.py record -p /dev/ttyACM0
+    $ python diagnostics.py report --margin 128
+"""
+import argparse
+import csv
+import datetime
+import os
+import time
+
+import serial
+
+import utils
+
+# Default log locations.
+DEFAULT_PATH = 'data/diagnostics.csv'
+DEFAULT_BUS_PATH = 'data/bus.csv'
+DEFAULT_TASK_PATH = 'data/tasks.csv'
+DEFAULT_DETECTION_PATH = 'data/detection.csv'
+DEFAULT_FAN_PATH = 'data/fan.csv'
+
+COLUMNS = ('posix_time', 'device') + utils.Diagnostics._fields
+BUS_COLUMNS = ('posix_time', 'device') + utils.BusUsage._fields
+TASK_COLUMNS = ('posix_time', 'device') + utils.TaskUsage._fields
+DETECTION_COLUMNS = ('posix_time', 'device') + utils.ShotDetection._fields
+FAN_COLUMNS = ('posix_time', 'device') + utils.Fan._fields
+
+# Reset causes reported by ATmega-based boards (the MCU status register's bits).
+RESET_CAUSES = (
+    (0x01, 'power-on'),
+    (0x02, 'external'),
+    (0x04, 'brown-out'),
+    (0x08, 'watchdog'),
+)
+
+
+class DiagnosticsLog:
+  """Append-only CSV logs of diagnostics, bus usage, task usage, shot
+  detection and fan frames."""
+
+  def __init__(self, path=DEFAULT_PATH, bus_path=DEFAULT_BUS_PATH,
+               task_path=DEFAULT_TASK_PATH,
+               detection_path=DEFAULT_DETECTION_PATH,
+               fan_path=DEFAULT_FAN_PATH):
+    self._path = path
+    self._bus_path = bus_path
+    self._task_path = task_path
+    self._detection_path = detection_path
+    self._fan_path = fan_path
+
+  def append(self, diagnostics, device='', posix_time=None):
+    """Appends a diagnostics, bus usage, task usage, shot detection or fan
+    frame to its log.
+
+    Args:
+      diagnostics: `utils.Diagnostics`, `utils.BusUsage`, `utils.TaskUsage`,
+        `utils.ShotDetection` or `utils.Fan`, frame to log.
+      device: str, device (e.g. serial port) that sent the frame.
+      posix_time: float or None, time the frame was received (now if None).
+    """
+    if posix_time is None:
+      posix_time = time.time()
+    if isinstance(diagnostics, utils.BusUsage):
+      path, columns = self._bus_path, BUS_COLUMNS
+    elif isinstance(diagnostics, utils.TaskUsage):
+      path, columns = self._task_path, TASK_COLUMNS
+    elif isinstance(diagnostics, utils.ShotDetection):
+      path, columns = self._detection_path, DETECTION_COLUMNS
+    elif isinstance(diagnostics, utils.Fan):
+      path, columns = self._fan_path, FAN_COLUMNS
+    else:
+      path, columns = self._path, COLUMNS
+    directory = os.path.dirname(path)
+    if directory:
+      os.makedirs(directory, exist_ok=True)
+    new_file = not os.path.exists(path)
+    with open(path, 'a', newline='') as f:
+      writer = csv.writer(f)
+      if new_file:
+        writer.writerow(columns)
+      writer.writerow(['{:.3f}'.format(posix_time), device] + list(diagnostics))
+
+  def records(self):
+    """Returns the logged diagnostics frames as a list of dicts, in the order
+    received."""
+    return _read_records(self._path, utils.Diagnostics._fields)
+
+  def bus_records(self):
+    """Returns the logged bus usage frames as a list of dicts, in the order
+    received."""
+    return _read_records(self._bus_path, utils.BusUsage._fields)
+
+  def task_records(self):
+    """Returns the logged task usage frames as a list of dicts, in the order
+    received."""
+    return _read_records(self._task_path, utils.TaskUsage._fields)
+
+  def detection_records(self):
+    """Returns the logged shot detection frames as a list of dicts, in the order
+    received."""
+    return _read_records(self._detection_path, utils.ShotDetection._fields)
+
+  def fan_records(self):
+    """Returns the logged fan frames as a list of dicts, in the order
+    received."""
+    return _read_records(self._fan_path, utils.Fan._fields)
+
+
+def _read_records(path, fields):
+  """Reads a CSV log's frames as a list of dicts."""
+  if not os.path.exists(path):
+    return []
+  with open(path, 'r', newline='') as f:
+    return [dict(record, posix_time=float(record['posix_time']),
+                 **{field: int(record[field]) for field in fields})
+            for record in csv.DictReader(f)]
+
+
+def reset_causes(reset_flags):
+  """Decodes a reset cause, e.g. 'brown-out', or 'unknown' if none is set."""
+  causes = [cause for bit, cause in RESET_CAUSES if reset_flags & bit]
+  return '+'.join(causes) if causes else 'unknown'
+
+
+def summarize(records, margin):
+  """Summarizes logged diagnostics per device.
+
+  Args:
+    records: list of dicts, as returned by `DiagnosticsLog.records`.
+    margin: int, free RAM (in bytes) to keep as a safety margin when sizing the
+      resistance buffers.
+
+  Returns:
+    dict mapping devices to dicts of summary statistics. RAM statistics are
+    None for devices whose board doesn't measure RAM usage.
+  """
+  summaries = {}
+  for device in sorted({record['device'] for record in records}):
+    device_records = [record for record in records
+                      if record['device'] == device]
+    latest = device_records[-1]
+    # Uptimes go back down after a reset.
+    resets = [
+        (record['posix_time'], reset_causes(record['reset_flags']))
+        for previous, record in zip(device_records, device_records[1:])
+        if record['uptime'] < previous['uptime']]
+    summary = {
+        'num_frames': len(device_records),
+        'since': device_records[0]['posix_time'],
+        'until': latest['posix_time'],
+        'resets': resets,
+        'last_reset_cause': reset_causes(latest['reset_flags']),
+        'ram_size': None,
+    }
+
+    measured = [record for record in device_records if record['ram_size']]
+    if measured:
+      min_free_ram = min(record['min_free_ram'] for record in measured)
+      summary.update({
+          'ram_size': latest['ram_size'],
+          'static_ram': latest['static_ram'],
+          'heap_used': max(record['heap_used'] for record in measured),
+          'free_ram': latest['free_ram'],
+          'max_stack_used': max(record['max_stack_used'] for record in measured),
+          'min_free_ram': min_free_ram,
+          'buffer_size': latest['buffer_size'],
+          # Each additional buffer entry takes `buffer_entry_size` bytes of
+          # static RAM.
+          'max_buffer_size': latest['buffer_size'] + (
+              (min_free_ram - margin) // max(latest['buffer_entry_size'], 1)),
+      })
+    summaries[device] = summary
+  return summaries
+
+
+def summarize_bus(records):
+  """Summarizes logged bus usage per device.
+
+  Args:
+    records: list of dicts, as returned by `DiagnosticsLog.bus_records`.
+
+  Returns:
+    dict mapping devices to dicts of summary statistics. Utilizations are None
+    when the log doesn't hold two consecutive frames from the same boot.
+  """
+  summaries = {}
+  for device in sorted({record['device'] for record in records}):
+    device_records = [record for record in records
+                      if record['device'] == device]
+    # A frame accounts for the bus usage since the previous frame, which is
+    # only known when the device didn't reset in between.
+    intervals = [
+        (previous, record)
+        for previous, record in zip(device_records, device_records[1:])
+        if record['uptime'] > previous['uptime']]
+    # Uptimes are in milliseconds, bus times in microseconds.
+    elapsed = 1000 * sum(record['uptime'] - previous['uptime']
+                         for previous, record in intervals)
+    summaries[device] = {
+        'num_frames': len(device_records),
+        'clock': device_records[-1]['clock'],
+        'adc_utilization': (
+            sum(record['adc_time'] for _, record in intervals) / elapsed
+            if elapsed else None),
+        'display_utilization': (
+            sum(record['display_time'] for _, record in intervals) / elapsed
+            if elapsed else None),
+        'max_adc_wait': max(record['max_adc_wait']
+                            for record in device_records),
+        'max_display_step': max(record['max_display_step']
+                                for record in device_records),
+        'num_missed_adc_reads': sum(record['num_missed_adc_reads']
+                                    for record in device_records),
+    }
+  return summaries
+
+
+def summarize_tasks(records):
+  """Summarizes logged task usage per device.
+
+  Args:
+    records: list of dicts, as returned by `DiagnosticsLog.task_records`.
+
+  Returns:
+    dict mapping devices to dicts of summary statistics. Averages are None when
+    no control tick was logged, and the CPU share when the log doesn't hold two
+    consecutive frames from the same boot.
+  """
+  summaries = {}
+  for device in sorted({record['device'] for record in records}):
+    device_records = [record for record in records
+                      if record['device'] == device]
+    intervals = [
+        (previous, record)
+        for previous, record in zip(device_records, device_records[1:])
+        if record['uptime'] > previous['uptime']]
+    elapsed = 1000 * sum(record['uptime'] - previous['uptime']
+                         for previous, record in intervals)
+    num_ticks = sum(record['num_control_ticks'] for record in device_records)
+    summaries[device] = {
+        'num_frames': len(device_records),
+        'num_control_ticks': num_ticks,
+        'mean_control_time': (
+            sum(record['control_time'] for record in device_records) /
+            num_ticks if num_ticks else None),
+        'max_control_time': max(record['max_control_time']
+                                for record in device_records),
+        'control_utilization': (
+            sum(record['control_time'] for _, record in intervals) / elapsed
+            if elapsed else None),
+        'idle_share': (
+            sum(record['idle_time'] for _, record in intervals) / elapsed
+            if elapsed else None),
+        'max_control_delay': max(record['max_control_delay']
+                                 for record in device_records),
+        'max_sensing_delay': max(record['max_sensing_delay']
+                                 for record in device_records),
+    }
+  return summaries
+
+
+def summarize_detection(records):
+  """Summarizes logged shot detection per device.
+
+  Args:
+    records: list of dicts, as returned by `DiagnosticsLog.detection_records`.
+
+  Returns:
+    dict mapping devices to dicts of summary statistics. Counts add up the
+    boots seen in the log, and the share of lever shots detected is None when
+    no lever shot was logged.
+  """
+  summaries = {}
+  for device in sorted({record['device'] for record in records}):
+    device_records = [record for record in records
+                      if record['device'] == device]
+    # Counts are since the device started, so every boot's last frame holds
+    # its totals.
+    boots = [previous
+             for previous, record in zip(device_records, device_records[1:])
+             if record['uptime'] < previous['uptime']] + [device_records[-1]]
+    counts = {
+        field: sum(boot[field] for boot in boots)
+        for field in ('num_lever_shots', 'num_detected_shots',
+                      'num_confirmed_shots', 'num_fallback_shots')}
+    latest = device_records[-1]
+    summaries[device] = dict(
+        counts,
+        num_frames=len(device_records),
+        recall=(counts['num_confirmed_shots'] / counts['num_lever_shots']
+                if counts['num_lever_shots'] else None),
+        last_start_error=(latest['last_start_error']
+                          if latest['num_confirmed_shots'] else None),
+        last_detection_delay=(latest['last_detection_delay']
+                              if latest['num_confirmed_shots'] else None))
+  return summaries
+
+
+def summarize_fan(records):
+  """Summarizes logged fan frames per device.
+
+  Args:
+    records: list of dicts, as returned by `DiagnosticsLog.fan_records`.
+
+  Returns:
+    dict mapping devices to dicts of summary statistics. Speeds and airflows
+    are over the frames sent while the fan was switched on and not stalled,
+    and are None when there were none. Stalls add up the boots seen in the
+    log.
+  """
+  summaries = {}
+  for device in sorted({record['device'] for record in records}):
+    device_records = [record for record in records
+                      if record['device'] == device]
+    # Stalls are counted since the device started, so every boot's last frame
+    # holds its total.
+    boots = [previous
+             for previous, record in zip(device_records, device_records[1:])
+             if record['uptime'] < previous['uptime']] + [device_records[-1]]
+    running = [record for record in device_records
+               if record['fan_on'] and not record['stalled']]
+    summaries[device] = {
+        'num_frames': len(device_records),
+        'num_stalls': sum(boot['num_stalls'] for boot in boots),
+        'stalled': bool(device_records[-1]['stalled']),
+        'mean_rpm': (sum(record['rpm'] for record in running) / len(running)
+                     if running else None),
+        'min_airflow': (min(record['airflow'] for record in running)
+                        if running else None),
+    }
+  return summaries
+
+
+def record(port, log, baudrate=9600):
+  """Logs the diagnostics frames received from a device until interrupted.
+
+  Args:
+    port: str, serial port of the device.
+    log: `DiagnosticsLog`, log to append to.
+    baudrate: int, serial port baud rate.
+  """
+  def on_diagnostics(diagnostics):
+    log.append(diagnostics, device=port)
+    if isinstance(diagnostics, utils.BusUsage):
+      print('Uptime {:.0f}s: ADC waited up to {} us for the bus, {} sensing '
+            'periods missed.'.format(diagnostics.uptime / 1000.0,
+                                     diagnostics.max_adc_wait,
+                                     diagnostics.num_missed_adc_reads))
+      return
+    if isinstance(diagnostics, utils.TaskUsage):
+      print('Uptime {:.0f}s: {} control ticks, up to {} us each, sensing up '
+            'to {} ms late.'.format(diagnostics.uptime / 1000.0,
+                                    diagnostics.num_control_ticks,
+                                    diagnostics.max_control_time,
+                                    diagnostics.max_sensing_delay))
+      return
+    if isinstance(diagnostics, utils.ShotDetection):
+      print('Uptime {:.0f}s: {} lever shots, {} detected, {} missed by the '
+            'lever.'.format(diagnostics.uptime / 1000.0,
+                            diagnostics.num_lever_shots,
+                            diagnostics.num_confirmed_shots,
+                            diagnostics.num_fallback_shots))
+      return
+    if isinstance(diagnostics, utils.Fan):
+      print('Uptime {:.0f}s: fan at {} RPM ({}% airflow){}.'.format(
+          diagnostics.uptime / 1000.0, diagnostics.rpm, diagnostics.airflow,
+          ', STALLED' if diagnostics.stalled else ''))
+      return
+    print('Uptime {:.0f}s: {} bytes free, {} at least, stack peaked at {} '
+          'bytes.'.format(diagnostics.uptime / 1000.0, diagnostics.free_ram,
+                          diagnostics.min_free_ram, diagnostics.max_stack_used))
+
+  serial_port = serial.Serial(port=port, baudrate=baudrate)
+  try:
+    while True:
+      utils.read_measurement(serial_port, on_diagnostics)
+  except KeyboardInterrupt:
+    pass
+  finally:
+    serial_port.close()
+
+
+def print_report(summaries, margin):
+  """Prints the summaries returned by `summarize`."""
+  for device, summary in summaries.items():
+    since, until = (
+        datetime.datetime.fromtimestamp(summary[key]).isoformat(
+            ' ', timespec='seconds') for key in ('since', 'until'))
+    print('{} ({} frames from {} to {})'.format(
+        device or '<unknown device>', summary['num_frames'], since, until))
+    if summary['ram_size'] is None:
+      print('  RAM usage is not measured on this board.')
+    else:
+      print('  RAM: {ram_size} bytes, {static_ram} static, up to {heap_used} '
+            'heap'.format(**summary))
+      print('  Stack high-water mark: {max_stack_used} bytes'.format(**summary))
+      print('  Free RAM: {free_ram} bytes now, {min_free_ram} at least'.format(
+          **summary))
+      print('  Resistance buffers: {} entries, up to {} with a {}-byte '
+            'margin'.format(summary['buffer_size'],
+                            summary['max_buffer_size'], margin))
+      if summary['min_free_ram'] < margin:
+        print('  WARNING: free RAM fell below the margin.')
+    print('  Last reset cause: {}'.format(summary['last_reset_cause']))
+    for posix_time, cause in summary['resets']:
+      print('  Reset before {} ({})'.format(
+          datetime.datetime.fromtimestamp(posix_time).isoformat(
+              ' ', timespec='seconds'), cause))
+
+
+def print_bus_report(summaries):
+  """Prints the summaries returned by `summarize_bus`."""
+  for device, summary in summaries.items():
+    print('{} ({} bus usage frames, {} kHz bus clock)'.format(
+        device or '<unknown device>', summary['num_frames'], summary['clock']))
+    if summary['adc_utilization'] is not None:
+      print('  Bus utilization: {:.1%} ADC, {:.1%} display'.format(
+          summary['adc_utilization'], summary['display_utilization']))
+    print('  ADC waited up to {max_adc_wait} us for the bus, display steps '
+          'took up to {max_display_step} us'.format(**summary))
+    if summary['num_missed_adc_reads']:
+      print('  WARNING: {} sensing periods were missed.'.format(
+          summary['num_missed_adc_reads']))
+
+
+def print_task_report(summaries):
+  """Prints the summaries returned by `summarize_tasks`."""
+  for device, summary in summaries.items():
+    print('{} ({} task usage frames)'.format(
+        device or '<unknown device>', summary['num_frames']))
+    if summary['mean_control_time'] is not None:
+      print('  Control tick: {:.0f} us on average, up to {} us, over {} '
+            'ticks'.format(summary['mean_control_time'],
+                           summary['max_control_time'],
+                           summary['num_control_ticks']))
+    if summary['control_utilization'] is not None:
+      print('  Control tick CPU usage: {:.2%}, CPU asleep {:.1%} of the '
+            'time'.format(summary['control_utilization'],
+                          summary['idle_share']))
+    print('  Tasks started up to {max_control_delay} ms late (control tick) and '
+          '{max_sensing_delay} ms late (sensing)'.format(**summary))
+
+
+def print_detection_report(summaries):
+  """Prints the summaries returned by `summarize_detection`."""
+  for device, summary in summaries.items():
+    print('{} ({} shot detection frames)'.format(
+        device or '<unknown device>', summary['num_frames']))
+    print('  Lever shots: {num_lever_shots}, of which {num_confirmed_shots} '
+          'were also detected'.format(**summary) + (
+              ' ({:.0%})'.format(summary['recall'])
+              if summary['recall'] is not None else ''))
+    if summary['last_start_error'] is not None:
+      print('  Last detected lever shot: start off by {last_start_error} ms, '
+            'detected after {last_detection_delay} ms'.format(**summary))
+    if summary['num_fallback_shots']:
+      print('  WARNING: {} shots were only detected from the temperatures, '
+            'check the tilt switch.'.format(summary['num_fallback_shots']))
+
+
+def print_fan_report(summaries):
+  """Prints the summaries returned by `summarize_fan`."""
+  for device, summary in summaries.items():
+    print('{} ({} fan frames)'.format(
+        device or '<unknown device>', summary['num_frames']))
+    if summary['mean_rpm'] is not None:
+      print('  Fan: {:.0f} RPM on average while on, {}% airflow at '
+            'least'.format(summary['mean_rpm'], summary['min_airflow']))
+    if summary['num_stalls']:
+      print('  WARNING: the fan stalled {} times{}, check it.'.format(
+          summary['num_stalls'],
+          ' and is stalled now' if summary['stalled'] else ''))
+
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser(
+      description='Log and report the device\'s RAM usage diagnostics.')
+  parser.add_argument(
+      '--path', type=str, default=DEFAULT_PATH,
+      help='Path to the diagnostics log.')
+  parser.add_argument(
+      '--bus_path', type=str, default=DEFAULT_BUS_PATH,
+      help='Path to the bus usage log.')
+  parser.add_argument(
+      '--task_path', type=str, default=DEFAULT_TASK_PATH,
+      help='Path to the task usage log.')
+  parser.add_argument(
+      '--detection_path', type=str, default=DEFAULT_DETECTION_PATH,
+      help='Path to the shot detection log.')
+  parser.add_argument(
+      '--fan_path', type=str, default=DEFAULT_FAN_PATH,
+      help='Path to the fan log.')
+  subparsers = parser.add_subparsers(dest='command', required=True)
+  record_parser = subparsers.add_parser(
+      'record', help='Log the diagnostics received from a device.')
+  record_parser.add_argument(
+      '-p', dest='port', type=str, required=True,
+      help='Serial port, e.g.: COM10 or /dev/ttyACM0')
+  report_parser = subparsers.add_parser(
+      'report', help='Summarize the logged diagnostics per device.')
+  report_parser.add_argument(
+      '--margin', type=int, default=128,
+      help='Free RAM (in bytes) to keep when sizing the resistance buffers.')
+  args = parser.parse_args()
+
+  log = DiagnosticsLog(args.path, args.bus_path, args.task_path,
+                       args.detection_path, args.fan_path)
+  if args.command == 'record':
+    record(args.port, log)
+  elif args.command == 'report':
+    records = log.records()
+    if not records:
+      print('No diagnostics logged in {}.'.format(args.path))
+    print_report(summarize(records, args.margin), args.margin)
+    bus_records = log.bus_records()
+    if bus_records:
+      print_bus_report(summarize_bus(bus_records))
+    task_records = log.task_records()
+    if task_records:
+      print_task_report(summarize_tasks(task_records))
+    detection_records = log.detection_records()
+    if detection_records:
+      print_detection_report(summarize_detection(detection_records))
+    fan_records = log.fan_records()
+    if fan_records:
+      print_fan_report(summarize_fan(fan_records))
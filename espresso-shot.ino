@@ -10,70 +10,161 @@
     https://www.home-barista.com/espresso-machines/monitoring-brew-temperature-e61-groups-t1352.html).
     The basket thermistor is wrapped in foil tape and sandwiched between the
     portafilter basket and the grouphead.
-  - Times the shot using a tilt switch taped to the brew lever.
-  - Controls a DC fan which cools the grouphead to a target temperature. The
-    target temperature is user-selectable with two push buttons.
-  - Displays basket temperature, group temperature, and shot time on an OLED
-    screen.
-  - Sends time and temperature logging information over serial. A companion
-    Python script listens to the serial channel and converts the information
-    into JSON files that a companion Jupyter Notebook can then read and display.
+  - Times the shot using a tilt switch taped to the brew lever, and detects
+    shots from the temperatures when the tilt switch misses them.
+  - Controls a DC fan which cools the grouphead to a target temperature,
+    optionally anticipating how the grouphead heats up once shots start and
+    end, and measuring the fan's speed to report stalls. The target
+    temperature is user-selectable with two push buttons.
+  - Estimates the puck temperature from the group temperature.
+  - Displays basket (or estimated puck) temperature, group temperature, and
+    shot time on an OLED screen, and counts down the time until the grouphead
+    is at its target temperature.
+  - Sends time and temperature logging information over serial, along with
+    periodic RAM, bus and CPU usage diagnostics. A companion Python script
+    listens to the serial channel and converts the information into JSON files
+    that a companion Jupyter Notebook can then read and display.
 */
 
 #include <Adafruit_ADS1015.h>
 #include <Button.h>
+// Makes tasks measure how late they start (Task::getStartDelay).
+#define _TASK_TIMECRITICAL
 #include <TaskScheduler.h>
 #include <U8g2lib.h>
 #include <Wire.h>
 
+#include "bus.h"
+#include "config.h"
 #include "constants.h"
 #include "data_structures.h"
 #include "functions.h"
+#include "power.h"
 
 // We use an ADS1115 for data acquisition and an OLED screen to display
 // information. We also monitor two button switches (target group temperature
 // increase / decrease) and one tilt switch (brew lever up / down).
 Adafruit_ADS1115 ads1115;
 U8G2_SSD1306_128X64_NONAME_1_HW_I2C u8g2(U8G2_R0);
-Button temperature_increase_button(TARGET_TEMPERATURE_INCREASE_PIN, 100);
-Button temperature_decrease_button(TARGET_TEMPERATURE_DECREASE_PIN, 100);
-Button tilt_switch(TILT_PIN, 100);
+Button temperature_increase_button(
+    DefaultConfig::target_temperature_increase_pin, 100);
+Button temperature_decrease_button(
+    DefaultConfig::target_temperature_decrease_pin, 100);
+Button tilt_switch(DefaultConfig::tilt_pin, 100);
 
 // Device state.
-DeviceState state;
+DeviceState<DefaultConfig> state;
+
+// History of the latest shots, kept in non-volatile storage.
+ShotHistory history;
+
+// The ADC and the OLED screen share the I2C bus. Tasks queue their bus
+// transactions, which the main loop runs in steps.
+BusScheduler bus;
+
+// Frames aren't sent while the shot history is, since the host reads the
+// history as one contiguous transfer.
+bool sense_step(void*) {
+  update_resistances(ads1115, state);
+  if (!history.sending())
+    write_measurement(state);
+  return false;
+}
+bool refresh_display_step(void*) {
+  return refresh_display(u8g2, state.display);
+}
+
+// Records the edges of the fan's tachometer output.
+void record_tachometer_edge() {
+  state.tachometer.record_edge(micros());
+}
+
+#if defined(ARDUINO_ARCH_AVR)
+// The AVR cores map pins to interrupts with a constant expression, so a
+// tachometer on a pin that can't trigger one (which would read as a stalled
+// fan) is caught here.
+static_assert(!DefaultConfig::has_fan_tachometer ||
+                  digitalPinToInterrupt(DefaultConfig::tachometer_pin) !=
+                      NOT_AN_INTERRUPT,
+              "TACHOMETER_PIN can't trigger an external interrupt");
+#endif
 
 // Task scheduler.
-void update_machine_state_callback() {
-  update_machine_state(temperature_increase_button, temperature_decrease_button,
-                       tilt_switch, state);
+Scheduler runner;
+
+// Records how late the running task started.
+void record_start_delay(unsigned long& max_delay) {
+  max_delay = max(max_delay,
+                  (unsigned long) runner.currentTask().getStartDelay());
+}
+
+void control_tick_callback() {
+  record_start_delay(state.scheduler_usage.max_control_delay);
+  control_tick(temperature_increase_button, temperature_decrease_button,
+               tilt_switch, state);
+  update_history(state, history);
+  handle_serial_commands(history);
 }
-void update_timer_callback() { update_timer(state); }
 void sense_callback() {
-  update_resistances(ads1115, state);
-  write_measurement(state);
+  record_start_delay(state.scheduler_usage.max_sensing_delay);
+  bus.enqueue(ADC_DEVICE, &sense_step, nullptr, ADC_PRIORITY);
+}
+void write_diagnostics_callback() {
+  if (history.sending())
+    return;
+  write_diagnostics(state);
+  write_bus_usage(bus, DefaultConfig::i2c_clock);
+  write_task_usage(state);
+  write_shot_detection(state);
+  write_fan(state);
+}
+void refresh_display_callback() {
+  update_display(state);
+  bus.enqueue(DISPLAY_DEVICE, &refresh_display_step, nullptr, DISPLAY_PRIORITY);
 }
-void control_fan_callback() { control_fan(state); }
-void refresh_display_callback() { refresh_display(u8g2, state); }
 
 Task tasks[] = {
-    {DEFAULT_TASK_PERIOD, TASK_FOREVER, &update_machine_state_callback},
-    {DEFAULT_TASK_PERIOD, TASK_FOREVER, &update_timer_callback},
-    {SENSING_PERIOD, TASK_FOREVER, &sense_callback},
-    {DEFAULT_TASK_PERIOD, TASK_FOREVER, &control_fan_callback},
-    {DISPLAY_PERIOD, TASK_FOREVER, &refresh_display_callback}
+    {DefaultConfig::default_task_period, TASK_FOREVER, &control_tick_callback},
+    {DefaultConfig::sensing_period, TASK_FOREVER, &sense_callback},
+    {DefaultConfig::display_period, TASK_FOREVER, &refresh_display_callback},
+    {DefaultConfig::diagnostics_period, TASK_FOREVER,
+     &write_diagnostics_callback}
 };
 
-Scheduler runner;
+// Sleeps until the next task is due. The sleep can end early (e.g. on AVR
+// boards, it ends on every millis() timer interrupt), in which case the main
+// loop checks the tasks and sleeps again.
+void idle_until_next_task() {
+  long idle_time = -1;
+  for (Task& task : tasks) {
+    long time_until_task = runner.timeUntilNextIteration(task);
+    if (time_until_task >= 0 && (idle_time < 0 || time_until_task < idle_time))
+      idle_time = time_until_task;
+  }
+  if (idle_time > 0)
+    state.scheduler_usage.idle_time += idle(idle_time);
+}
 
 void setup() {
   Serial.begin(9600);
   ads1115.begin();
+  // U8g2 sets the bus clock before every transfer, so both devices use the
+  // same clock.
+  u8g2.setBusClock(DefaultConfig::i2c_clock);
   u8g2.begin();
+  Wire.setClock(DefaultConfig::i2c_clock);
   temperature_increase_button.begin();
   temperature_decrease_button.begin();
   tilt_switch.begin();
-  pinMode(FAN_PIN, OUTPUT);
+  pinMode(DefaultConfig::fan_pin, OUTPUT);
   initialize_state(ads1115, state);
+  if (DefaultConfig::has_fan_tachometer) {
+    // Fan tachometer outputs are open collector.
+    pinMode(DefaultConfig::tachometer_pin, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(DefaultConfig::tachometer_pin),
+                    record_tachometer_edge, FALLING);
+  }
+  history.begin();
 
   runner.init();
   for (Task& task : tasks) {
@@ -84,4 +175,8 @@ void setup() {
 
 void loop() {
   runner.execute();
+  // Queued bus transactions run right away, and the CPU only sleeps once they
+  // are all done.
+  if (!bus.run())
+    idle_until_next_task();
 }
@@ -2,7 +2,11 @@
 
 The script builds and uploads the Arduino sketch to the device, then starts
 listening to serial communication on the upload port and records measurement
-series to JSON files.
+series to JSON files. The device's RAM usage diagnostics, I2C bus usage and
+task CPU usage are logged to `data/diagnostics.csv`, `data/bus.csv` and
+`data/tasks.csv` (see diagnostics.py). On connecting, the script also downloads
+the shots the device kept while no host was connected to `data/history.jsonl`
+(see history.py).
 
 Example usage:
 
@@ -12,7 +16,6 @@ The space key toggles between saving measurement series to disk and simply
 displaying data on screen.
 """
 import argparse
-import collections
 import curses
 import datetime
 import functools
@@ -20,102 +23,256 @@ import json
 import struct
 import time
 
-import numpy as np
 import serial
 
+import archive
+import catalog
+import diagnostics
+import history
 import utils
 
 
-def main_loop(stdscr, port, simulate):
-  """Runs the main loop.
+class TerminalView:
+  """Live view of the device's measurements in the terminal.
 
-  Args:
-    stdscr: curses window object.
-    port: str, upload port.
-    simulate: bool, whether to simulate a connected device.
+  The view is redrawn at a fixed frame rate rather than for every measurement,
+  and only the cells whose text changed since the previous frame are written
+  to the terminal.
   """
-  serial_class = utils.MockSerial if simulate else serial.Serial
-  serial_port = serial_class(port=port, baudrate=9600)
 
-  # We average temperatures over the previous 100 measurements.
-  basket_temperatures = collections.deque(maxlen=100)
-  group_temperatures = collections.deque(maxlen=100)
+  def __init__(self, stdscr, frame_rate):
+    """Instantiates the view.
 
-  curses.curs_set(0)
-  stdscr.nodelay(True)
-  stdscr.clear()
+    Args:
+      stdscr: curses window object.
+      frame_rate: float, number of frames drawn per second.
+    """
+    self._stdscr = stdscr
+    self._frame_period = 1.0 / frame_rate
+    self._next_frame_time = time.monotonic()
+    self._cells = {}
+    self._size = None
 
-  record_mode = False
+  def due(self):
+    """Returns whether it is time to draw a new frame."""
+    return time.monotonic() >= self._next_frame_time
 
-  while True:
-    # Read serial one measurement at a time.
-    measurement = utils.read_measurement(serial_port)
-    elapsed_time = measurement[0]
-    basket_temperature, group_temperature, state = measurement[-3:]
+  def draw(self, elapsed_time, group_temperature, basket_temperature, state,
+           record_mode):
+    """Draws a frame.
 
-    basket_temperatures.append(basket_temperature)
-    group_temperatures.append(group_temperature)
+    Args:
+      elapsed_time: float, shot timer value.
+      group_temperature: float, average group temperature.
+      basket_temperature: float, average basket temperature.
+      state: utils.State, machine state.
+      record_mode: bool, whether shots are being recorded.
+    """
+    self._next_frame_time = max(self._next_frame_time + self._frame_period,
+                                time.monotonic())
 
-    # The space key toggles the recording mode.
-    try:
-      key = stdscr.getkey()
-    except:
-      key = None
-    if key == ' ':
-      record_mode = not record_mode
-
-    # Update the terminal display
-    stdscr.clear()
-    num_rows, num_cols = stdscr.getmaxyx()
+    # Everything needs to be redrawn when the terminal is resized.
+    size = self._stdscr.getmaxyx()
+    if size != self._size:
+      self._size = size
+      self._cells.clear()
+      self._stdscr.clear()
+    num_rows, num_cols = size
     section_width = num_cols // 4
 
-    stdscr.addstr(0, 0, 'Elapsed time', curses.A_BOLD)
-    stdscr.addstr(1, 0, '{:.2f}'.format(elapsed_time))
+    self._draw_cell(0, 0, 'Elapsed time', curses.A_BOLD)
+    self._draw_cell(1, 0, '{:.2f}'.format(elapsed_time))
 
-    stdscr.addstr(0, section_width, 'Group temperature', curses.A_BOLD)
-    mean = np.mean(group_temperatures)
-    stdscr.addstr(1, section_width,
-                  ('{:.3f}C'.format(mean) if mean > -273.0 else '---C'))
+    self._draw_cell(0, section_width, 'Group temperature', curses.A_BOLD)
+    self._draw_cell(1, section_width, (
+        '{:.3f}C'.format(group_temperature) if group_temperature > -273.0
+        else '---C'))
 
-    stdscr.addstr(0, 2 * section_width, 'Basket temperature', curses.A_BOLD)
-    mean = np.mean(basket_temperatures)
-    stdscr.addstr(1, 2 * section_width,
-                  ('{:.3f}C'.format(mean) if mean > -273.0 else '---C'))
+    self._draw_cell(0, 2 * section_width, 'Basket temperature', curses.A_BOLD)
+    self._draw_cell(1, 2 * section_width, (
+        '{:.3f}C'.format(basket_temperature) if basket_temperature > -273.0
+        else '---C'))
 
-    stdscr.addstr(0, 3 * section_width, 'State', curses.A_BOLD)
-    stdscr.addstr(1, 3 * section_width, str(utils.State(state)))
+    self._draw_cell(0, 3 * section_width, 'State', curses.A_BOLD)
+    self._draw_cell(1, 3 * section_width, str(utils.State(state)))
 
     record_mode_string = 'Recording' if record_mode else 'Not recording'
-    stdscr.addstr(num_rows - 1, num_cols - len(record_mode_string) - 1,
-                  record_mode_string)
-    stdscr.refresh()
+    self._draw_cell(num_rows - 1, num_cols - len('Not recording') - 1,
+                    record_mode_string.rjust(len('Not recording')))
+    self._stdscr.refresh()
+
+  def _draw_cell(self, row, col, text, attributes=curses.A_NORMAL):
+    previous_text = self._cells.get((row, col))
+    if text == previous_text:
+      return
+    # Pad the text to erase whatever remains of longer previous text.
+    padded_text = text.ljust(len(previous_text or ''))
+    try:
+      self._stdscr.addstr(row, col, padded_text, attributes)
+    except curses.error:
+      # The terminal is too small to hold the cell.
+      pass
+    self._cells[(row, col)] = text
+
+
+class ShotRecorder:
+  """Records shots from the measurement stream.
+
+  A shot begins with the state "START" and ends with the state "STOP". When
+  recording, finished shots are serialized to a JSON file named after the date
+  and time at which they began, appended to the shot archive and summarized in
+  the catalog.
+
+  Shots are stamped with the calibration version that the device reports (see
+  `set_calibration_version`), or with 0 if it hasn't reported one yet, which
+  makes recalibrate.py recompute their temperatures.
+  """
+
+  def __init__(self, shot_archive, shot_catalog, device,
+               data_directory='data'):
+    """Instantiates the recorder.
+
+    Args:
+      shot_archive: archive.Archive, archive to append shots to.
+      shot_catalog: catalog.Catalog, catalog to summarize shots in.
+      device: str, name of the device that records the shots.
+      data_directory: str, directory to write JSON shot files to.
+    """
+    self._calibration_version = 0
+    self._shot_archive = shot_archive
+    self._shot_catalog = shot_catalog
+    self._device = device
+    self._data_directory = data_directory
+    self._file_path = None
+    self._shot_data = None
+
+  def set_calibration_version(self, version):
+    """Sets the calibration version used by the device to compute temperatures.
+
+    Args:
+      version: int, calibration version reported by the device (e.g. in a
+        `utils.HistoryHeader`).
+    """
+    self._calibration_version = version
+
+  def update(self, measurement, record_mode):
+    """Processes a measurement.
+
+    Args:
+      measurement: tuple, measurement as returned by `utils.read_measurement`.
+      record_mode: bool, whether finished shots are saved.
+    """
+    elapsed_time = measurement[0]
+    basket_resistance, group_resistance = measurement[1:3]
+    basket_temperature, group_temperature, state, fan_on = measurement[3:]
 
     # A new measurement series begins with the state "START".
     if state == utils.State.START:
       # We will write the measurement series to a JSON file with the current
       # date and time as its name.
-      file_path = 'data/{}.json'.format(''.join(
+      self._file_path = '{}/{}.json'.format(self._data_directory, ''.join(
           datetime.datetime.now().isoformat('-', timespec='seconds').split(':')
       ))
-      # The shot data to be serialized to JSON.
-      shot_data = {
+      # The shot data to be serialized to JSON. Raw resistances are recorded
+      # along with the calibration version used to compute temperatures, so
+      # that temperatures can be recomputed after recalibrating thermistors.
+      # The version is the device's as of the end of the shot.
+      self._shot_data = {
         'posix time': time.time(),
         'description': "",
+        'calibration version': self._calibration_version,
         'time': [],
+        'basket_resistance': [],
+        'group_resistance': [],
         'basket_temperature': [],
         'group_temperature': [],
+        'fan': [],
       }
     # A measurement series ends with the state "STOP".
     elif state == utils.State.STOP:
-      # When the measurement series ends, we serialize it to a JSON file.
-      if record_mode and not simulate:
-        with open(file_path, 'w') as f:
-          json.dump(shot_data, f)
+      # When the measurement series ends, we serialize it to a JSON file,
+      # append it to the shot archive and add its summary to the catalog.
+      if record_mode and self._shot_data is not None:
+        self._shot_data['calibration version'] = self._calibration_version
+        with open(self._file_path, 'w') as f:
+          json.dump(self._shot_data, f)
+        self._shot_archive.append(self._shot_data)
+        self._shot_catalog.add(self._shot_data, len(self._shot_archive) - 1,
+                               device=self._device)
+      self._shot_data = None
     # When running, we record shot data.
-    elif state == utils.State.RUNNING:
-      shot_data['time'].append(elapsed_time)
-      shot_data['basket_temperature'].append(basket_temperature)
-      shot_data['group_temperature'].append(group_temperature)
+    elif state == utils.State.RUNNING and self._shot_data is not None:
+      self._shot_data['time'].append(elapsed_time)
+      self._shot_data['basket_resistance'].append(basket_resistance)
+      self._shot_data['group_resistance'].append(group_resistance)
+      self._shot_data['basket_temperature'].append(basket_temperature)
+      self._shot_data['group_temperature'].append(group_temperature)
+      self._shot_data['fan'].append(int(fan_on))
+
+
+def main_loop(stdscr, port, simulate, frame_rate):
+  """Runs the main loop.
+
+  Args:
+    stdscr: curses window object.
+    port: str, upload port.
+    simulate: bool, whether to simulate a connected device.
+    frame_rate: float, number of times per second the terminal is redrawn.
+  """
+  serial_class = utils.MockSerial if simulate else serial.Serial
+  serial_port = serial_class(port=port, baudrate=9600)
+
+  # We average temperatures over the previous 100 measurements.
+  basket_temperatures = utils.RunningMean(maxlen=100)
+  group_temperatures = utils.RunningMean(maxlen=100)
+
+  curses.curs_set(0)
+  stdscr.nodelay(True)
+  stdscr.clear()
+  view = TerminalView(stdscr, frame_rate)
+
+  record_mode = False
+  shot_archive = archive.Archive()
+  shot_catalog = catalog.Catalog()
+  shot_catalog.sync(shot_archive)
+  recorder = ShotRecorder(shot_archive, shot_catalog, device=port)
+  # The device's RAM, bus and task usage diagnostics are logged as they arrive.
+  on_diagnostics = functools.partial(diagnostics.DiagnosticsLog().append,
+                                     device=port)
+  # The device's shot history is downloaded once, when the script connects,
+  # and its header reports the device's calibration version.
+  history_store = history.HistoryStore()
+  def on_history(header, records):
+    recorder.set_calibration_version(header.calibration_version)
+    history_store.merge(history.decode(header, records), device=port)
+  serial_port.write(history.HISTORY_COMMAND)
+
+  while True:
+    # Read serial one measurement at a time.
+    measurement = utils.read_measurement(serial_port, on_diagnostics,
+                                         on_history)
+    elapsed_time = measurement[0]
+    basket_temperature, group_temperature, state = measurement[3:6]
+
+    basket_temperatures.append(basket_temperature)
+    group_temperatures.append(group_temperature)
+
+    # The terminal is only polled and redrawn at the view's frame rate, so
+    # that ingesting measurements doesn't wait on the terminal.
+    if view.due():
+      # The space key toggles the recording mode.
+      try:
+        key = stdscr.getkey()
+      except curses.error:
+        key = None
+      if key == ' ':
+        record_mode = not record_mode
+
+      view.draw(elapsed_time, group_temperatures.mean,
+                basket_temperatures.mean, state, record_mode)
+
+    # Simulated shots are never saved.
+    recorder.update(measurement, record_mode and not simulate)
 
 
 if __name__ == '__main__':
@@ -133,6 +290,9 @@ if __name__ == '__main__':
   parser.add_argument(
       '--simulate', action='store_true',
       help='Simulate a connected Arduino device.')
+  parser.add_argument(
+      '--frame_rate', type=float, default=10.0,
+      help='Number of times per second the terminal display is refreshed.')
   args = parser.parse_args()
 
   fqbn = args.fqbn
@@ -149,4 +309,5 @@ if __name__ == '__main__':
       main_loop,
       port=port,
       simulate=simulate,
+      frame_rate=args.frame_rate,
   ))
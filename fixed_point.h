@@ -0,0 +1,239 @@
+/*
+  Fixed-point arithmetic.
+
+  Boards without a floating point unit (e.g. ATmega-based boards) emulate float
+  arithmetic in software, which is slow and takes several KB of flash. On those
+  boards, the sensing-to-display pipeline works with the Q-format numbers
+  defined here instead (see USE_FIXED_POINT in constants.h).
+
+  Those boards also lack a divider, and a 64-bit division takes their runtime
+  library several times longer than a 32-bit one (and about as long as a float
+  division), so divisions are kept to 32 bits. Multiplications may widen to 64
+  bits, which costs far less.
+*/
+#ifndef ESPRESSO_SHOT_FIXED_POINT_H_
+#define ESPRESSO_SHOT_FIXED_POINT_H_
+
+#include <Arduino.h>
+#include <math.h>
+#include <stdint.h>
+
+// Saturates a 64-bit integer to the range of 32-bit integers.
+inline int32_t saturate(int64_t value) {
+  return value > INT32_C(0x7FFFFFFF) ? INT32_C(0x7FFFFFFF) :
+         value < -INT32_C(0x7FFFFFFF) - 1 ? -INT32_C(0x7FFFFFFF) - 1 :
+         int32_t(value);
+}
+
+// Signed fixed-point number with FRACTIONAL_BITS fractional bits, stored in 32
+// bits. Arithmetic saturates at the ends of the representable range instead of
+// wrapping around, and saturated values stand for out-of-range values (e.g. the
+// infinite resistance of a disconnected thermistor).
+template <int FRACTIONAL_BITS>
+class Fixed {
+ public:
+  static constexpr int32_t MAX_RAW = INT32_C(0x7FFFFFFF);
+  static constexpr int32_t MIN_RAW = -MAX_RAW - 1;
+
+  constexpr Fixed() : raw_(0) {}
+
+  static constexpr Fixed from_raw(int32_t raw) { return Fixed(raw, 0); }
+
+  // Converts a constant. This is meant to be evaluated at compile time, so that
+  // constants don't need float arithmetic at run time.
+  static constexpr Fixed from_double(double value) {
+    return from_raw(
+        value * SCALE >= MAX_RAW ? MAX_RAW :
+        value * SCALE <= MIN_RAW ? MIN_RAW :
+        int32_t(value * SCALE + (value < 0.0 ? -0.5 : 0.5)));
+  }
+
+  // Returns whether a constant is within the representable range.
+  static constexpr bool can_represent(double value) {
+    return value * SCALE < MAX_RAW && value * SCALE > MIN_RAW;
+  }
+
+  static Fixed from_int(int32_t value) {
+    return from_raw(saturate(int64_t(value) << FRACTIONAL_BITS));
+  }
+
+  static constexpr Fixed max() { return from_raw(MAX_RAW); }
+  static constexpr Fixed min() { return from_raw(MIN_RAW); }
+
+  constexpr int32_t raw() const { return raw_; }
+  constexpr bool is_saturated() const {
+    return raw_ == MAX_RAW || raw_ == MIN_RAW;
+  }
+
+  // Converts to float, mapping saturated values to infinities.
+  float to_float() const {
+    return raw_ == MAX_RAW ? INFINITY : raw_ == MIN_RAW ? -INFINITY :
+           raw_ * (1.0f / SCALE);
+  }
+
+  // Converts to another number of fractional bits.
+  template <int OTHER_FRACTIONAL_BITS>
+  Fixed<OTHER_FRACTIONAL_BITS> convert() const {
+    return Fixed<OTHER_FRACTIONAL_BITS>::from_raw(saturate(
+        OTHER_FRACTIONAL_BITS >= FRACTIONAL_BITS ?
+            int64_t(raw_) << (OTHER_FRACTIONAL_BITS - FRACTIONAL_BITS) :
+            int64_t(raw_) >> (FRACTIONAL_BITS - OTHER_FRACTIONAL_BITS)));
+  }
+
+  Fixed operator+(Fixed other) const {
+    return from_raw(saturate(int64_t(raw_) + other.raw_));
+  }
+  Fixed operator-(Fixed other) const {
+    return from_raw(saturate(int64_t(raw_) - other.raw_));
+  }
+  Fixed operator-() const { return from_raw(saturate(-int64_t(raw_))); }
+  Fixed operator*(Fixed other) const {
+    return from_raw(saturate(
+        (int64_t(raw_) * other.raw_) >> FRACTIONAL_BITS));
+  }
+  Fixed operator/(int32_t divisor) const { return from_raw(raw_ / divisor); }
+
+  constexpr bool operator<(Fixed other) const { return raw_ < other.raw_; }
+  constexpr bool operator>(Fixed other) const { return raw_ > other.raw_; }
+  constexpr bool operator<=(Fixed other) const { return raw_ <= other.raw_; }
+  constexpr bool operator>=(Fixed other) const { return raw_ >= other.raw_; }
+  constexpr bool operator==(Fixed other) const { return raw_ == other.raw_; }
+  constexpr bool operator!=(Fixed other) const { return raw_ != other.raw_; }
+
+ private:
+  static constexpr double SCALE = double(int64_t(1) << FRACTIONAL_BITS);
+
+  constexpr Fixed(int32_t raw, int) : raw_(raw) {}
+
+  int32_t raw_;
+};
+
+template <int FRACTIONAL_BITS>
+constexpr int32_t Fixed<FRACTIONAL_BITS>::MAX_RAW;
+template <int FRACTIONAL_BITS>
+constexpr int32_t Fixed<FRACTIONAL_BITS>::MIN_RAW;
+template <int FRACTIONAL_BITS>
+constexpr double Fixed<FRACTIONAL_BITS>::SCALE;
+
+// Multiplies numbers of different formats, rounding the exact product to the
+// result's format.
+template <int RESULT_BITS, int A_BITS, int B_BITS>
+Fixed<RESULT_BITS> multiply(Fixed<A_BITS> a, Fixed<B_BITS> b) {
+  static_assert(A_BITS + B_BITS >= RESULT_BITS && A_BITS + B_BITS < 63 +
+                RESULT_BITS, "unsupported formats");
+  int64_t product = int64_t(a.raw()) * b.raw();
+  if (A_BITS + B_BITS > RESULT_BITS)
+    product = ((product >> (A_BITS + B_BITS - RESULT_BITS - 1)) + 1) >> 1;
+  return Fixed<RESULT_BITS>::from_raw(saturate(product));
+}
+
+// Returns the index of the most significant set bit of a nonzero value.
+inline int most_significant_bit(uint32_t value) {
+  int bit = 0;
+  for (int shift = 16; shift > 0; shift /= 2) {
+    if (value >> shift) {
+      value >>= shift;
+      bit += shift;
+    }
+  }
+  return bit;
+}
+
+// Computes 1 / x for positive x, truncated to the result's format.
+template <int RESULT_BITS, int FRACTIONAL_BITS>
+Fixed<RESULT_BITS> reciprocal(Fixed<FRACTIONAL_BITS> x) {
+  static_assert(RESULT_BITS + FRACTIONAL_BITS < 63, "unsupported formats");
+  if (x.raw() <= 0)
+    return Fixed<RESULT_BITS>::max();
+
+  // Long division of 2^(RESULT_BITS + FRACTIONAL_BITS) by x, one quotient bit
+  // at a time. The quotient's bits above the divisor's most significant bit
+  // are zero, so the division starts with the dividend's leading bit aligned
+  // with it, and the remainder stays below twice the divisor (2^32).
+  uint32_t divisor = x.raw();
+  int msb = most_significant_bit(divisor);
+  uint32_t remainder = UINT32_C(1) << msb;
+  uint32_t quotient = 0;
+  for (int bit = RESULT_BITS + FRACTIONAL_BITS - msb; bit >= 0; --bit) {
+    if (quotient >> 30)
+      return Fixed<RESULT_BITS>::max();
+    quotient <<= 1;
+    if (remainder >= divisor) {
+      remainder -= divisor;
+      quotient |= 1;
+    }
+    remainder <<= 1;
+  }
+  return Fixed<RESULT_BITS>::from_raw(int32_t(quotient));
+}
+
+// Computes a * b / divisor for a positive divisor, rounded to nearest and
+// saturated to INT32_MAX, with 32-bit divisions only: a * b is split into its
+// upper bits and its 16 lower bits, which are divided in turn like digits in a
+// long division.
+inline int32_t multiply_divide(uint32_t a, uint16_t b, uint16_t divisor) {
+  uint32_t low = (a & UINT32_C(0xFFFF)) * b + divisor / 2;
+  uint32_t high = (a >> 16) * b + (low >> 16);
+  uint32_t high_quotient = high / divisor;
+  if (high_quotient >> 15)
+    return INT32_C(0x7FFFFFFF);
+  uint32_t remainder = high - high_quotient * divisor;
+  return int32_t((high_quotient << 16) |
+                 (((remainder << 16) | (low & UINT32_C(0xFFFF))) / divisor));
+}
+
+// Computes the natural logarithm of positive x, with an absolute error below
+// 1.5e-6.
+template <int FRACTIONAL_BITS>
+Fixed<24> log(Fixed<FRACTIONAL_BITS> x) {
+  if (x.raw() <= 0)
+    return Fixed<24>::min();
+
+  // x = 2^exponent * (1 + t), with t in [0, 1) stored with 30 fractional bits.
+  uint32_t raw = x.raw();
+  int msb = most_significant_bit(raw);
+  uint32_t mantissa = msb > 30 ? raw >> (msb - 30) : raw << (30 - msb);
+  int64_t t = int64_t(mantissa) - (INT32_C(1) << 30);
+
+  // Minimax polynomial approximation of log2(1 + t) on [0, 1), evaluated with
+  // Horner's method. Coefficients have 30 fractional bits, and are kept in
+  // flash.
+  static const int32_t COEFFICIENTS[] PROGMEM = {
+      INT32_C(-28408458), INT32_C(132554990), INT32_C(-300151754),
+      INT32_C(492064513), INT32_C(-771249334), INT32_C(1548929645)};
+  int64_t log2_mantissa = 0;
+  for (const int32_t& coefficient : COEFFICIENTS) {
+    log2_mantissa = ((log2_mantissa * t) >> 30) +
+                    int32_t(pgm_read_dword(&coefficient));
+  }
+  log2_mantissa = (log2_mantissa * t) >> 30;
+
+  // log(x) = log(2) * (exponent + log2(1 + t)).
+  static constexpr Fixed<30> LN2 = Fixed<30>::from_double(M_LN2);
+  Fixed<24> log2_x = Fixed<24>::from_raw(
+      int32_t(msb - FRACTIONAL_BITS) * (INT32_C(1) << 24) +
+      int32_t(log2_mantissa >> 6));
+  return multiply<24>(log2_x, LN2);
+}
+
+// Converts fixed-point or float numbers to float, e.g. to send them over
+// serial.
+inline float to_float(float x) { return x; }
+
+template <int FRACTIONAL_BITS>
+float to_float(Fixed<FRACTIONAL_BITS> x) { return x.to_float(); }
+
+// Converts a constant to T, a Fixed type or float.
+template <typename T>
+constexpr T from_double(double value) { return T::from_double(value); }
+
+template <>
+constexpr float from_double<float>(double value) { return value; }
+
+// Formats used by the sensing pipeline. Resistances (in Ohms) have a resolution
+// of 1/16 Ohm, which is finer than the ADC's, and range up to about 134 MOhms.
+// Temperatures (in degrees Celsius) have a resolution of about 1.5e-5 degrees.
+typedef Fixed<4> FixedResistance;
+typedef Fixed<16> FixedTemperature;
+
+#endif  // ESPRESSO_SHOT_FIXED_POINT_H_
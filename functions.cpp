@@ -3,198 +3,193 @@
 */
 #include "functions.h"
 
-void initialize_state(Adafruit_ADS1115& ads1115, DeviceState& state) {
-  // Initialize running state.
-  state.machine_state = STOPPED;
-
-  // Initialize resistances and temperatures.
-  float basket_resistance = read_basket_resistance(ads1115);
-  float group_resistance = read_group_resistance(ads1115);
-
-  for (int i = 0; i < BUFFER_SIZE; ++i) {
-    state.basket_resistance_buffer[i] = basket_resistance;
-    state.group_resistance_buffer[i] = group_resistance;
-  }
-  state.latest_buffer_index = BUFFER_SIZE - 1;
-
-  state.target_group_temperature = TARGET_TEMPERATURE_DEFAULT;
-  state.current_basket_temperature = basket_resistance_to_temperature(
-      basket_resistance);
-  state.current_group_temperature = group_resistance_to_temperature(
-      group_resistance);
-
-  // Initialize time.
-  state.start_time = millis();
-  state.last_display_refresh = state.start_time;
-  state.last_target_change = state.start_time;
-  state.elapsed_time = 0.0;
-}
-
-void update_machine_state(Button& temperature_increase_button,
-                          Button& temperature_decrease_button,
-                          Button& tilt_switch,
-                          DeviceState& state) {
-  if (temperature_increase_button.pressed()) {
-    state.target_group_temperature = min(
-        state.target_group_temperature + TARGET_TEMPERATURE_INCREMENT,
-        TARGET_TEMPERATURE_MAX);
-    state.last_target_change = millis();
-  } else if (temperature_decrease_button.pressed()) {
-    state.target_group_temperature = max(
-        state.target_group_temperature - TARGET_TEMPERATURE_INCREMENT,
-        TARGET_TEMPERATURE_MIN);
-    state.last_target_change = millis();
-  }
-
-  bool lever_up = tilt_switch.read() == Button::RELEASED;
-  switch (state.machine_state) {
-    case START:
-      state.machine_state = lever_up ? RUNNING : STOP;
-      break;
-    case RUNNING:
-      state.machine_state = lever_up ? RUNNING : STOP;
-      break;
-    case STOP:
-      state.machine_state = lever_up ? START : STOPPED;
-      break;
-    case STOPPED:
-      state.machine_state = lever_up ? START : STOPPED;
-      break;
-  }
-}
-
-void update_timer(DeviceState& state) {
-  unsigned long current_time = millis();
-
-  // When a state transition from "stopped" to "running" occurs, reset the
-  // elapsed time and start the timer.
-  if (state.machine_state == START) {
-    state.start_time = current_time;
-    state.elapsed_time = 0.0;
-  }
-
-  // When the machine is running or has just stopped, update the timer.
-  if (state.machine_state != STOPPED)
-    state.elapsed_time = (current_time - state.start_time) / 1000.0;
-}
-
-void update_resistances(Adafruit_ADS1115& ads1115,
-                        DeviceState& state) {
-  // Update resistance buffers.
-  int index = (state.latest_buffer_index + 1) % BUFFER_SIZE;
-  state.basket_resistance_buffer[index] = read_basket_resistance(ads1115);
-  state.group_resistance_buffer[index] = read_group_resistance(ads1115);
-  state.latest_buffer_index = index;
-
-  // Compute resistance averages and their corresponding temperatures. It would
-  // be more efficient to remove the the resistance overwritten in the buffer
-  // from the average and add the new resistance to the average, but since
-  // thermistors can be disconnected from the device the running average can be
-  // contaminated by NaNs. We use the inefficient but safe approach instead.
-  float basket_resistance_sum = 0.0;
-  float group_resistance_sum = 0.0;
-  for (int i = 0; i < BUFFER_SIZE; ++i) {
-    basket_resistance_sum += state.basket_resistance_buffer[i];
-    group_resistance_sum += state.group_resistance_buffer[i];
-  }
-
-  state.current_basket_temperature = basket_resistance_to_temperature(
-      basket_resistance_sum / BUFFER_SIZE);
-  state.current_group_temperature = group_resistance_to_temperature(
-      group_resistance_sum / BUFFER_SIZE);
-}
-
-void write_measurement(const DeviceState& state) {
-  int index = state.latest_buffer_index;
-  float basket_resistance = state.basket_resistance_buffer[index];
-  float group_resistance = state.group_resistance_buffer[index];
-  Measurement measurement = {
-      state.elapsed_time,
-      basket_resistance,
-      group_resistance,
-      basket_resistance_to_temperature(basket_resistance),
-      group_resistance_to_temperature(group_resistance),
-      long(state.machine_state)
-  };
-  Serial.write((byte *) &measurement, sizeof(measurement));
-}
-
-void control_fan(DeviceState& state) {
-  // We cool the grouphead until it reaches the target temperature. We could
-  // eventually dampen the temperature swings by implementing PID control, but
-  // for now this is good enough.
-  bool over_target_temperature = state.current_group_temperature >
-                                 state.target_group_temperature;
-  // Since we are using a BJT to set the voltage at the MOSFET gate, the logic
-  // is inverted and we need to output HIGH to stop the fan.
-  digitalWrite(FAN_PIN, over_target_temperature ? LOW : HIGH);
-}
-
-void refresh_display(U8G2_SSD1306_128X64_NONAME_1_HW_I2C& u8g2,
-                     const DeviceState& state) {
-  char buffer[FORMAT_BUFFER_SIZE];
-
-  // If the target group temperature changed recently, display it instead of the
-  // group temperature.
-  bool display_target = millis() <= state.last_target_change +
-                                    TARGET_DISPLAY_TIME;
-
-  u8g2.firstPage();
-  do {
+#include "seven_segment_font.h"
+
+#if USE_FIXED_POINT
+static_assert(Fixed<39>::can_represent(BASKET_SH_A) &&
+              Fixed<41>::can_represent(BASKET_SH_B) &&
+              Fixed<51>::can_represent(BASKET_SH_C) &&
+              Fixed<39>::can_represent(GROUP_SH_A) &&
+              Fixed<41>::can_represent(GROUP_SH_B) &&
+              Fixed<51>::can_represent(GROUP_SH_C),
+              "Steinhart-Hart coefficients out of fixed-point range");
+#endif
+
+bool refresh_display(U8G2_SSD1306_128X64_NONAME_1_HW_I2C& u8g2,
+                     DisplayContents& display) {
+  // Layout, in tiles of 8x8 pixels (the screen is 16 tiles wide and 8 tiles
+  // high). Temperatures (VWX.YC) are drawn below the header, with the group
+  // temperature on the left and the basket (or estimated puck) temperature on
+  // the right, and the elapsed time (AB:CD.E) is centered at the bottom. The
+  // time to ready (M:SS) is drawn in the header, after its label.
+  constexpr uint8_t temperature_width = 6;
+  constexpr uint8_t temperature_row = 2;
+  constexpr uint8_t basket_column = 16 - temperature_width;
+  constexpr uint8_t elapsed_time_width = 7;
+  constexpr uint8_t elapsed_time_column = 2;
+  constexpr uint8_t elapsed_time_row = 5;
+  constexpr uint8_t time_to_ready_width = 4;
+  constexpr uint8_t time_to_ready_column = 5;
+
+  // The header and the elapsed time's background only change with the header,
+  // so the whole screen is only drawn (and transferred) then, one page per
+  // step.
+  if (display.page > 0 || !display.initialized ||
+      display.target != display.displayed_target ||
+      display.puck != display.displayed_puck ||
+      display.countdown != display.displayed_countdown ||
+      display.stall != display.displayed_stall) {
+    if (display.page == 0) {
+      display.initialized = false;
+      display.displayed_target = display.target;
+      display.displayed_puck = display.puck;
+      display.displayed_countdown = display.countdown;
+      display.displayed_stall = display.stall;
+      u8g2.firstPage();
+    }
     u8g2.setFont(u8g2_font_helvR10_tr);
     u8g2.setFontMode(0);
     u8g2.setDrawColor(1);
 
-    // Draw header.
-    u8g2.drawStr(0, 11, display_target ? "Target" : "Group");
-    u8g2.drawStr(128 - u8g2.getStrWidth("Basket") - 1, 11, "Basket");
-    u8g2.drawLine(0, 13, 127, 13);
-
-    // Display temperatures.
-    format_temperature(buffer,
-                       display_target ? state.target_group_temperature :
-                                        state.current_group_temperature);
-    u8g2.drawStr(0, 30, buffer);
-
-    format_temperature(buffer, state.current_basket_temperature);
-    u8g2.drawStr(128 - u8g2.getStrWidth(buffer) - 1, 30, buffer);
-
-    // Display time.
-    u8g2.drawBox(0, 40, 128, 24);
-    format_elapsed_time(buffer, state.elapsed_time);
-
-    u8g2.setFont(u8g2_font_helvR18_tn);
-    u8g2.setFontMode(1);
-    u8g2.setDrawColor(2);
+    // Draw header. The countdown's glyphs are drawn over the line below the
+    // header, so the line skips them.
+    const char* left_header = display.displayed_target ? "Target" :
+                              display.displayed_stall ? "Fan stall" :
+                              display.displayed_countdown ? "Ready" : "Group";
+    u8g2.drawStr(0, 11, left_header);
+    const char* right_header = display.displayed_puck ? "Puck" : "Basket";
+    u8g2.drawStr(128 - u8g2.getStrWidth(right_header) - 1, 11, right_header);
+    if (display.displayed_countdown) {
+      u8g2.drawLine(0, 13, 8 * time_to_ready_column - 1, 13);
+      u8g2.drawLine(8 * (time_to_ready_column + time_to_ready_width), 13, 127,
+                    13);
+    } else {
+      u8g2.drawLine(0, 13, 127, 13);
+    }
+
+    // Draw the elapsed time's background.
+    u8g2.drawBox(0, 8 * elapsed_time_row, 128, 64 - 8 * elapsed_time_row);
+
+    ++display.page;
+    if (u8g2.nextPage())
+      return true;
+
+    // Drawing the screen erased all fields.
+    display.page = 0;
+    display.initialized = true;
+    memset(display.group_temperature.displayed, 0, FORMAT_BUFFER_SIZE);
+    memset(display.basket_temperature.displayed, 0, FORMAT_BUFFER_SIZE);
+    memset(display.elapsed_time.displayed, 0, FORMAT_BUFFER_SIZE);
+    memset(display.time_to_ready.displayed, 0, FORMAT_BUFFER_SIZE);
+    return true;
+  }
 
-    u8g2.drawStr(24, 61, buffer);
-  } while ( u8g2.nextPage() );
+  // Display temperatures and times, drawing only the glyphs that changed.
+  return update_field(u8g2, display.group_temperature, temperature_width, 0,
+                      temperature_row, false) ||
+         update_field(u8g2, display.basket_temperature, temperature_width,
+                      basket_column, temperature_row, false) ||
+         update_field(u8g2, display.elapsed_time, elapsed_time_width,
+                      elapsed_time_column, elapsed_time_row, true) ||
+         (display.displayed_countdown &&
+          update_field(u8g2, display.time_to_ready, time_to_ready_width,
+                       time_to_ready_column, 0, false));
 }
 
-float basket_resistance_to_temperature(float resistance) {
+Temperature basket_resistance_to_temperature(Resistance resistance) {
+#if USE_FIXED_POINT
+  static constexpr FixedSteinhartHart coefficients(BASKET_SH_A, BASKET_SH_B,
+                                                   BASKET_SH_C);
+  return resistance_to_temperature(resistance, coefficients);
+#else
   return resistance_to_temperature(resistance, BASKET_SH_A, BASKET_SH_B,
                                    BASKET_SH_C);
+#endif
 }
 
-float group_resistance_to_temperature(float resistance) {
+Temperature group_resistance_to_temperature(Resistance resistance) {
+#if USE_FIXED_POINT
+  static constexpr FixedSteinhartHart coefficients(GROUP_SH_A, GROUP_SH_B,
+                                                   GROUP_SH_C);
+  return resistance_to_temperature(resistance, coefficients);
+#else
   return resistance_to_temperature(resistance, GROUP_SH_A, GROUP_SH_B,
                                    GROUP_SH_C);
+#endif
+}
+
+void draw_glyph(U8G2_SSD1306_128X64_NONAME_1_HW_I2C& u8g2, char character,
+                uint8_t x, uint8_t y, bool large) {
+  const char* found = character ? strchr(SEVEN_SEGMENT_CHARACTERS, character) :
+                                  nullptr;
+  int index = (found ? found : strchr(SEVEN_SEGMENT_CHARACTERS, ' ')) -
+              SEVEN_SEGMENT_CHARACTERS;
+  uint8_t width = glyph_width(character, large);
+  uint8_t height = large ? LARGE_GLYPH_HEIGHT : SMALL_GLYPH_HEIGHT;
+
+  // Glyphs are copied out of flash one tile row at a time and sent to the
+  // display as is, which is much cheaper than rendering a font glyph into the
+  // page buffer.
+  uint8_t tiles[8 * LARGE_GLYPH_WIDTH];
+  for (uint8_t row = 0; row < height; ++row) {
+    if (large) {
+      memcpy_P(tiles, LARGE_GLYPHS[index][row], 8 * width);
+      for (uint8_t i = 0; i < 8 * width; ++i)
+        tiles[i] = ~tiles[i];
+    } else {
+      memcpy_P(tiles, SMALL_GLYPHS[index][row], 8 * width);
+    }
+    u8x8_DrawTile(u8g2.getU8x8(), x, y + row, width, tiles);
+  }
+}
+
+uint8_t glyph_width(char character, bool large) {
+  if (!large)
+    return SMALL_GLYPH_WIDTH;
+  return character == '.' || character == ':' ? 1 : LARGE_GLYPH_WIDTH;
+}
+
+bool update_field(U8G2_SSD1306_128X64_NONAME_1_HW_I2C& u8g2,
+                  DisplayField& field, uint8_t width, uint8_t x, uint8_t y,
+                  bool large) {
+  int padding = width - int(strlen(field.text));
+  for (int i = 0; i < width; ++i) {
+    char character = i < padding ? ' ' : field.text[i - padding];
+    if (character != field.displayed[i]) {
+      draw_glyph(u8g2, character, x, y, large);
+      field.displayed[i] = character;
+      return true;
+    }
+    x += glyph_width(character, large);
+  }
+  return false;
 }
 
 void format_elapsed_time(char (&buffer)[FORMAT_BUFFER_SIZE],
-                         float elapsed_time) {
+                         unsigned long elapsed_time) {
   // We only display up to an hour of elapsed time, which is more than enough
   // for an espresso shot. This guarantees a fixed-width representation.
-  elapsed_time = min(elapsed_time, 3599.0);
-  int minutes = int(elapsed_time) / 60;
-  int seconds = int(elapsed_time) % 60;
-  // Casting ten times the elapsed time to int gets rid of all but one decimal
-  // place, and use the remainder of dividing the result by 10 keeps only the
-  // first decimal place.
-  int decimal = int(elapsed_time * 10) % 10;
+  elapsed_time = min(elapsed_time, 3599999UL);
+  int minutes = elapsed_time / 60000;
+  int seconds = (elapsed_time / 1000) % 60;
+  // Only the first decimal place of the seconds is displayed.
+  int decimal = (elapsed_time / 100) % 10;
   snprintf(buffer, sizeof(buffer), "%02d:%02d.%1d", minutes, seconds, decimal);
 }
 
+void format_time_to_ready(char (&buffer)[FORMAT_BUFFER_SIZE],
+                          int16_t seconds) {
+  if (seconds != UNKNOWN_TIME_TO_READY) {
+    // Like the elapsed time, the countdown has a fixed width, and waits longer
+    // than ten minutes are shown as 9:59 (and negative ones as 0:00).
+    seconds = min(max(seconds, int16_t(0)), int16_t(599));
+    snprintf(buffer, sizeof(buffer), "%1u:%02u", uint8_t(seconds / 60),
+             uint8_t(seconds % 60));
+  } else {
+    snprintf(buffer, sizeof(buffer), "-:--");
+  }
+}
+
 void format_temperature(char (&buffer)[FORMAT_BUFFER_SIZE], float temperature) {
   // If the resistance is so high that the temperature is close to absolute
   // zero, that probably means that the wire is disconnected.
@@ -211,20 +206,57 @@ void format_temperature(char (&buffer)[FORMAT_BUFFER_SIZE], float temperature) {
   }
 }
 
-float read_basket_resistance(Adafruit_ADS1115& ads1115) {
-  return read_resistance(ads1115, BASKET_VOLTAGE_CHANNEL,
-                         BASKET_KNOWN_RESISTANCE);
+void format_temperature(char (&buffer)[FORMAT_BUFFER_SIZE],
+                        FixedTemperature temperature) {
+  // Same format as the float version, with the integer part and first decimal
+  // place extracted from the temperature's magnitude. The magnitude is
+  // saturated to 999.9 to keep within the format's width (the remainder, which
+  // is then a no-op, bounds the integer part for -Wformat-truncation even
+  // without optimizations).
+  if (temperature > from_double<FixedTemperature>(-273.0)) {
+    int32_t magnitude = temperature.raw() < 0 ? -temperature.raw() :
+                                                temperature.raw();
+    magnitude = min(magnitude, INT32_C(1000) * 65536 - 1);
+    int integer = (magnitude >> 16) % 1000;
+    if (temperature.raw() < 0)
+      integer = -integer;
+    int decimal = ((magnitude & INT32_C(0xFFFF)) * 10) >> 16;
+    snprintf(buffer, sizeof(buffer), "%3d.%1dC", integer, decimal);
+  } else {
+    snprintf(buffer, sizeof(buffer), "--- C");
+  }
+}
+
+void format_centidegrees(char (&buffer)[FORMAT_BUFFER_SIZE],
+                         int16_t temperature) {
+  if (temperature != DISCONNECTED_CENTIDEGREES) {
+    int integer = temperature / 100;
+    int decimal = (abs(temperature) / 10) % 10;
+    snprintf(buffer, sizeof(buffer), "%3d.%1dC", integer, decimal);
+  } else {
+    snprintf(buffer, sizeof(buffer), "--- C");
+  }
+}
+
+int16_t to_centidegrees(float temperature) {
+  if (!(temperature > -273.0))
+    return DISCONNECTED_CENTIDEGREES;
+  float centidegrees = temperature * 100.0f;
+  return centidegrees < INT16_MAX ? int16_t(lroundf(centidegrees)) : INT16_MAX;
 }
 
-float read_group_resistance(Adafruit_ADS1115& ads1115) {
-  return read_resistance(ads1115, GROUP_VOLTAGE_CHANNEL,
-                         GROUP_KNOWN_RESISTANCE);
+int16_t to_centidegrees(FixedTemperature temperature) {
+  if (!(temperature > from_double<FixedTemperature>(-273.0)))
+    return DISCONNECTED_CENTIDEGREES;
+  int32_t centidegrees = int32_t(
+      (int64_t(temperature.raw()) * 100 + (INT32_C(1) << 15)) >> 16);
+  return int16_t(min(centidegrees, int32_t(INT16_MAX)));
 }
 
 float read_resistance(Adafruit_ADS1115& ads1115, uint8_t channel,
-                      float known_resistance) {
+                      float known_resistance, uint8_t reference_channel) {
   // Infer the resistance from the voltage divider circuit.
-  float reference_voltage = read_voltage(ads1115, REFERENCE_VOLTAGE_CHANNEL);
+  float reference_voltage = read_voltage(ads1115, reference_channel);
   float voltage = read_voltage(ads1115, channel);
   float voltage_ratio = reference_voltage / voltage;
   // In theory the voltage should never be greater than the reference voltage,
@@ -235,6 +267,25 @@ float read_resistance(Adafruit_ADS1115& ads1115, uint8_t channel,
       INFINITY : known_resistance / (voltage_ratio - 1.0);
 }
 
+FixedResistance read_resistance(Adafruit_ADS1115& ads1115, uint8_t channel,
+                                FixedResistance known_resistance,
+                                uint8_t reference_channel) {
+  // Voltages are proportional to the ADC's conversion results, so the voltage
+  // divider's resistance is known_resistance * code / (reference_code - code),
+  // which is infinite under the same condition as above (a voltage ratio below
+  // 1.01). Single-ended conversions are at most 15 bits, so the denominator
+  // fits the 32-bit division of multiply_divide.
+  int32_t reference_code = int16_t(
+      ads1115.readADC_SingleEnded(reference_channel));
+  int32_t code = int16_t(ads1115.readADC_SingleEnded(channel));
+  if (code <= 0)
+    return FixedResistance();
+  if (100 * reference_code < 101 * code)
+    return FixedResistance::max();
+  return FixedResistance::from_raw(multiply_divide(
+      known_resistance.raw(), code, reference_code - code));
+}
+
 float read_voltage(Adafruit_ADS1115& ads1115, uint8_t channel) {
   return 0.0001875 * ads1115.readADC_SingleEnded(channel);
 }
@@ -249,3 +300,26 @@ float resistance_to_temperature(float resistance, float sh_a, float sh_b,
 
   return 1.0 / inverse_temperature_kelvin - 273.15;
 }
+
+FixedTemperature resistance_to_temperature(
+    FixedResistance resistance, const FixedSteinhartHart& coefficients) {
+  // Like with floats, infinite resistances (disconnected thermistors) and zero
+  // resistances convert to absolute zero.
+  constexpr FixedTemperature absolute_zero = from_double<FixedTemperature>(
+      -273.15);
+  if (resistance.is_saturated() || resistance.raw() <= 0)
+    return absolute_zero;
+
+  // The intermediate formats are chosen to keep as much precision as possible
+  // for resistances up to 100 MOhms (the logarithm's cube is below 6,400).
+  Fixed<24> log_resistance = log(resistance);
+  Fixed<20> log_squared = multiply<20>(log_resistance, log_resistance);
+  Fixed<16> log_cubed = multiply<16>(log_squared, log_resistance);
+  Fixed<38> inverse_temperature_kelvin = (
+    coefficients.sh_a.convert<38>() +
+    multiply<38>(coefficients.sh_b, log_resistance) +
+    multiply<38>(coefficients.sh_c, log_cubed)
+  );
+
+  return reciprocal<16>(inverse_temperature_kelvin) + absolute_zero;
+}
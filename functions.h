@@ -9,66 +9,182 @@
 #include <Button.h>
 #include <U8g2lib.h>
 
+#include "config.h"
 #include "constants.h"
 #include "data_structures.h"
+#include "diagnostics.h"
+#include "history.h"
 
-// Initializes the device state.
-void initialize_state(Adafruit_ADS1115& ads1115, DeviceState& state);
+// Functions that work with the device state are templates on the device
+// configuration (see config.h), defined in functions_impl.h.
 
-// Updates the machine's state as determined by the switches and its previous
-// state.
+// Initializes the device state.
+template <typename Config>
+void initialize_state(Adafruit_ADS1115& ads1115, DeviceState<Config>& state);
+
+// Runs the control loop once: reads the switches, then advances the machine's
+// state and the timer and controls the fan, in that order and with a single
+// timestamp. Its CPU usage is accumulated in the state's control_usage.
+template <typename Config>
+void control_tick(Button& temperature_increase_button,
+                  Button& temperature_decrease_button,
+                  Button& tilt_switch,
+                  DeviceState<Config>& state);
+
+// Records the shot in progress in the shot history as the machine's state
+// changes, and writes the next part of a finished shot's record to storage.
+template <typename Config>
+void update_history(const DeviceState<Config>& state, ShotHistory& history);
+
+// Updates the machine's state as determined by the switches, the shot detector
+// and its previous state, given the current time. Shots are timed with the
+// lever, and with the shot detector when the lever misses them.
+template <typename Config>
 void update_machine_state(Button& temperature_increase_button,
                           Button& temperature_decrease_button,
                           Button& tilt_switch,
-                          DeviceState& state);
-
-// Updates the device's timer.
-void update_timer(DeviceState& state);
-
-// Updates the basket and group resistance buffers and recomputes the average
-// basket and group resistances.
-void update_resistances(Adafruit_ADS1115& ads1115, DeviceState& state);
+                          Timestamp current_time,
+                          DeviceState<Config>& state);
+
+// Cross-checks the shot detector with the lever (see ShotCrossCheck), and
+// returns whether the detector has just detected a shot that the lever missed,
+// given the current uptime (see uptime_millis).
+template <typename Config>
+bool cross_check_shot_detection(bool lever_up, uint32_t time,
+                                DeviceState<Config>& state);
+
+// Updates the device's timer, given the current time.
+template <typename Config>
+void update_timer(Timestamp current_time, DeviceState<Config>& state);
+
+// Updates the basket and group resistance buffers, recomputes the average
+// basket and group resistances, and passes their temperatures to the shot
+// detector.
+template <typename Config>
+void update_resistances(Adafruit_ADS1115& ads1115,
+                        DeviceState<Config>& state);
 
 // Writes a measurement to the serial port.
-void write_measurement(const DeviceState& state);
-
-// Activates the fan if the current group temperature is above target.
-void control_fan(DeviceState& state);
-
-// Refreshes the OLED screen using current basket / group resistances and
-// elapsed time.
-void refresh_display(U8G2_SSD1306_128X64_NONAME_1_HW_I2C& u8g2,
-                     const DeviceState& state);
+template <typename Config>
+void write_measurement(const DeviceState<Config>& state);
+
+// Measures RAM usage and writes it to the serial port as a diagnostics frame.
+template <typename Config>
+void write_diagnostics(const DeviceState<Config>& state);
+
+// Writes the tasks' and the main loop's CPU usage to the serial port and resets
+// it.
+template <typename Config>
+void write_task_usage(DeviceState<Config>& state);
+
+// Writes the shot detection's cross-check with the lever to the serial port.
+template <typename Config>
+void write_shot_detection(const DeviceState<Config>& state);
+
+// Writes the fan's measured speed to the serial port, if it has a tachometer.
+template <typename Config>
+void write_fan(const DeviceState<Config>& state);
+
+// Activates the fan if the current group temperature (or the estimated puck
+// temperature, see DefaultConfig::control_puck_temperature) is above target,
+// given the current time. With DefaultConfig::has_fan_tachometer, the fan's
+// speed is measured too.
+template <typename Config>
+void control_fan(Timestamp current_time, DeviceState<Config>& state);
+
+// Updates what the OLED screen should show using current basket (or estimated
+// puck) / group temperatures and elapsed time. The screen itself is drawn by
+// refresh_display.
+template <typename Config>
+void update_display(DeviceState<Config>& state);
+
+// Draws the next step of a display refresh (one page of the screen, or one
+// glyph that changed), returning whether the refresh has more steps.
+bool refresh_display(U8G2_SSD1306_128X64_NONAME_1_HW_I2C& u8g2,
+                     DisplayContents& display);
 
 // Converts the basket thermistor's resistance to a temperature. Wraps
 // resistance_to_temperature for convenience.
-float basket_resistance_to_temperature(float resistance);
+Temperature basket_resistance_to_temperature(Resistance resistance);
 
 // Converts the group thermistor's resistance to a temperature. Wraps
 // resistance_to_temperature for convenience.
-float group_resistance_to_temperature(float resistance);
-
-// Writes the string representation of elapsed time to a character buffer using
-// the AB:CD.E format.
+Temperature group_resistance_to_temperature(Resistance resistance);
+
+// Averages a resistance buffer. The average is infinite if the buffer holds an
+// infinite resistance (i.e. a disconnected thermistor).
+template <int SIZE>
+float average_resistance(const float (&buffer)[SIZE]);
+template <int SIZE>
+FixedResistance average_resistance(const FixedResistance (&buffer)[SIZE]);
+
+// Draws a pre-rendered seven-segment glyph (see seven_segment_font.h) with its
+// top left corner at the given tile column and row. Large glyphs are drawn
+// dark on a lit background. Characters without a glyph are drawn blank.
+void draw_glyph(U8G2_SSD1306_128X64_NONAME_1_HW_I2C& u8g2, char character,
+                uint8_t x, uint8_t y, bool large);
+
+// Returns the width of a seven-segment glyph, in tiles.
+uint8_t glyph_width(char character, bool large);
+
+// Draws the first character of a text field that differs from the displayed
+// one, and returns whether there was one. The text is right-aligned on the
+// given number of characters, with its top left corner at the given tile
+// column and row. Narrow glyphs ('.' and ':' in large fields) must stay at the
+// same positions, since the positions of the following glyphs depend on them.
+bool update_field(U8G2_SSD1306_128X64_NONAME_1_HW_I2C& u8g2,
+                  DisplayField& field, uint8_t width, uint8_t x, uint8_t y,
+                  bool large);
+
+// Writes the string representation of elapsed time (in milliseconds) to a
+// character buffer using the AB:CD.E format.
 void format_elapsed_time(char (&buffer)[FORMAT_BUFFER_SIZE],
-                         float elapsed_time);
+                         unsigned long elapsed_time);
+
+// Writes the string representation of a time to ready (in seconds, see
+// ready_predictor.h) to a character buffer using the M:SS format, or -:-- if it
+// is unknown.
+void format_time_to_ready(char (&buffer)[FORMAT_BUFFER_SIZE], int16_t seconds);
 
 // Writes the string representation of a temperature to a character buffer using
 // the VWXY.ZC format.
 void format_temperature(char (&buffer)[FORMAT_BUFFER_SIZE], float temperature);
+void format_temperature(char (&buffer)[FORMAT_BUFFER_SIZE],
+                        FixedTemperature temperature);
+
+// Writes the string representation of a temperature in hundredths of degrees
+// (see to_centidegrees) to a character buffer using the VWXY.ZC format.
+void format_centidegrees(char (&buffer)[FORMAT_BUFFER_SIZE],
+                         int16_t temperature);
+
+// Converts a temperature to hundredths of degrees for the shot detector (see
+// shot_detection.h), saturating at the int16_t range. Temperatures close to
+// absolute zero come from disconnected thermistors and convert to
+// DISCONNECTED_CENTIDEGREES, like in format_temperature.
+int16_t to_centidegrees(float temperature);
+int16_t to_centidegrees(FixedTemperature temperature);
 
 // Reads the basket resistance from its corresponding thermistor. Wraps
 // read_resistance for convenience.
-float read_basket_resistance(Adafruit_ADS1115& ads1115);
+template <typename Config>
+Resistance read_basket_resistance(Adafruit_ADS1115& ads1115);
 
 // Reads the group resistance from its corresponding thermistor. Wraps
 // read_resistance for convenience.
-float read_group_resistance(Adafruit_ADS1115& ads1115);
+template <typename Config>
+Resistance read_group_resistance(Adafruit_ADS1115& ads1115);
 
 // Reads and returns a thermistor's resistance at the specified ADC channel
-// given the specified known resistance.
+// given the specified known resistance, measuring the reference voltage on the
+// specified reference channel. The fixed-point version works directly on the
+// ADC's conversion results, since the voltages themselves are not needed.
 float read_resistance(Adafruit_ADS1115& ads1115, uint8_t channel,
-                      float known_resistance);
+                      float known_resistance,
+                      uint8_t reference_channel = REFERENCE_VOLTAGE_CHANNEL);
+FixedResistance read_resistance(
+    Adafruit_ADS1115& ads1115, uint8_t channel,
+    FixedResistance known_resistance,
+    uint8_t reference_channel = REFERENCE_VOLTAGE_CHANNEL);
 
 // Reads and returns the voltage at the specified ADC channel.
 float read_voltage(Adafruit_ADS1115& ads1115, uint8_t channel);
@@ -77,5 +193,9 @@ float read_voltage(Adafruit_ADS1115& ads1115, uint8_t channel);
 // model coefficients.
 float resistance_to_temperature(float resistance, float sh_a, float sh_b,
                                 float sh_c);
+FixedTemperature resistance_to_temperature(
+    FixedResistance resistance, const FixedSteinhartHart& coefficients);
+
+#include "functions_impl.h"
 
 #endif  // ESPRESSO_SHOT_FUNCTIONS_H_
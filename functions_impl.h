@@ -0,0 +1,450 @@
+/*
+  Definitions of the function templates declared in functions.h. They depend on
+  the device configuration (see config.h), so they are defined in a header
+  rather than in functions.cpp. Only functions.h should include this file.
+*/
+#ifndef ESPRESSO_SHOT_FUNCTIONS_IMPL_H_
+#define ESPRESSO_SHOT_FUNCTIONS_IMPL_H_
+
+template <typename Config>
+void initialize_state(Adafruit_ADS1115& ads1115, DeviceState<Config>& state) {
+  // Initialize running state.
+  state.machine_state = STOPPED;
+
+  // Initialize resistances and temperatures.
+  Resistance basket_resistance = read_basket_resistance<Config>(ads1115);
+  Resistance group_resistance = read_group_resistance<Config>(ads1115);
+
+  for (int i = 0; i < Config::buffer_size; ++i) {
+    state.basket_resistance_buffer[i] = basket_resistance;
+    state.group_resistance_buffer[i] = group_resistance;
+  }
+  state.latest_buffer_index = Config::buffer_size - 1;
+
+  state.target_group_temperature = from_double<Temperature>(
+      Config::target_temperature_default);
+  state.current_basket_temperature = basket_resistance_to_temperature(
+      basket_resistance);
+  state.current_group_temperature = group_resistance_to_temperature(
+      group_resistance);
+
+  // Initialize time.
+  state.start_time = monotonic_micros();
+  state.control_usage = TaskUsage();
+  state.scheduler_usage = SchedulerUsage();
+  state.last_target_change = state.start_time;
+  state.elapsed_time = 0;
+
+  // Initialize shot detection and puck temperature estimation.
+  state.shot_detector.begin();
+  state.shot_cross_check = ShotCrossCheck();
+  state.puck_estimator.begin();
+  state.puck_estimator.update(
+      0, to_centidegrees(state.current_group_temperature));
+
+  // Initialize fan control.
+  state.fan_on = false;
+  state.tachometer.begin();
+  state.ready_predictor.begin();
+
+  // The screen is drawn entirely on the first refresh.
+  state.display.initialized = false;
+  state.display.page = 0;
+  update_display(state);
+}
+
+template <typename Config>
+void control_tick(Button& temperature_increase_button,
+                  Button& temperature_decrease_button,
+                  Button& tilt_switch,
+                  DeviceState<Config>& state) {
+  Timestamp current_time = monotonic_micros();
+
+  // The fan is controlled last, with the temperatures of the latest sensing
+  // task, so that every tick acts on the switches it has just read.
+  update_machine_state(temperature_increase_button, temperature_decrease_button,
+                       tilt_switch, current_time, state);
+  update_timer(current_time, state);
+  control_fan(current_time, state);
+
+  unsigned long tick_time = elapsed_micros(current_time, monotonic_micros());
+  state.control_usage.time += tick_time;
+  state.control_usage.max_time = max(state.control_usage.max_time, tick_time);
+  ++state.control_usage.num_runs;
+}
+
+template <typename Config>
+void update_history(const DeviceState<Config>& state, ShotHistory& history) {
+  switch (state.machine_state) {
+    case START:
+      history.start_shot(state.current_group_temperature,
+                         state.target_group_temperature);
+      history.record(state.elapsed_time, state.current_basket_temperature,
+                     state.current_group_temperature);
+      break;
+    case RUNNING:
+      history.record(state.elapsed_time, state.current_basket_temperature,
+                     state.current_group_temperature);
+      break;
+    case STOP:
+      history.end_shot(state.elapsed_time);
+      break;
+    case STOPPED:
+      break;
+  }
+  history.write_step();
+}
+
+template <typename Config>
+void update_machine_state(Button& temperature_increase_button,
+                          Button& temperature_decrease_button,
+                          Button& tilt_switch,
+                          Timestamp current_time,
+                          DeviceState<Config>& state) {
+  constexpr Temperature increment = from_double<Temperature>(
+      Config::target_temperature_increment);
+  if (temperature_increase_button.pressed()) {
+    state.target_group_temperature = min(
+        state.target_group_temperature + increment,
+        from_double<Temperature>(Config::target_temperature_max));
+    state.last_target_change = current_time;
+  } else if (temperature_decrease_button.pressed()) {
+    state.target_group_temperature = max(
+        state.target_group_temperature - increment,
+        from_double<Temperature>(Config::target_temperature_min));
+    state.last_target_change = current_time;
+  }
+
+  bool lever_up = tilt_switch.read() == Button::RELEASED;
+  bool detected_shot_started = cross_check_shot_detection(
+      lever_up, uptime_millis(), state);
+  // A shot that the lever missed runs for as long as the detector sees it.
+  ShotCrossCheck& cross_check = state.shot_cross_check;
+  if (lever_up)
+    cross_check.detected_shot = false;
+  else if (detected_shot_started)
+    cross_check.detected_shot = true;
+  bool shot = lever_up || (cross_check.detected_shot &&
+                           state.shot_detector.in_shot());
+
+  switch (state.machine_state) {
+    case START:
+      state.machine_state = shot ? RUNNING : STOP;
+      break;
+    case RUNNING:
+      state.machine_state = shot ? RUNNING : STOP;
+      break;
+    case STOP:
+      state.machine_state = shot ? START : STOPPED;
+      break;
+    case STOPPED:
+      state.machine_state = shot ? START : STOPPED;
+      break;
+  }
+}
+
+template <typename Config>
+bool cross_check_shot_detection(bool lever_up, uint32_t time,
+                                DeviceState<Config>& state) {
+  ShotCrossCheck& cross_check = state.shot_cross_check;
+  const ShotDetector& detector = state.shot_detector;
+
+  if (lever_up && !cross_check.lever_up) {
+    ++cross_check.num_lever_shots;
+    cross_check.lever_shot_detected = false;
+    cross_check.lever_shot_start = time;
+  } else if (!lever_up && cross_check.lever_up) {
+    cross_check.lever_shot_end = time;
+  }
+  cross_check.lever_up = lever_up;
+
+  bool detected = detector.in_shot() && !cross_check.detector_in_shot;
+  cross_check.detector_in_shot = detector.in_shot();
+  if (!detected)
+    return false;
+  ++cross_check.num_detected_shots;
+
+  // Shots are detected a second or two after they start, so a short lever
+  // shot may already be over when it is detected. Its detected start then
+  // comes before the lever went down.
+  bool lever_shot = lever_up || (
+      cross_check.num_lever_shots > 0 &&
+      int32_t(detector.start_time() - cross_check.lever_shot_end) < 0);
+  if (!lever_shot) {
+    ++cross_check.num_fallback_shots;
+    return true;
+  }
+  if (!cross_check.lever_shot_detected) {
+    cross_check.lever_shot_detected = true;
+    ++cross_check.num_confirmed_shots;
+    int32_t start_error = int32_t(detector.start_time() -
+                                  cross_check.lever_shot_start);
+    cross_check.last_start_error = int16_t(
+        max(min(start_error, int32_t(INT16_MAX)), int32_t(INT16_MIN)));
+    cross_check.last_detection_delay = uint16_t(min(
+        detector.detection_time() - cross_check.lever_shot_start,
+        uint32_t(UINT16_MAX)));
+  }
+  return false;
+}
+
+template <typename Config>
+void update_timer(Timestamp current_time, DeviceState<Config>& state) {
+  // When a state transition from "stopped" to "running" occurs, reset the
+  // elapsed time and start the timer. Shots that the lever missed started
+  // before the detector saw them.
+  if (state.machine_state == START) {
+    state.start_time = current_time;
+    if (state.shot_cross_check.detected_shot) {
+      uint32_t time = uptime_millis();
+      state.start_time -= millis_to_micros(
+          uint32_t(time - state.shot_detector.start_time()));
+    }
+    state.elapsed_time = 0;
+  }
+
+  // When the machine is running or has just stopped, update the timer. Shots
+  // that the lever missed ended before the detector saw them end.
+  if (state.machine_state == STOP && state.shot_cross_check.detected_shot) {
+    state.elapsed_time = state.shot_detector.end_time() -
+                         state.shot_detector.start_time();
+  } else if (state.machine_state != STOPPED) {
+    state.elapsed_time = elapsed_millis(state.start_time, current_time);
+  }
+}
+
+template <typename Config>
+void update_resistances(Adafruit_ADS1115& ads1115,
+                        DeviceState<Config>& state) {
+  // Update resistance buffers.
+  int index = (state.latest_buffer_index + 1) % Config::buffer_size;
+  state.basket_resistance_buffer[index] =
+      read_basket_resistance<Config>(ads1115);
+  state.group_resistance_buffer[index] = read_group_resistance<Config>(ads1115);
+  state.latest_buffer_index = index;
+
+  // Compute resistance averages and their corresponding temperatures. Without
+  // a basket thermistor, its temperature stays at absolute zero.
+  if (Config::has_basket_thermistor)
+    state.current_basket_temperature = basket_resistance_to_temperature(
+        average_resistance(state.basket_resistance_buffer));
+  state.current_group_temperature = group_resistance_to_temperature(
+      average_resistance(state.group_resistance_buffer));
+
+  // The detector, the puck temperature estimator and the ready predictor only
+  // need the averages, once per sample.
+  uint32_t time = uptime_millis();
+  int16_t group_temperature = to_centidegrees(state.current_group_temperature);
+  state.shot_detector.update(time,
+                             to_centidegrees(state.current_basket_temperature),
+                             group_temperature);
+  state.puck_estimator.update(time, group_temperature);
+  state.ready_predictor.update(
+      time,
+      Config::control_puck_temperature ? state.puck_estimator.temperature() :
+                                         group_temperature,
+      to_centidegrees(state.target_group_temperature),
+      state.fan_on && !state.tachometer.stalled(), state.tachometer.airflow());
+}
+
+template <typename Config>
+void write_measurement(const DeviceState<Config>& state) {
+  int index = state.latest_buffer_index;
+  Resistance basket_resistance = state.basket_resistance_buffer[index];
+  Resistance group_resistance = state.group_resistance_buffer[index];
+  // The serial protocol sends floats, which are the only float arithmetic left
+  // when using fixed-point numbers.
+  Measurement measurement = {
+      state.elapsed_time * 0.001f,
+      to_float(basket_resistance),
+      to_float(group_resistance),
+      to_float(Config::has_basket_thermistor ?
+                   basket_resistance_to_temperature(basket_resistance) :
+                   state.current_basket_temperature),
+      to_float(group_resistance_to_temperature(group_resistance)),
+      int32_t(state.machine_state) | (state.fan_on ? MEASUREMENT_FAN_ON : 0)
+  };
+  Serial.write((byte *) &measurement, sizeof(measurement));
+}
+
+template <typename Config>
+void write_diagnostics(const DeviceState<Config>& state) {
+  Diagnostics diagnostics;
+  diagnostics.uptime = uptime_millis();
+  measure_memory(diagnostics);
+  diagnostics.buffer_entry_size = sizeof(state.basket_resistance_buffer[0]) +
+                                  sizeof(state.group_resistance_buffer[0]);
+  diagnostics.buffer_size = Config::buffer_size;
+  diagnostics.marker = DIAGNOSTICS_MARKER;
+  Serial.write((byte *) &diagnostics, sizeof(diagnostics));
+}
+
+template <typename Config>
+void write_task_usage(DeviceState<Config>& state) {
+  const TaskUsage& control = state.control_usage;
+  const SchedulerUsage& scheduler = state.scheduler_usage;
+  TaskUsageFrame frame = {
+      uptime_millis(),
+      uint32_t(control.time),
+      uint16_t(min(control.max_time, 0xFFFFUL)),
+      uint16_t(min(control.num_runs, 0xFFFFUL)),
+      uint32_t(scheduler.idle_time),
+      uint16_t(min(scheduler.max_control_delay, 0xFFFFUL)),
+      uint16_t(min(scheduler.max_sensing_delay, 0xFFFFUL)),
+      TASK_USAGE_MARKER
+  };
+  Serial.write((byte *) &frame, sizeof(frame));
+  state.control_usage = TaskUsage();
+  state.scheduler_usage = SchedulerUsage();
+}
+
+template <typename Config>
+void write_shot_detection(const DeviceState<Config>& state) {
+  const ShotCrossCheck& cross_check = state.shot_cross_check;
+  ShotDetectionFrame frame = {
+      uptime_millis(),
+      cross_check.num_lever_shots,
+      cross_check.num_detected_shots,
+      cross_check.num_confirmed_shots,
+      cross_check.num_fallback_shots,
+      cross_check.last_start_error,
+      cross_check.last_detection_delay,
+      {},
+      SHOT_DETECTION_MARKER
+  };
+  Serial.write((byte *) &frame, sizeof(frame));
+}
+
+template <typename Config>
+void write_fan(const DeviceState<Config>& state) {
+  if (!Config::has_fan_tachometer)
+    return;
+  const typename TachometerType<Config::has_fan_tachometer>::type& tachometer =
+      state.tachometer;
+  FanFrame frame = {
+      uptime_millis(),
+      tachometer.rpm(),
+      tachometer.num_stalls(),
+      tachometer.airflow(),
+      state.fan_on,
+      tachometer.stalled(),
+      {},
+      FAN_MARKER
+  };
+  Serial.write((byte *) &frame, sizeof(frame));
+}
+
+template <typename Config>
+void control_fan(Timestamp current_time, DeviceState<Config>& state) {
+  int16_t group_temperature = to_centidegrees(state.current_group_temperature);
+
+  // The fan's speed since the previous tick is measured with the tachometer.
+  if (Config::has_fan_tachometer)
+    state.tachometer.update(uint32_t(current_time), state.fan_on);
+
+  // We cool the grouphead until it (or the puck, as estimated from it) reaches
+  // the target temperature. We could eventually dampen the temperature swings
+  // by implementing PID control, but for now this is good enough. A
+  // disconnected group thermistor leaves the fan off.
+  int16_t temperature = Config::control_puck_temperature ?
+                        state.puck_estimator.temperature() : group_temperature;
+  state.fan_on = temperature != DISCONNECTED_CENTIDEGREES &&
+                 temperature > to_centidegrees(state.target_group_temperature);
+  // Since we are using a BJT to set the voltage at the MOSFET gate, the logic
+  // is inverted and we need to output HIGH to stop the fan.
+  digitalWrite(Config::fan_pin, state.fan_on ? LOW : HIGH);
+}
+
+template <typename Config>
+void update_display(DeviceState<Config>& state) {
+  DisplayContents& display = state.display;
+
+  // If the target group temperature changed recently, display it instead of the
+  // group temperature.
+  display.target = !has_elapsed(
+      state.last_target_change, monotonic_micros(),
+      millis_to_micros(Config::target_display_time));
+
+  format_temperature(display.group_temperature.text,
+                     display.target ? state.target_group_temperature :
+                                      state.current_group_temperature);
+  // Without a connected basket thermistor (e.g. when brewing, once the group
+  // to puck relationship is known), display the estimated puck temperature
+  // instead of the basket temperature.
+  display.puck = to_centidegrees(state.current_basket_temperature) ==
+                 DISCONNECTED_CENTIDEGREES;
+  if (display.puck) {
+    format_centidegrees(display.basket_temperature.text,
+                        state.puck_estimator.temperature());
+  } else {
+    format_temperature(display.basket_temperature.text,
+                       state.current_basket_temperature);
+  }
+  format_elapsed_time(display.elapsed_time.text, state.elapsed_time);
+
+  // A stalled fan is reported in the header. Otherwise, until the controlled
+  // temperature is ready, the header counts down the time predicted until it
+  // is.
+  display.stall = !display.target && state.tachometer.stalled();
+  display.countdown = !display.target && !display.stall &&
+                      !state.ready_predictor.ready();
+  format_time_to_ready(display.time_to_ready.text,
+                       state.ready_predictor.time_to_ready());
+}
+
+template <int SIZE>
+float average_resistance(const float (&buffer)[SIZE]) {
+  // It would be more efficient to remove the the resistance overwritten in the
+  // buffer from the average and add the new resistance to the average, but
+  // since thermistors can be disconnected from the device the running average
+  // can be contaminated by NaNs. We use the inefficient but safe approach
+  // instead.
+  float sum = 0.0;
+  for (int i = 0; i < SIZE; ++i)
+    sum += buffer[i];
+  return sum / SIZE;
+}
+
+template <int SIZE>
+FixedResistance average_resistance(const FixedResistance (&buffer)[SIZE]) {
+  // The sum is accumulated in 64 bits so that it can't overflow, and infinite
+  // resistances make the average infinite like they do with floats. Sums of
+  // thermistor resistances fit in 32 bits, which keeps the division 32-bit
+  // (see fixed_point.h). Larger sums are shifted until they fit, which only
+  // drops bits far below such resistances' precision.
+  uint64_t sum = 0;
+  for (int i = 0; i < SIZE; ++i) {
+    if (buffer[i].is_saturated())
+      return FixedResistance::max();
+    sum += uint32_t(max(buffer[i].raw(), INT32_C(0)));
+  }
+  int shift = 0;
+  while (sum >> 32) {
+    sum >>= 1;
+    ++shift;
+  }
+  return FixedResistance::from_raw(saturate(
+      int64_t(uint32_t(sum) / uint32_t(SIZE)) << shift));
+}
+
+template <typename Config>
+Resistance read_basket_resistance(Adafruit_ADS1115& ads1115) {
+  // A missing basket thermistor reads like a disconnected one, without
+  // spending time on ADC conversions.
+  if (!Config::has_basket_thermistor)
+    return from_double<Resistance>(INFINITY);
+  return read_resistance(
+      ads1115, Config::basket_voltage_channel,
+      from_double<Resistance>(Config::basket_known_resistance),
+      Config::reference_voltage_channel);
+}
+
+template <typename Config>
+Resistance read_group_resistance(Adafruit_ADS1115& ads1115) {
+  return read_resistance(
+      ads1115, Config::group_voltage_channel,
+      from_double<Resistance>(Config::group_known_resistance),
+      Config::reference_voltage_channel);
+}
+
+#endif  // ESPRESSO_SHOT_FUNCTIONS_IMPL_H_
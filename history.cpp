@@ -0,0 +1,264 @@
+/*
+  History of the latest shots, kept on the device.
+*/
+#include "history.h"
+
+#include <stddef.h>
+
+#include "storage.h"
+#include "timebase.h"
+
+namespace {
+
+// Curve point of a disconnected thermistor.
+constexpr uint8_t DISCONNECTED_POINT = 0xFF;
+
+// Converts a temperature to tenths of degrees. Temperatures close to absolute
+// zero come from disconnected thermistors, like in format_temperature.
+int16_t to_tenths(Temperature temperature) {
+  if (!(temperature > from_double<Temperature>(-273.0)))
+    return INT16_MIN;
+#if USE_FIXED_POINT
+  int64_t tenths = (int64_t(temperature.raw()) * 10 + (INT32_C(1) << 15)) >> 16;
+  return int16_t(min(tenths, int64_t(INT16_MAX)));
+#else
+  float tenths = temperature * 10.0f;
+  return tenths < INT16_MAX ? int16_t(lroundf(tenths)) : INT16_MAX;
+#endif
+}
+
+// Converts a temperature to a curve point, in half degrees.
+uint8_t to_curve_point(Temperature temperature) {
+  int16_t tenths = to_tenths(temperature);
+  if (tenths == INT16_MIN)
+    return DISCONNECTED_POINT;
+  return uint8_t(max(min((tenths + 2) / 5, DISCONNECTED_POINT - 1), 0));
+}
+
+uint16_t checksum(const ShotRecord& record) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&record);
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < sizeof(record); ++i) {
+    bool is_checksum = i >= offsetof(ShotRecord, checksum) &&
+                       i < offsetof(ShotRecord, checksum) + sizeof(crc);
+    crc ^= uint16_t(is_checksum ? 0 : bytes[i]) << 8;
+    for (int bit = 0; bit < 8; ++bit)
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+}  // namespace
+
+void ShotHistory::begin() {
+  begin_storage();
+  sector_size_ = storage_sector_size();
+  slots_per_sector_ = sector_size_ / sizeof(ShotRecord);
+  num_slots_ = storage_size() / sector_size_ * slots_per_sector_;
+  recording_ = false;
+  finished_ = false;
+  writing_ = false;
+  sending_ = false;
+
+  // Sequence numbers wrap around, so the latest shot is the one whose sequence
+  // number is ahead of all others.
+  next_slot_ = 0;
+  next_sequence_ = 0;
+  bool found = false;
+  ShotRecord record;
+  for (uint16_t slot = 0; slot < num_slots_; ++slot) {
+    if (read_slot(slot, record) &&
+        (!found || int16_t(record.sequence - next_sequence_) >= 0)) {
+      found = true;
+      next_slot_ = (slot + 1) % num_slots_;
+      next_sequence_ = record.sequence + 1;
+    }
+  }
+}
+
+void ShotHistory::start_shot(Temperature group_temperature,
+                             Temperature target_temperature) {
+  if (finished_)
+    return;
+  memset(&shot_, 0, sizeof(shot_));
+  shot_.curve_period = HISTORY_SAMPLE_PERIOD;
+  shot_.target_temperature = to_tenths(target_temperature);
+  shot_.start_group_temperature = to_tenths(group_temperature);
+  min_group_temperature_ = group_temperature;
+  max_group_temperature_ = group_temperature;
+  max_basket_temperature_ = from_double<Temperature>(-274.0);
+  recording_ = true;
+}
+
+void ShotHistory::record(unsigned long elapsed_time,
+                         Temperature basket_temperature,
+                         Temperature group_temperature) {
+  if (!recording_)
+    return;
+  min_group_temperature_ = min(min_group_temperature_, group_temperature);
+  max_group_temperature_ = max(max_group_temperature_, group_temperature);
+  max_basket_temperature_ = max(max_basket_temperature_, basket_temperature);
+
+  if (elapsed_time < (unsigned long) shot_.num_points * shot_.curve_period)
+    return;
+  if (shot_.num_points == HISTORY_CURVE_SIZE) {
+    // Curves stop at their longest period (over 9 minutes per point).
+    if (shot_.curve_period > UINT16_MAX / 2)
+      return;
+    for (uint8_t i = 0; i < HISTORY_CURVE_SIZE / 2; ++i) {
+      shot_.group_curve[i] = shot_.group_curve[2 * i];
+      shot_.basket_curve[i] = shot_.basket_curve[2 * i];
+    }
+    memset(shot_.group_curve + HISTORY_CURVE_SIZE / 2, 0,
+           HISTORY_CURVE_SIZE / 2);
+    memset(shot_.basket_curve + HISTORY_CURVE_SIZE / 2, 0,
+           HISTORY_CURVE_SIZE / 2);
+    shot_.num_points = HISTORY_CURVE_SIZE / 2;
+    shot_.curve_period *= 2;
+  }
+  shot_.group_curve[shot_.num_points] = to_curve_point(group_temperature);
+  shot_.basket_curve[shot_.num_points] = to_curve_point(basket_temperature);
+  ++shot_.num_points;
+}
+
+void ShotHistory::end_shot(unsigned long duration) {
+  if (!recording_)
+    return;
+  recording_ = false;
+  if (duration < HISTORY_MIN_SHOT_DURATION || num_slots_ == 0)
+    return;
+
+  shot_.version = SHOT_RECORD_VERSION;
+  shot_.duration = uint16_t(min(duration / 100, 0xFFFFUL));
+  shot_.min_group_temperature = to_tenths(min_group_temperature_);
+  shot_.max_group_temperature = to_tenths(max_group_temperature_);
+  shot_.max_basket_temperature = to_tenths(max_basket_temperature_);
+  finished_ = true;
+  queue_write();
+}
+
+void ShotHistory::queue_write() {
+  if (!finished_ || writing_)
+    return;
+  // The record's sequence number is only final once the previous record is
+  // written.
+  write_record_ = shot_;
+  write_record_.sequence = next_sequence_;
+  write_record_.checksum = checksum(write_record_);
+  finished_ = false;
+  writing_ = true;
+  write_offset_ = 0;
+}
+
+void ShotHistory::write_step() {
+  // Slots don't change while the history is being sent, so that the records
+  // sent match the header.
+  if (!writing_ || sending_)
+    return;
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&write_record_);
+  write_offset_ += write_storage(slot_address(next_slot_) + write_offset_,
+                                 bytes + write_offset_,
+                                 sizeof(write_record_) - write_offset_);
+  if (write_offset_ == sizeof(write_record_)) {
+    writing_ = false;
+    next_slot_ = (next_slot_ + 1) % num_slots_;
+    ++next_sequence_;
+    queue_write();
+  }
+}
+
+void ShotHistory::start_send() {
+  if (sending_)
+    return;
+  // The slot being written, if any, holds neither the oldest shot nor a valid
+  // record.
+  uint16_t first_slot = writing_ ? 1 : 0;
+  ShotRecord record;
+  send_num_records_ = 0;
+  for (uint16_t i = first_slot; i < num_slots_; ++i)
+    send_num_records_ += read_slot((next_slot_ + i) % num_slots_, record);
+  send_uptime_ = uptime_millis();
+  send_progress_time_ = send_uptime_;
+  sending_ = true;
+  send_header_ = true;
+  send_slot_ = first_slot;
+  send_offset_ = 0;
+}
+
+void ShotHistory::send_step() {
+  if (!sending_)
+    return;
+  int available = Serial.availableForWrite();
+  if (available <= 0) {
+    // A host that stops reading would otherwise hold off every other frame and
+    // shot record for good.
+    if (uptime_millis() - send_progress_time_ >= HISTORY_SEND_TIMEOUT)
+      sending_ = false;
+    return;
+  }
+  send_progress_time_ = uptime_millis();
+  while (sending_ && available > 0) {
+    // The header and records are read again for every part sent, which is
+    // cheaper than keeping them in RAM.
+    HistoryHeader header;
+    ShotRecord record;
+    const uint8_t* frame;
+    uint16_t size;
+    if (send_header_) {
+      header = {
+          send_uptime_,
+          send_num_records_,
+          sizeof(ShotRecord),
+          num_slots_,
+          SHOT_RECORD_VERSION,
+          HISTORY_CURVE_SIZE,
+          CALIBRATION_VERSION,
+          {},
+          HISTORY_MARKER
+      };
+      frame = reinterpret_cast<const uint8_t*>(&header);
+      size = sizeof(header);
+    } else {
+      while (send_slot_ < num_slots_ &&
+             !read_slot((next_slot_ + send_slot_) % num_slots_, record))
+        ++send_slot_;
+      if (send_slot_ == num_slots_) {
+        sending_ = false;
+        return;
+      }
+      frame = reinterpret_cast<const uint8_t*>(&record);
+      size = sizeof(record);
+    }
+
+    uint16_t length = min(uint16_t(size - send_offset_), uint16_t(available));
+    Serial.write(frame + send_offset_, length);
+    available -= length;
+    send_offset_ += length;
+    if (send_offset_ == size) {
+      send_offset_ = 0;
+      if (send_header_)
+        send_header_ = false;
+      else
+        ++send_slot_;
+    }
+  }
+}
+
+void handle_serial_commands(ShotHistory& history) {
+  while (Serial.available()) {
+    if (Serial.read() == HISTORY_COMMAND)
+      history.start_send();
+  }
+  history.send_step();
+}
+
+uint16_t ShotHistory::slot_address(uint16_t slot) const {
+  return slot / slots_per_sector_ * sector_size_ +
+         slot % slots_per_sector_ * sizeof(ShotRecord);
+}
+
+bool ShotHistory::read_slot(uint16_t slot, ShotRecord& record) const {
+  read_storage(slot_address(slot), &record, sizeof(record));
+  return record.version == SHOT_RECORD_VERSION &&
+         record.checksum == checksum(record);
+}
@@ -0,0 +1,119 @@
+/*
+  History of the latest shots, kept on the device so that shots pulled while no
+  host is connected aren't lost.
+
+  Every shot is summarized (duration, target temperature, start, minimum and
+  maximum group temperatures, and maximum basket temperature) along with
+  decimated group and basket temperature curves: curve points are taken every
+  HISTORY_SAMPLE_PERIOD milliseconds, and when a shot outlasts its curve, every
+  other point is dropped and the period doubles, so that curves always span the
+  whole shot.
+
+  Records are kept in a ring of slots in non-volatile storage (see storage.h),
+  each tagged with an increasing sequence number. Every shot goes to the slot
+  after the latest shot's, so that writes are spread evenly over the storage
+  instead of wearing out a fixed location, and the latest shot is found again at
+  boot from the sequence numbers. A record is written in the background a
+  little at a time, from its own buffer so that the next shot can be recorded
+  meanwhile, and a record whose writing was interrupted (e.g. by a reset) fails
+  its checksum and is ignored.
+
+  The host downloads the history by sending HISTORY_COMMAND, to which the device
+  answers with a HistoryHeader followed by the valid records, oldest first. The
+  download goes out over several control ticks, as fast as the serial port's
+  transmit buffer drains, so that it never stalls the tick. The host reads it
+  as one contiguous transfer, so no other frame may be sent until it is done,
+  and records wait to be written to storage until then. A download that can't
+  send anything for HISTORY_SEND_TIMEOUT milliseconds is abandoned.
+*/
+#ifndef ESPRESSO_SHOT_HISTORY_H_
+#define ESPRESSO_SHOT_HISTORY_H_
+
+#include <Arduino.h>
+
+#include "data_structures.h"
+
+class ShotHistory {
+ public:
+  // Finds the latest shot in storage.
+  void begin();
+
+  // Starts recording a shot, unless the previous shot's record still waits for
+  // the one before it to be written (which takes two shots ending during a
+  // download), in which case the shot isn't kept.
+  void start_shot(Temperature group_temperature,
+                  Temperature target_temperature);
+
+  // Adds the temperatures at the given time (in milliseconds since the start of
+  // the shot) to the shot being recorded.
+  void record(unsigned long elapsed_time, Temperature basket_temperature,
+              Temperature group_temperature);
+
+  // Ends the shot being recorded, given its duration (in milliseconds), and
+  // queues its record to be written to storage unless the shot was too short.
+  void end_shot(unsigned long duration);
+
+  // Writes the next part of the queued record to storage, if any. Meant to be
+  // called periodically.
+  void write_step();
+
+  // Starts sending the stored shots over the serial port, oldest first, unless
+  // they are already being sent.
+  void start_send();
+
+  // Sends the next part of the history, as much of it as the serial port's
+  // transmit buffer takes without blocking. Meant to be called periodically.
+  void send_step();
+
+  // Whether the history is being sent, during which no other frame may be
+  // sent.
+  bool sending() const { return sending_; }
+
+ private:
+  uint16_t slot_address(uint16_t slot) const;
+  // Reads the record in a slot, returning whether it is valid.
+  bool read_slot(uint16_t slot, ShotRecord& record) const;
+
+  // Queues the finished shot's record to be written, if no other record is
+  // being written.
+  void queue_write();
+
+  // Record of the shot being recorded, and whether it is finished and waits to
+  // be queued.
+  ShotRecord shot_;
+  Temperature min_group_temperature_;
+  Temperature max_group_temperature_;
+  Temperature max_basket_temperature_;
+  bool recording_;
+  bool finished_;
+  // Record being written to storage, whether it is, and how many of its bytes
+  // are written.
+  ShotRecord write_record_;
+  bool writing_;
+  uint16_t write_offset_;
+
+  // Whether the history is being sent, the last time any of it was, the
+  // header's contents, the slot (after the latest shot's) being sent or the
+  // header if it isn't sent yet, and how many of the header's or the slot's
+  // bytes are sent.
+  bool sending_;
+  uint32_t send_progress_time_;
+  uint32_t send_uptime_;
+  uint16_t send_num_records_;
+  bool send_header_;
+  uint16_t send_slot_;
+  uint16_t send_offset_;
+
+  uint16_t sector_size_;
+  uint16_t num_slots_;
+  uint16_t slots_per_sector_;
+  uint16_t next_slot_;
+  uint16_t next_sequence_;
+};
+
+// Handles the commands received over the serial port, i.e. starts sending the
+// shot history when the host asks for it, and sends the next part of the
+// history.
+void handle_serial_commands(ShotHistory& history);
+
+#endif  // ESPRESSO_SHOT_HISTORY_H_
@@ -0,0 +1,226 @@
+"""Download and storage of the shot history kept on the device.
+
+The device keeps a summary and decimated temperature curves of each of its
+latest shots in non-volatile storage (see the sketch's history.h), so that shots
+pulled while no host is connected aren't lost. Sending `HISTORY_COMMAND` makes
+it send them all, oldest first, in a single transfer, which `espresso-shot.py`
+asks for whenever it connects.
+
+Downloaded shots are appended to a JSON lines file (`DEFAULT_PATH`). Shots are
+identified by their device, sequence number and checksum, so downloading the
+same shots again doesn't duplicate them.
+
+Example usage:
+
+    $ python history.py download -p /dev/ttyACM0
+    $ python history.py list
+"""
+import argparse
+import datetime
+import json
+import os
+import struct
+import time
+
+import serial
+
+import utils
+
+# Default history location.
+DEFAULT_PATH = 'data/history.jsonl'
+
+# Byte that makes the device send its shot history.
+HISTORY_COMMAND = b'H'
+
+# Shot records (see `ShotRecord` in the sketch's data_structures.h) start with
+# these fields, followed by the group and basket curves (`curve_size` bytes
+# each). Temperatures are in tenths of degrees and curve points in half degrees.
+SHOT_RECORD_VERSION = 1
+RECORD_FORMAT_STRING = '<BBHHHHhhhhh'
+RECORD_FIELDS = (
+    'version', 'num_points', 'checksum', 'sequence', 'duration',
+    'curve_period', 'target_temperature', 'start_group_temperature',
+    'min_group_temperature', 'max_group_temperature', 'max_basket_temperature')
+# Offset of the checksum, which covers the record with the checksum set to 0.
+CHECKSUM_OFFSET = 2
+
+# Temperatures and curve points of disconnected thermistors.
+DISCONNECTED_TEMPERATURE = -32768
+DISCONNECTED_POINT = 0xFF
+
+
+def checksum(record):
+  """Computes a record's CRC-16-CCITT, like the sketch's history.cpp."""
+  crc = 0xFFFF
+  for i, value in enumerate(record):
+    if CHECKSUM_OFFSET <= i < CHECKSUM_OFFSET + 2:
+      value = 0
+    crc ^= value << 8
+    for _ in range(8):
+      crc = ((crc << 1) ^ 0x1021 if crc & 0x8000 else crc << 1) & 0xFFFF
+  return crc
+
+
+def decode(header, records):
+  """Decodes the records of a shot history transfer.
+
+  Args:
+    header: `utils.HistoryHeader`, header of the transfer.
+    records: bytes, records that followed the header.
+
+  Returns:
+    list of dicts, one per valid record, oldest first. Durations and curve
+    periods are in seconds, and temperatures in degrees Celsius or None for a
+    disconnected thermistor. Records that fail their checksum (e.g. because of
+    a transmission error) are dropped.
+  """
+  if header.version != SHOT_RECORD_VERSION:
+    raise ValueError('Unsupported shot record version {}'.format(
+        header.version))
+  fixed_size = struct.calcsize(RECORD_FORMAT_STRING)
+  shots = []
+  for offset in range(0, len(records) - header.record_size + 1,
+                      header.record_size):
+    record = records[offset:offset + header.record_size]
+    fields = dict(zip(RECORD_FIELDS,
+                      struct.unpack_from(RECORD_FORMAT_STRING, record)))
+    if (fields['version'] != SHOT_RECORD_VERSION or
+        fields['checksum'] != checksum(record)):
+      continue
+
+    def temperature(tenths):
+      return None if tenths == DISCONNECTED_TEMPERATURE else tenths / 10.0
+
+    def curve(start):
+      points = record[start:start + fields['num_points']]
+      return [None if point == DISCONNECTED_POINT else point / 2.0
+              for point in points]
+
+    shots.append({
+        'sequence': fields['sequence'],
+        'checksum': fields['checksum'],
+        'duration': fields['duration'] / 10.0,
+        'curve_period': fields['curve_period'] / 1000.0,
+        'target_temperature': temperature(fields['target_temperature']),
+        'start_group_temperature': temperature(
+            fields['start_group_temperature']),
+        'min_group_temperature': temperature(fields['min_group_temperature']),
+        'max_group_temperature': temperature(fields['max_group_temperature']),
+        'max_basket_temperature': temperature(
+            fields['max_basket_temperature']),
+        'group_curve': curve(fixed_size),
+        'basket_curve': curve(fixed_size + header.curve_size),
+    })
+  return shots
+
+
+class HistoryStore:
+  """JSON lines file of the shots downloaded from devices."""
+
+  def __init__(self, path=DEFAULT_PATH):
+    self._path = path
+
+  def shots(self):
+    """Returns the stored shots as a list of dicts, in the order downloaded."""
+    if not os.path.exists(self._path):
+      return []
+    with open(self._path, 'r') as f:
+      return [json.loads(line) for line in f if line.strip()]
+
+  def merge(self, shots, device='', posix_time=None):
+    """Stores the shots that aren't stored yet.
+
+    Args:
+      shots: list of dicts, as returned by `decode`.
+      device: str, device (e.g. serial port) the shots were downloaded from.
+      posix_time: float or None, time of the download (now if None).
+
+    Returns:
+      int, number of shots stored.
+    """
+    if posix_time is None:
+      posix_time = time.time()
+    known = {(shot['device'], shot['sequence'], shot['checksum'])
+             for shot in self.shots()}
+    new_shots = [shot for shot in shots
+                 if (device, shot['sequence'], shot['checksum']) not in known]
+    directory = os.path.dirname(self._path)
+    if directory:
+      os.makedirs(directory, exist_ok=True)
+    with open(self._path, 'a') as f:
+      for shot in new_shots:
+        f.write(json.dumps(dict(shot, device=device,
+                                downloaded=posix_time)) + '\n')
+    return len(new_shots)
+
+
+def download(serial_port, timeout=10.0):
+  """Downloads a device's shot history.
+
+  Args:
+    serial_port: Serial, serial port of the device.
+    timeout: float, seconds to wait for the history.
+
+  Returns:
+    tuple (header, shots) of the transfer's `utils.HistoryHeader` and decoded
+    shots, or None if the device didn't answer in time.
+  """
+  received = []
+  serial_port.write(HISTORY_COMMAND)
+  deadline = time.monotonic() + timeout
+  while not received and time.monotonic() < deadline:
+    utils.read_measurement(
+        serial_port,
+        on_history=lambda header, records: received.append(
+            (header, decode(header, records))))
+  return received[0] if received else None
+
+
+def print_shots(shots):
+  """Prints one line per shot."""
+  for shot in shots:
+    downloaded = datetime.datetime.fromtimestamp(shot['downloaded']).isoformat(
+        ' ', timespec='seconds')
+    print('{} #{:<5} downloaded {}: {:5.1f}s, target {}, group {} to {} '
+          '(started at {}), basket up to {}'.format(
+              shot['device'] or '<unknown device>', shot['sequence'],
+              downloaded, shot['duration'], *[
+                  '---' if shot[key] is None else '{:.1f}C'.format(shot[key])
+                  for key in ('target_temperature', 'min_group_temperature',
+                              'max_group_temperature',
+                              'start_group_temperature',
+                              'max_basket_temperature')]))
+
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser(
+      description='Download and list the shot history kept on the device.')
+  parser.add_argument(
+      '--path', type=str, default=DEFAULT_PATH,
+      help='Path to the downloaded shot history.')
+  subparsers = parser.add_subparsers(dest='command', required=True)
+  download_parser = subparsers.add_parser(
+      'download', help='Download the shot history of a device.')
+  download_parser.add_argument(
+      '-p', dest='port', type=str, required=True,
+      help='Serial port, e.g.: COM10 or /dev/ttyACM0')
+  subparsers.add_parser('list', help='List the downloaded shots.')
+  args = parser.parse_args()
+
+  store = HistoryStore(args.path)
+  if args.command == 'download':
+    serial_port = serial.Serial(port=args.port, baudrate=9600)
+    try:
+      result = download(serial_port)
+    finally:
+      serial_port.close()
+    if result is None:
+      print('The device did not send its shot history.')
+    else:
+      header, shots = result
+      num_new_shots = store.merge(shots, device=args.port)
+      print('Downloaded {} of {} shots ({} new), the device keeps up to '
+            '{}.'.format(len(shots), header.num_records, num_new_shots,
+                         header.capacity))
+  elif args.command == 'list':
+    print_shots(store.shots())
@@ -0,0 +1,250 @@
+"""Python bindings to the host-side C++ library.
+
+The library is built from the sources in `host/` (along with the parts of the
+sketch that don't depend on the Arduino core) with the system's C++ compiler
+the first time it is needed (and again whenever a source file changes), then
+loaded with ctypes.
+"""
+import ctypes
+import os
+import subprocess
+
+import numpy as np
+
+ROOT = os.path.dirname(os.path.abspath(__file__))
+SOURCES = [
+    os.path.join(ROOT, 'calibration.cpp'),
+    os.path.join(ROOT, 'host', 'calibration_bindings.cpp'),
+    os.path.join(ROOT, 'host', 'puck_estimator_bindings.cpp'),
+    os.path.join(ROOT, 'host', 'shot_detection_bindings.cpp'),
+    os.path.join(ROOT, 'host', 'steinhart_hart.cpp'),
+    os.path.join(ROOT, 'puck_estimator.cpp'),
+    os.path.join(ROOT, 'shot_detection.cpp'),
+]
+LIBRARY_PATH = os.path.join(ROOT, 'host', 'build', 'libespresso_shot.so')
+SIMULATOR_SOURCES = [
+    os.path.join(ROOT, 'bus.cpp'),
+    os.path.join(ROOT, 'diagnostics.cpp'),
+    os.path.join(ROOT, 'functions.cpp'),
+    os.path.join(ROOT, 'history.cpp'),
+    os.path.join(ROOT, 'host', 'simulator.cpp'),
+    os.path.join(ROOT, 'host', 'shims', 'arduino_shim.cpp'),
+    os.path.join(ROOT, 'puck_estimator.cpp'),
+    os.path.join(ROOT, 'ready_predictor.cpp'),
+    os.path.join(ROOT, 'shot_detection.cpp'),
+    os.path.join(ROOT, 'storage.cpp'),
+    os.path.join(ROOT, 'tachometer.cpp'),
+    os.path.join(ROOT, 'timebase.cpp'),
+]
+SIMULATOR_PATH = os.path.join(ROOT, 'host', 'build', 'simulator')
+
+_library = None
+
+
+def _build(path, sources, flags, dependencies=()):
+  """Compiles and links `sources` into `path` if it is missing or outdated."""
+  headers = [os.path.splitext(source)[0] + '.h' for source in sources]
+  dependencies = [path for path in list(sources) + headers + list(dependencies)
+                  if os.path.exists(path)]
+  if (not os.path.exists(path) or
+      os.path.getmtime(path) < max(map(os.path.getmtime, dependencies))):
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    subprocess.run(
+        [os.environ.get('CXX', 'g++'), '-O2', '-std=c++14'] + flags +
+        ['-o', path] + sources,
+        check=True)
+  return path
+
+
+def build_library():
+  """Builds the host library if it is missing or older than its sources.
+
+  Returns:
+    str, path to the built library.
+  """
+  return _build(LIBRARY_PATH, SOURCES, ['-shared', '-fPIC'],
+                [os.path.join(ROOT, 'constants.h')])
+
+
+def build_simulator():
+  """Builds the device simulator if it is missing or older than its sources.
+
+  See `host/simulator.cpp`.
+
+  Returns:
+    str, path to the built simulator.
+  """
+  shims = os.path.join(ROOT, 'host', 'shims')
+  dependencies = [os.path.join(ROOT, name)
+                  for name in ('config.h', 'constants.h', 'data_structures.h',
+                               'fixed_point.h', 'functions_impl.h',
+                               'seven_segment_font.h')]
+  dependencies += [os.path.join(shims, name) for name in os.listdir(shims)]
+  return _build(SIMULATOR_PATH, SIMULATOR_SOURCES, ['-I' + shims],
+                dependencies)
+
+
+def load_library():
+  """Builds (if needed) and loads the host library.
+
+  Returns:
+    ctypes.CDLL, the loaded library.
+  """
+  global _library
+  if _library is None:
+    library = ctypes.CDLL(build_library())
+    float_pointer = np.ctypeslib.ndpointer(np.float32, flags='C_CONTIGUOUS')
+    library.espresso_shot_resistance_to_temperature_batch.argtypes = [
+        float_pointer, float_pointer, ctypes.c_size_t, ctypes.c_float,
+        ctypes.c_float, ctypes.c_float]
+    library.espresso_shot_resistance_to_temperature_batch.restype = None
+    library.espresso_shot_fit_steinhart_hart.argtypes = [
+        float_pointer, float_pointer, ctypes.c_void_p, ctypes.c_size_t,
+        np.ctypeslib.ndpointer(np.float64, shape=(3,)),
+        np.ctypeslib.ndpointer(np.float64, shape=(3,)), float_pointer]
+    library.espresso_shot_fit_steinhart_hart.restype = ctypes.c_size_t
+    library.espresso_shot_detect_shots.argtypes = [
+        np.ctypeslib.ndpointer(np.uint32, flags='C_CONTIGUOUS'),
+        np.ctypeslib.ndpointer(np.int16, flags='C_CONTIGUOUS'),
+        np.ctypeslib.ndpointer(np.int16, flags='C_CONTIGUOUS'),
+        ctypes.c_size_t, ctypes.c_void_p,
+        np.ctypeslib.ndpointer(np.uint32, flags='C_CONTIGUOUS'),
+        ctypes.c_size_t]
+    library.espresso_shot_detect_shots.restype = ctypes.c_size_t
+    library.espresso_shot_estimate_puck_temperatures.argtypes = [
+        np.ctypeslib.ndpointer(np.uint32, flags='C_CONTIGUOUS'),
+        np.ctypeslib.ndpointer(np.int16, flags='C_CONTIGUOUS'),
+        ctypes.c_size_t, ctypes.c_void_p,
+        np.ctypeslib.ndpointer(np.int16, flags='C_CONTIGUOUS')]
+    library.espresso_shot_estimate_puck_temperatures.restype = None
+    _library = library
+  return _library
+
+
+def resistance_to_temperature_batch(resistances, sh_a, sh_b, sh_c):
+  """Converts thermistor resistances to temperatures with the SIMD kernel.
+
+  Args:
+    resistances: array-like, thermistor resistances.
+    sh_a: float, Steinhart-Hart model A coefficient.
+    sh_b: float, Steinhart-Hart model B coefficient.
+    sh_c: float, Steinhart-Hart model C coefficient.
+
+  Returns:
+    float32 numpy array of temperatures in degrees Celsius.
+  """
+  resistances = np.ascontiguousarray(resistances, dtype=np.float32)
+  temperatures = np.empty_like(resistances)
+  load_library().espresso_shot_resistance_to_temperature_batch(
+      resistances, temperatures, resistances.size, sh_a, sh_b, sh_c)
+  return temperatures
+
+
+def fit_steinhart_hart(temperatures, resistances, weights=None):
+  """Fits Steinhart-Hart coefficients by weighted least squares.
+
+  See `calibration.h` for details on the fit.
+
+  Args:
+    temperatures: array-like, reference temperatures in degrees Celsius.
+    resistances: array-like, thermistor resistances at those temperatures.
+    weights: array-like or None, confidence in each point (e.g. the inverse
+      variance of its reference temperature). Defaults to unit weights.
+
+  Returns:
+    tuple (coefficients, diagnostics), where `coefficients` is a tuple (sh_a,
+    sh_b, sh_c) and `diagnostics` is a dict with the number of points used
+    ('num_points'), the RMS and signed maximum temperature residuals
+    ('rms_residual' and 'max_residual', in degrees Celsius), the index of the
+    point with the maximum residual ('worst_point') and every point's residual
+    ('residuals', NaN for ignored points).
+
+  Raises:
+    ValueError, if the points don't determine the coefficients.
+  """
+  temperatures = np.ascontiguousarray(temperatures, dtype=np.float32)
+  resistances = np.ascontiguousarray(resistances, dtype=np.float32)
+  if weights is not None:
+    weights = np.ascontiguousarray(weights, dtype=np.float32)
+  coefficients = np.zeros(3)
+  diagnostics = np.zeros(3)
+  residuals = np.empty_like(temperatures)
+  num_points = load_library().espresso_shot_fit_steinhart_hart(
+      temperatures, resistances,
+      None if weights is None else weights.ctypes.data, temperatures.size,
+      coefficients, diagnostics, residuals)
+  if num_points == 0:
+    raise ValueError('the calibration points do not determine the '
+                     'Steinhart-Hart coefficients.')
+  return tuple(coefficients.tolist()), {
+      'num_points': num_points,
+      'rms_residual': float(diagnostics[0]),
+      'max_residual': float(diagnostics[1]),
+      'worst_point': int(diagnostics[2]),
+      'residuals': residuals,
+  }
+
+
+def detect_shots(times, basket_temperatures, group_temperatures,
+                 thresholds=None):
+  """Runs the sketch's shot detector over a stream of samples.
+
+  See `shot_detection.h` for details on the detector.
+
+  Args:
+    times: array-like, sample times in milliseconds.
+    basket_temperatures: array-like, averaged basket temperatures in hundredths
+      of degrees Celsius (-32768 for a disconnected thermistor).
+    group_temperatures: array-like, averaged group temperatures, likewise.
+    thresholds: sequence or None, fields of `ShotDetectionThresholds` in order
+      (the sketch's defaults if None).
+
+  Returns:
+    uint32 numpy array of shape (num_shots, 3) holding the start, detection and
+    end times of every detected shot, in milliseconds.
+  """
+  times = np.ascontiguousarray(times, dtype=np.uint32)
+  basket_temperatures = np.ascontiguousarray(basket_temperatures,
+                                             dtype=np.int16)
+  group_temperatures = np.ascontiguousarray(group_temperatures, dtype=np.int16)
+  if thresholds is not None:
+    thresholds = np.ascontiguousarray(thresholds, dtype=np.int32)
+  library = load_library()
+  max_shots = 16
+  while True:
+    shots = np.zeros((max_shots, 3), dtype=np.uint32)
+    num_shots = library.espresso_shot_detect_shots(
+        times, basket_temperatures, group_temperatures, times.size,
+        None if thresholds is None else thresholds.ctypes.data, shots.ravel(),
+        max_shots)
+    if num_shots <= max_shots:
+      return shots[:num_shots]
+    max_shots = num_shots
+
+
+def estimate_puck_temperatures(times, group_temperatures, coefficients=None):
+  """Runs the sketch's puck temperature estimator over a stream of samples.
+
+  See `puck_estimator.h` for details on the estimator.
+
+  Args:
+    times: array-like, sample times in milliseconds.
+    group_temperatures: array-like, averaged group temperatures in hundredths
+      of degrees Celsius (-32768 for a disconnected thermistor).
+    coefficients: sequence or None, the model's (a1, a2, b0, b1, c)
+      coefficients (the sketch's `PUCK_MODEL_*` if None).
+
+  Returns:
+    int16 numpy array of the estimated puck temperature after every sample, in
+    hundredths of degrees Celsius (-32768 while the group thermistor is
+    disconnected).
+  """
+  times = np.ascontiguousarray(times, dtype=np.uint32)
+  group_temperatures = np.ascontiguousarray(group_temperatures, dtype=np.int16)
+  if coefficients is not None:
+    coefficients = np.ascontiguousarray(coefficients, dtype=np.float64)
+  estimates = np.empty(times.size, dtype=np.int16)
+  load_library().espresso_shot_estimate_puck_temperatures(
+      times, group_temperatures, times.size,
+      None if coefficients is None else coefficients.ctypes.data, estimates)
+  return estimates
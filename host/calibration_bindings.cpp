@@ -0,0 +1,43 @@
+/*
+  C interface to the least-squares Steinhart-Hart calibration (calibration.h)
+  used by the Python bindings (host.py).
+*/
+#include <stddef.h>
+
+#include <vector>
+
+#include "../calibration.h"
+
+extern "C" {
+
+// Fits Steinhart-Hart coefficients to n calibration points given as parallel
+// arrays. weights may be null, in which case all points have unit weight.
+// coefficients receives (A, B, C) and diagnostics receives the RMS residual,
+// the signed maximum residual and the index of the worst point. residuals may
+// be null. Returns the number of points used, or 0 if the fit failed.
+size_t espresso_shot_fit_steinhart_hart(const float* temperatures,
+                                        const float* resistances,
+                                        const float* weights, size_t n,
+                                        double* coefficients,
+                                        double* diagnostics,
+                                        float* residuals) {
+  std::vector<CalibrationPoint> points(n);
+  for (size_t i = 0; i < n; ++i) {
+    points[i] = {temperatures[i], resistances[i],
+                 weights == nullptr ? 1.0f : weights[i]};
+  }
+
+  SteinhartHartFit fit;
+  if (!fit_steinhart_hart(points.data(), n, fit, residuals))
+    return 0;
+
+  coefficients[0] = fit.sh_a;
+  coefficients[1] = fit.sh_b;
+  coefficients[2] = fit.sh_c;
+  diagnostics[0] = fit.rms_residual;
+  diagnostics[1] = fit.max_residual;
+  diagnostics[2] = fit.worst_point;
+  return fit.num_points;
+}
+
+}  // extern "C"
@@ -0,0 +1,107 @@
+/*
+  Benchmarks the sketch's sensing task under several device configurations
+  (see config.h), side by side in a single build.
+
+  Every configuration gets its own DeviceState, and its sensing task
+  (update_resistances followed by write_measurement, like in
+  espresso-shot.ino) is run on simulated ADC readings through the host shims.
+  The program reports the host time and the number of ADC conversions per
+  sensing tick, as well as the host time per simulated second of sensing, which
+  accounts for the configuration's sensing frequency.
+
+  Build and run with:
+
+    $ g++ -O2 -std=c++14 -Ihost/shims -o host/build/config_benchmark \
+        host/config_benchmark.cpp host/shims/arduino_shim.cpp functions.cpp \
+        timebase.cpp shot_detection.cpp puck_estimator.cpp ready_predictor.cpp \
+        tachometer.cpp
+    $ host/build/config_benchmark
+*/
+#include <stdio.h>
+
+#include <chrono>
+
+#include <Adafruit_ADS1015.h>
+#include <Arduino.h>
+
+#include "../config.h"
+#include "../constants.h"
+#include "../data_structures.h"
+#include "../functions.h"
+
+namespace {
+
+// Averages over four seconds instead of one.
+struct LongWindowConfig : DefaultConfig {
+  static constexpr int buffer_size = 4 * DefaultConfig::buffer_size;
+};
+
+// Senses five times faster, averaging over the same one second window.
+struct FastSensingConfig : DefaultConfig {
+  static constexpr unsigned short sensing_frequency =
+      5 * DefaultConfig::sensing_frequency;
+  static constexpr unsigned short sensing_period = 1000 / sensing_frequency;
+  static constexpr int buffer_size = sensing_frequency;
+};
+
+// Only monitors the group temperature.
+struct GroupOnlyConfig : DefaultConfig {
+  static constexpr bool has_basket_thermistor = false;
+};
+
+constexpr int NUM_TICKS = 200000;
+
+// Reference voltage's and thermistors' conversion results (3.3V and about
+// 93C with the ADS1115's default gain).
+constexpr uint16_t REFERENCE_CODE = 17600;
+constexpr uint16_t THERMISTOR_CODE = 1100;
+
+template <typename Config>
+void benchmark(const char* name) {
+  Adafruit_ADS1115 ads1115;
+  long num_conversions = 0;
+  // The conversion results vary slightly so that averages aren't constant.
+  ads1115.set_source([&num_conversions](uint8_t channel) {
+    ++num_conversions;
+    return channel == Config::reference_voltage_channel ? REFERENCE_CODE :
+        uint16_t(THERMISTOR_CODE + num_conversions % 7);
+  });
+  size_t num_bytes = 0;
+  Serial.set_sink([&num_bytes](const uint8_t* buffer, size_t size) {
+    (void) buffer;
+    num_bytes += size;
+  });
+
+  DeviceState<Config> state;
+  initialize_state(ads1115, state);
+  num_conversions = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int tick = 0; tick < NUM_TICKS; ++tick) {
+    update_resistances(ads1115, state);
+    write_measurement(state);
+  }
+  double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  double tick_time = 1e9 * seconds / NUM_TICKS;
+  printf("%-14s %6d %8d %10.1f %10.2f %12.1f\n", name,
+         int(Config::sensing_frequency), int(Config::buffer_size), tick_time,
+         double(num_conversions) / NUM_TICKS,
+         1e-3 * tick_time * Config::sensing_frequency);
+  // Keeps the compiler from optimizing the measurements away.
+  if (num_bytes != NUM_TICKS * sizeof(Measurement))
+    printf("  unexpected serial output: %zu bytes\n", num_bytes);
+}
+
+}  // namespace
+
+int main() {
+  printf("%-14s %6s %8s %10s %10s %12s\n", "Config", "Hz", "Buffer",
+         "ns/tick", "ADC/tick", "us/second");
+  benchmark<DefaultConfig>("default");
+  benchmark<LongWindowConfig>("long_window");
+  benchmark<FastSensingConfig>("fast_sensing");
+  benchmark<GroupOnlyConfig>("group_only");
+  return 0;
+}
@@ -0,0 +1,165 @@
+/*
+  Bounds the error of the sketch's fixed-point sensing pipeline (see
+  fixed_point.h) against its float counterpart.
+
+  Every ADC conversion result is fed through both versions of read_resistance
+  and resistance_to_temperature, and buffers of random resistances through both
+  versions of average_resistance. Temperatures are also compared to a double
+  precision evaluation of the Steinhart-Hart model, to tell the fixed-point
+  pipeline's error apart from the float pipeline's. The program fails if the
+  fixed-point pipeline's temperatures are off by more than
+  MAX_TEMPERATURE_ERROR in the operating range.
+
+  Build and run with:
+
+    $ g++ -O2 -std=c++14 -Ihost/shims -o host/build/fixed_point_accuracy \
+        host/fixed_point_accuracy.cpp host/shims/arduino_shim.cpp functions.cpp
+    $ host/build/fixed_point_accuracy
+*/
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <random>
+
+#include <Adafruit_ADS1015.h>
+
+#include "../config.h"
+#include "../constants.h"
+#include "../data_structures.h"
+#include "../functions.h"
+
+namespace {
+
+// Operating range (in degrees Celsius) and maximum tolerated error of the
+// fixed-point pipeline in that range.
+constexpr double MIN_TEMPERATURE = 0.0;
+constexpr double MAX_TEMPERATURE = 150.0;
+constexpr double MAX_TEMPERATURE_ERROR = 0.002;
+
+// Reference voltage's conversion result (3.3V with the ADS1115's default gain).
+constexpr uint16_t REFERENCE_CODE = 17600;
+
+double steinhart_hart(double resistance) {
+  double log_resistance = log(resistance);
+  return 1.0 / (BASKET_SH_A + BASKET_SH_B * log_resistance +
+                BASKET_SH_C * pow(log_resistance, 3)) - 273.15;
+}
+
+struct Error {
+  double max = 0.0;
+  double argmax = 0.0;
+
+  void update(double error, double at) {
+    if (fabs(error) > fabs(max)) {
+      max = error;
+      argmax = at;
+    }
+  }
+};
+
+}  // namespace
+
+int main() {
+  Adafruit_ADS1115 ads1115;
+  uint16_t code = 0;
+  ads1115.set_source([&code](uint8_t channel) {
+    return channel == REFERENCE_VOLTAGE_CHANNEL ? REFERENCE_CODE : code;
+  });
+
+  constexpr FixedSteinhartHart coefficients(BASKET_SH_A, BASKET_SH_B,
+                                            BASKET_SH_C);
+  Error resistance_error;
+  Error fixed_error;
+  Error float_error;
+  Error fixed_exact_error;
+  int num_codes = 0;
+  int num_format_mismatches = 0;
+  int num_infinity_mismatches = 0;
+  for (code = 1; code < REFERENCE_CODE; ++code) {
+    float float_resistance = read_resistance(ads1115, BASKET_VOLTAGE_CHANNEL,
+                                             float(BASKET_KNOWN_RESISTANCE));
+    FixedResistance fixed_resistance = read_resistance(
+        ads1115, BASKET_VOLTAGE_CHANNEL,
+        FixedResistance::from_double(BASKET_KNOWN_RESISTANCE));
+    if (isinf(float_resistance) != fixed_resistance.is_saturated()) {
+      ++num_infinity_mismatches;
+      continue;
+    }
+    if (isinf(float_resistance))
+      continue;
+    double exact_temperature = steinhart_hart(float_resistance);
+    if (exact_temperature < MIN_TEMPERATURE ||
+        exact_temperature > MAX_TEMPERATURE)
+      continue;
+
+    ++num_codes;
+    resistance_error.update(
+        (to_float(fixed_resistance) - float_resistance) / float_resistance,
+        float_resistance);
+    float float_temperature = resistance_to_temperature(
+        float_resistance, BASKET_SH_A, BASKET_SH_B, BASKET_SH_C);
+    FixedTemperature fixed_temperature = resistance_to_temperature(
+        fixed_resistance, coefficients);
+    fixed_error.update(to_float(fixed_temperature) - float_temperature,
+                       float_resistance);
+    float_error.update(float_temperature - exact_temperature,
+                       float_resistance);
+    // Evaluating the fixed-point conversion on the float pipeline's resistance
+    // isolates its error from the resistance's.
+    fixed_exact_error.update(
+        to_float(resistance_to_temperature(
+            FixedResistance::from_raw(lround(float_resistance * 16.0)),
+            coefficients)) -
+        steinhart_hart(lround(float_resistance * 16.0) / 16.0),
+        float_resistance);
+
+    char float_buffer[FORMAT_BUFFER_SIZE];
+    char fixed_buffer[FORMAT_BUFFER_SIZE];
+    format_temperature(float_buffer, float_temperature);
+    format_temperature(fixed_buffer, fixed_temperature);
+    num_format_mismatches += strcmp(float_buffer, fixed_buffer) != 0;
+  }
+
+  // Averages of random resistances in the thermistors' usual range.
+  std::mt19937 generator(0);
+  std::uniform_real_distribution<float> distribution(500.0, 50000.0);
+  Error average_error;
+  for (int trial = 0; trial < 10000; ++trial) {
+    float float_buffer[DefaultConfig::buffer_size];
+    FixedResistance fixed_buffer[DefaultConfig::buffer_size];
+    for (int i = 0; i < DefaultConfig::buffer_size; ++i) {
+      fixed_buffer[i] = FixedResistance::from_raw(
+          lround(distribution(generator) * 16.0));
+      float_buffer[i] = to_float(fixed_buffer[i]);
+    }
+    float float_average = average_resistance(float_buffer);
+    average_error.update(
+        (to_float(average_resistance(fixed_buffer)) - float_average) /
+        float_average, float_average);
+  }
+
+  printf("ADC codes in %g-%gC: %d\n", MIN_TEMPERATURE, MAX_TEMPERATURE,
+         num_codes);
+  printf("Resistance relative error (fixed vs float): %.3g at %.1f Ohms\n",
+         resistance_error.max, resistance_error.argmax);
+  printf("Average relative error (fixed vs float): %.3g at %.1f Ohms\n",
+         average_error.max, average_error.argmax);
+  printf("Temperature error (fixed vs float): %.3gC at %.1f Ohms\n",
+         fixed_error.max, fixed_error.argmax);
+  printf("Temperature error (float vs exact): %.3gC at %.1f Ohms\n",
+         float_error.max, float_error.argmax);
+  printf("Temperature error (fixed vs exact): %.3gC at %.1f Ohms\n",
+         fixed_exact_error.max, fixed_exact_error.argmax);
+  printf("Formatted temperature mismatches: %d\n", num_format_mismatches);
+  printf("Infinite resistance mismatches: %d\n", num_infinity_mismatches);
+
+  if (fabs(fixed_error.max) > MAX_TEMPERATURE_ERROR ||
+      num_infinity_mismatches > 0) {
+    printf("FAILED: the fixed-point pipeline exceeds its error bound.\n");
+    return 1;
+  }
+  printf("OK: the fixed-point pipeline is within %gC of the float pipeline.\n",
+         MAX_TEMPERATURE_ERROR);
+  return 0;
+}
@@ -0,0 +1,184 @@
+"""Generates the sketch's pre-rendered seven-segment glyphs.
+
+The display's timer and temperature fields are drawn by copying pre-rendered
+glyphs straight to the display as 8x8 pixel tiles (see `draw_glyph` in the
+sketch's functions.cpp), which avoids decoding font glyphs on every refresh.
+This script renders the glyphs from their segments and writes them as C++
+tables to `seven_segment_font.h`.
+
+Tiles are stored the way the SSD1306 expects them: every byte is a column of 8
+pixels, with the least significant bit at the top.
+
+Example usage:
+
+    $ python host/generate_seven_segment_font.py
+"""
+import argparse
+import os
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# Characters with a glyph, in the order of the glyph tables.
+CHARACTERS = '0123456789 -.:C'
+
+# Segments lit for every character: a (top), b (top right), c (bottom right),
+# d (bottom), e (bottom left), f (top left) and g (middle), plus 'p' (a point at
+# the bottom) and 'k' (a colon).
+SEGMENTS = {
+    '0': 'abcdef',
+    '1': 'bc',
+    '2': 'abdeg',
+    '3': 'abcdg',
+    '4': 'bcfg',
+    '5': 'acdfg',
+    '6': 'acdefg',
+    '7': 'abc',
+    '8': 'abcdefg',
+    '9': 'abcdfg',
+    ' ': '',
+    '-': 'g',
+    '.': 'p',
+    ':': 'k',
+    'C': 'adef',
+}
+
+# Rectangles (x0, y0, x1, y1, inclusive) covered by every segment, for each
+# glyph size.
+SMALL_SEGMENTS = {
+    'a': [(2, 1, 4, 2)],
+    'b': [(5, 2, 6, 7)],
+    'c': [(5, 8, 6, 13)],
+    'd': [(2, 13, 4, 14)],
+    'e': [(0, 8, 1, 13)],
+    'f': [(0, 2, 1, 7)],
+    'g': [(2, 7, 4, 8)],
+    'p': [(3, 13, 4, 14)],
+    'k': [(3, 4, 4, 5), (3, 10, 4, 11)],
+}
+LARGE_SEGMENTS = {
+    'a': [(4, 1, 11, 3)],
+    'b': [(12, 4, 14, 10)],
+    'c': [(12, 14, 14, 20)],
+    'd': [(4, 21, 11, 23)],
+    'e': [(1, 14, 3, 20)],
+    'f': [(1, 4, 3, 10)],
+    'g': [(4, 11, 11, 13)],
+    'p': [(2, 21, 4, 23)],
+    'k': [(2, 6, 4, 8), (2, 16, 4, 18)],
+}
+
+# Glyph sizes in tiles (width, height). Points and colons take a single tile
+# column in both sizes.
+SMALL_SIZE = (1, 2)
+LARGE_SIZE = (2, 3)
+NARROW_CHARACTERS = '.:'
+
+
+def render(character, segments, size):
+  """Renders a glyph.
+
+  Args:
+    character: str, character to render.
+    segments: dict, segment rectangles (e.g. `SMALL_SEGMENTS`).
+    size: tuple (width, height) of the glyph's size in tiles.
+
+  Returns:
+    list of `size[1]` tile rows, each a list of `8 * size[0]` column bytes.
+  """
+  width, height = size
+  pixels = set()
+  for segment in SEGMENTS[character]:
+    for x0, y0, x1, y1 in segments[segment]:
+      pixels.update((x, y) for x in range(x0, x1 + 1)
+                    for y in range(y0, y1 + 1))
+  return [[sum(1 << bit for bit in range(8) if (x, 8 * row + bit) in pixels)
+           for x in range(8 * width)]
+          for row in range(height)]
+
+
+def format_table(name, segments, size):
+  """Formats the glyph table of a glyph size as a C++ definition."""
+  width, height = size
+  lines = ['const uint8_t {}[][{}][{}] PROGMEM = {{'.format(
+      name, height, 8 * width)]
+  for character in CHARACTERS:
+    lines.append('    // \'{}\''.format(character))
+    lines.append('    {')
+    for row in render(character, segments, size):
+      lines.append('        {' + ', '.join(
+          '0x{:02X}'.format(column) for column in row) + '},')
+    lines.append('    },')
+  lines.append('};')
+  return '\n'.join(lines)
+
+
+def generate():
+  """Returns the contents of `seven_segment_font.h`."""
+  return '''/*
+  Pre-rendered seven-segment glyphs for the display's timer and temperature
+  fields, stored as SSD1306 tiles (see draw_glyph in functions.cpp).
+
+  Generated by host/generate_seven_segment_font.py; do not edit by hand.
+*/
+#ifndef ESPRESSO_SHOT_SEVEN_SEGMENT_FONT_H_
+#define ESPRESSO_SHOT_SEVEN_SEGMENT_FONT_H_
+
+#include <Arduino.h>
+
+// Characters with a glyph, in the order of the glyph tables.
+#define SEVEN_SEGMENT_CHARACTERS "{characters}"
+
+// Glyph sizes, in tiles of 8x8 pixels. Narrow characters ('.' and ':') only use
+// their glyph's first tile column.
+#define SMALL_GLYPH_WIDTH {small_width}
+#define SMALL_GLYPH_HEIGHT {small_height}
+#define LARGE_GLYPH_WIDTH {large_width}
+#define LARGE_GLYPH_HEIGHT {large_height}
+
+// Glyphs used for temperatures (8x16 pixels).
+{small_table}
+
+// Glyphs used for the timer (16x24 pixels).
+{large_table}
+
+#endif  // ESPRESSO_SHOT_SEVEN_SEGMENT_FONT_H_
+'''.format(
+      characters=CHARACTERS,
+      small_width=SMALL_SIZE[0], small_height=SMALL_SIZE[1],
+      large_width=LARGE_SIZE[0], large_height=LARGE_SIZE[1],
+      small_table=format_table('SMALL_GLYPHS', SMALL_SEGMENTS, SMALL_SIZE),
+      large_table=format_table('LARGE_GLYPHS', LARGE_SEGMENTS, LARGE_SIZE))
+
+
+def preview(text, segments, size):
+  """Returns an ASCII art preview of a string rendered with a glyph size."""
+  glyphs = [render(character, segments, size) for character in text]
+  lines = []
+  for row in range(size[1]):
+    for bit in range(8):
+      lines.append(''.join(
+          ''.join('#' if column >> bit & 1 else '.'
+                  for column in glyph[row][:8 if character in NARROW_CHARACTERS
+                                           else None])
+          for character, glyph in zip(text, glyphs)))
+  return '\n'.join(lines)
+
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser(
+      description='Generate the sketch\'s pre-rendered seven-segment glyphs.')
+  parser.add_argument(
+      '--output', type=str, default=os.path.join(ROOT, 'seven_segment_font.h'),
+      help='Path to the generated header.')
+  parser.add_argument(
+      '--preview', type=str, default=None,
+      help='Print a string rendered with both glyph sizes instead.')
+  args = parser.parse_args()
+
+  if args.preview is not None:
+    print(preview(args.preview, SMALL_SEGMENTS, SMALL_SIZE))
+    print()
+    print(preview(args.preview, LARGE_SEGMENTS, LARGE_SIZE))
+  else:
+    with open(args.output, 'w') as f:
+      f.write(generate())
@@ -0,0 +1,35 @@
+/*
+  C interface to the puck temperature estimator (puck_estimator.h) used by the
+  Python bindings (host.py).
+*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../puck_estimator.h"
+
+extern "C" {
+
+// Runs the puck temperature estimator over n samples given as parallel arrays
+// (times in milliseconds, and averaged group temperatures in hundredths of
+// degrees). coefficients holds the model's a1, a2, b0, b1 and c (see
+// PUCK_MODEL_* in constants.h) in that order, and may be null for the
+// defaults. estimates receives the estimated puck temperature after every
+// sample, in hundredths of degrees.
+void espresso_shot_estimate_puck_temperatures(
+    const uint32_t* times, const int16_t* group_temperatures, size_t n,
+    const double* coefficients, int16_t* estimates) {
+  PuckEstimator estimator;
+  if (coefficients != nullptr) {
+    estimator.begin(PuckModel(coefficients[0], coefficients[1],
+                              coefficients[2], coefficients[3],
+                              coefficients[4]));
+  } else {
+    estimator.begin();
+  }
+  for (size_t i = 0; i < n; ++i) {
+    estimator.update(times[i], group_temperatures[i]);
+    estimates[i] = estimator.temperature();
+  }
+}
+
+}  // extern "C"
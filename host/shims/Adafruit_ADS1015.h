@@ -0,0 +1,26 @@
+/*
+  Minimal host implementation of the Adafruit ADS1X15 library. Conversions are
+  provided by a callback set by the simulator.
+*/
+#ifndef ESPRESSO_SHOT_HOST_SHIMS_ADAFRUIT_ADS1015_H_
+#define ESPRESSO_SHOT_HOST_SHIMS_ADAFRUIT_ADS1015_H_
+
+#include <Arduino.h>
+
+class Adafruit_ADS1115 {
+ public:
+  void begin() {}
+
+  uint16_t readADC_SingleEnded(uint8_t channel) {
+    return source_ ? source_(channel) : 0;
+  }
+
+  void set_source(std::function<uint16_t(uint8_t)> source) {
+    source_ = source;
+  }
+
+ private:
+  std::function<uint16_t(uint8_t)> source_;
+};
+
+#endif  // ESPRESSO_SHOT_HOST_SHIMS_ADAFRUIT_ADS1015_H_
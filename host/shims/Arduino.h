@@ -0,0 +1,122 @@
+/*
+  Minimal host implementation of the Arduino core, used to build the sketch's
+  code natively (see host/simulator.cpp).
+
+  Time is simulated: the simulator sets it with set_simulated_micros and the
+  sketch reads it through millis() and micros() as usual.
+*/
+#ifndef ESPRESSO_SHOT_HOST_SHIMS_ARDUINO_H_
+#define ESPRESSO_SHOT_HOST_SHIMS_ARDUINO_H_
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <functional>
+
+// Like the architecture macros defined by real cores (e.g. ARDUINO_ARCH_AVR),
+// lets the sketch tell that it is built against the shims.
+#define ARDUINO_ARCH_HOST
+
+typedef uint8_t byte;
+
+// There is a single address space on the host, so program memory is read like
+// any other memory.
+#define PROGMEM
+#define memcpy_P memcpy
+#define pgm_read_byte(address) (*(const uint8_t*) (address))
+#define pgm_read_dword(address) (*(const uint32_t*) (address))
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+// Like the ArduinoCore-API templates, min and max accept mixed argument types
+// (e.g. float and double).
+template <class T, class L>
+auto min(const T& a, const L& b) -> decltype(b < a ? b : a) {
+  return b < a ? b : a;
+}
+
+template <class T, class L>
+auto max(const T& a, const L& b) -> decltype(b < a ? b : a) {
+  return a < b ? b : a;
+}
+
+// Simulated time. Like on the device, millis() and micros() wrap around at
+// 32 bits.
+void set_simulated_micros(uint64_t micros);
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+// Interrupts. The simulator records tachometer edges between control ticks,
+// never during them, so there is nothing to mask.
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+// Digital pins. Writes are recorded so that the simulator can observe outputs
+// such as the fan, and reads return values set by the simulator. Since the
+// simulator runs several devices in turn, it selects the pins of the device
+// that is about to run.
+constexpr int NUM_SIMULATED_PINS = 64;
+
+struct SimulatedPins {
+  uint8_t outputs[NUM_SIMULATED_PINS];
+  // Inputs are pulled up by default.
+  uint8_t inputs[NUM_SIMULATED_PINS];
+
+  SimulatedPins() {
+    memset(outputs, LOW, sizeof(outputs));
+    memset(inputs, HIGH, sizeof(inputs));
+  }
+};
+
+void select_simulated_pins(SimulatedPins* pins);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+// Serial port whose output is handed to a callback set by the simulator.
+class HardwareSerial {
+ public:
+  void begin(unsigned long baud) { (void) baud; }
+  size_t write(const uint8_t* buffer, size_t size);
+  size_t write(uint8_t value) { return write(&value, 1); }
+  // Free space in the transmit buffer, which is as large as the ATmega cores'
+  // unless set_free_space says otherwise.
+  int availableForWrite() { return free_space_ ? free_space_() : 63; }
+  int available();
+  int read();
+
+  void set_sink(std::function<void(const uint8_t*, size_t)> sink) {
+    sink_ = sink;
+  }
+  // Received bytes come from `source`, which returns the next byte or -1 when
+  // none is available.
+  void set_source(std::function<int()> source) {
+    source_ = source;
+    next_byte_ = -1;
+  }
+  // availableForWrite returns what `free_space` returns.
+  void set_free_space(std::function<int()> free_space) {
+    free_space_ = free_space;
+  }
+
+ private:
+  std::function<void(const uint8_t*, size_t)> sink_;
+  std::function<int()> source_;
+  std::function<int()> free_space_;
+  // Byte taken from the source by available() and not read yet.
+  int next_byte_ = -1;
+};
+
+extern HardwareSerial Serial;
+
+#endif  // ESPRESSO_SHOT_HOST_SHIMS_ARDUINO_H_
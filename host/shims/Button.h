@@ -0,0 +1,42 @@
+/*
+  Minimal host implementation of the Button library. The button state is read
+  from its (simulated) pin without debouncing.
+*/
+#ifndef ESPRESSO_SHOT_HOST_SHIMS_BUTTON_H_
+#define ESPRESSO_SHOT_HOST_SHIMS_BUTTON_H_
+
+#include <Arduino.h>
+
+class Button {
+ public:
+  static constexpr bool PRESSED = LOW;
+  static constexpr bool RELEASED = HIGH;
+
+  Button(uint8_t pin, uint16_t debounce_ms = 100)
+      : pin_(pin), state_(RELEASED), has_changed_(false) {
+    (void) debounce_ms;
+  }
+
+  void begin() {
+    pinMode(pin_, INPUT_PULLUP);
+    state_ = digitalRead(pin_);
+  }
+
+  bool read() {
+    bool state = digitalRead(pin_);
+    has_changed_ = state != state_;
+    state_ = state;
+    return state_;
+  }
+
+  bool toggled() { read(); return has_changed_; }
+  bool pressed() { return read() == PRESSED && has_changed_; }
+  bool released() { return read() == RELEASED && has_changed_; }
+
+ private:
+  uint8_t pin_;
+  bool state_;
+  bool has_changed_;
+};
+
+#endif  // ESPRESSO_SHOT_HOST_SHIMS_BUTTON_H_
@@ -0,0 +1,35 @@
+/*
+  Minimal host implementation of the Arduino EEPROM library. Like pins, every
+  simulated device has its own EEPROM, which the simulator selects before
+  running the device.
+*/
+#ifndef ESPRESSO_SHOT_HOST_SHIMS_EEPROM_H_
+#define ESPRESSO_SHOT_HOST_SHIMS_EEPROM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+// Same size as an ATmega328P's EEPROM.
+constexpr int SIMULATED_EEPROM_SIZE = 1024;
+
+struct SimulatedEEPROM {
+  // Erased EEPROM reads as 0xFF.
+  SimulatedEEPROM() { memset(memory, 0xFF, sizeof(memory)); }
+
+  uint8_t memory[SIMULATED_EEPROM_SIZE];
+  unsigned long num_writes = 0;
+};
+
+void select_simulated_eeprom(SimulatedEEPROM* eeprom);
+
+class EEPROMClass {
+ public:
+  uint8_t read(int address);
+  void write(int address, uint8_t value);
+  void update(int address, uint8_t value);
+  uint16_t length() { return SIMULATED_EEPROM_SIZE; }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif  // ESPRESSO_SHOT_HOST_SHIMS_EEPROM_H_
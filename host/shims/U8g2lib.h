@@ -0,0 +1,77 @@
+/*
+  Minimal host implementation of the U8g2 library. Drawing calls are accepted
+  and discarded, but tiles sent directly to the display are kept in a copy of
+  the display's memory, and the number of bytes transferred to the display is
+  counted.
+*/
+#ifndef ESPRESSO_SHOT_HOST_SHIMS_U8G2LIB_H_
+#define ESPRESSO_SHOT_HOST_SHIMS_U8G2LIB_H_
+
+#include <Arduino.h>
+
+typedef uint8_t u8g2_uint_t;
+struct u8g2_cb_t {};
+
+extern const u8g2_cb_t u8g2_cb_r0;
+#define U8G2_R0 (&u8g2_cb_r0)
+
+extern const uint8_t u8g2_font_helvR10_tr[];
+
+// SSD1306 display memory: 8 rows of tiles (pages), each 128 columns of 8
+// pixels.
+struct u8x8_t {
+  uint8_t memory[8][128];
+  unsigned long num_bytes_transferred;
+};
+
+// Sends `cnt` tiles of 8 bytes to the display, starting at tile column x and
+// row y.
+inline uint8_t u8x8_DrawTile(u8x8_t* u8x8, uint8_t x, uint8_t y, uint8_t cnt,
+                             uint8_t* tile_ptr) {
+  if (y < 8 && 8 * (x + cnt) <= 128)
+    memcpy(&u8x8->memory[y][8 * x], tile_ptr, 8 * cnt);
+  u8x8->num_bytes_transferred += 8 * cnt;
+  return 1;
+}
+
+// Like the real library's page buffer mode, drawing between firstPage and
+// nextPage is repeated once per page and every page is transferred.
+class U8G2_SSD1306_128X64_NONAME_1_HW_I2C {
+ public:
+  explicit U8G2_SSD1306_128X64_NONAME_1_HW_I2C(const u8g2_cb_t* rotation)
+      : u8x8_(), page_(0) {
+    (void) rotation;
+  }
+
+  bool begin() { return true; }
+  void setBusClock(uint32_t) {}
+  void firstPage() { page_ = 0; }
+  uint8_t nextPage() {
+    // Drawing isn't rendered, so transferred pages are blank.
+    memset(u8x8_.memory[page_], 0, sizeof(u8x8_.memory[page_]));
+    u8x8_.num_bytes_transferred += sizeof(u8x8_.memory[page_]);
+    return ++page_ < 8;
+  }
+  u8x8_t* getU8x8() { return &u8x8_; }
+  void setFont(const uint8_t* font) { (void) font; }
+  void setFontMode(uint8_t mode) { (void) mode; }
+  void setDrawColor(uint8_t color) { (void) color; }
+  u8g2_uint_t drawStr(u8g2_uint_t x, u8g2_uint_t y, const char* s) {
+    (void) x; (void) y;
+    return getStrWidth(s);
+  }
+  u8g2_uint_t getStrWidth(const char* s) { return 8 * strlen(s); }
+  void drawLine(u8g2_uint_t x1, u8g2_uint_t y1, u8g2_uint_t x2,
+                u8g2_uint_t y2) {
+    (void) x1; (void) y1; (void) x2; (void) y2;
+  }
+  void drawBox(u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h) {
+    (void) x; (void) y; (void) w; (void) h;
+  }
+
+ private:
+  u8x8_t u8x8_;
+  uint8_t page_;
+};
+
+#endif  // ESPRESSO_SHOT_HOST_SHIMS_U8G2LIB_H_
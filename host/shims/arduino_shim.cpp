@@ -0,0 +1,80 @@
+/*
+  Minimal host implementation of the Arduino core.
+*/
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <U8g2lib.h>
+
+namespace {
+
+uint64_t simulated_micros = 0;
+SimulatedPins default_pins;
+SimulatedPins* selected_pins = &default_pins;
+SimulatedEEPROM default_eeprom;
+SimulatedEEPROM* selected_eeprom = &default_eeprom;
+
+}  // namespace
+
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+
+const u8g2_cb_t u8g2_cb_r0 = {};
+const uint8_t u8g2_font_helvR10_tr[] = {0};
+
+void set_simulated_micros(uint64_t micros) { simulated_micros = micros; }
+
+unsigned long millis() { return uint32_t(simulated_micros / 1000); }
+
+unsigned long micros() { return uint32_t(simulated_micros); }
+
+void delay(unsigned long ms) { simulated_micros += uint64_t(ms) * 1000; }
+
+void select_simulated_pins(SimulatedPins* pins) { selected_pins = pins; }
+
+void pinMode(uint8_t pin, uint8_t mode) { (void) pin; (void) mode; }
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < NUM_SIMULATED_PINS)
+    selected_pins->outputs[pin] = value;
+}
+
+int digitalRead(uint8_t pin) {
+  return pin < NUM_SIMULATED_PINS ? selected_pins->inputs[pin] : LOW;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  if (sink_)
+    sink_(buffer, size);
+  return size;
+}
+
+int HardwareSerial::available() {
+  if (next_byte_ < 0 && source_)
+    next_byte_ = source_();
+  return next_byte_ >= 0 ? 1 : 0;
+}
+
+int HardwareSerial::read() {
+  available();
+  int value = next_byte_;
+  next_byte_ = -1;
+  return value;
+}
+
+void select_simulated_eeprom(SimulatedEEPROM* eeprom) {
+  selected_eeprom = eeprom;
+}
+
+uint8_t EEPROMClass::read(int address) {
+  return selected_eeprom->memory[address];
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  selected_eeprom->memory[address] = value;
+  ++selected_eeprom->num_writes;
+}
+
+void EEPROMClass::update(int address, uint8_t value) {
+  if (read(address) != value)
+    write(address, value);
+}
@@ -0,0 +1,58 @@
+/*
+  C interface to the shot detector (shot_detection.h) used by the Python
+  bindings (host.py).
+*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../shot_detection.h"
+
+extern "C" {
+
+// Runs the shot detector over n samples given as parallel arrays (times in
+// milliseconds, and averaged temperatures in hundredths of degrees).
+// thresholds holds the fields of ShotDetectionThresholds in order, and may be
+// null for the defaults. shots receives the start, detection and end times of
+// up to max_shots shots, in that order; a shot still in progress after the last
+// sample ends at the last sample. Returns the number of shots detected, which
+// may exceed max_shots.
+size_t espresso_shot_detect_shots(const uint32_t* times,
+                                  const int16_t* basket_temperatures,
+                                  const int16_t* group_temperatures, size_t n,
+                                  const int32_t* thresholds, uint32_t* shots,
+                                  size_t max_shots) {
+  ShotDetectionThresholds detection_thresholds =
+      DEFAULT_SHOT_DETECTION_THRESHOLDS;
+  if (thresholds != nullptr) {
+    detection_thresholds = {
+        int16_t(thresholds[0]), int16_t(thresholds[1]), int16_t(thresholds[2]),
+        int16_t(thresholds[3]), uint8_t(thresholds[4]),
+        uint16_t(thresholds[5]), uint32_t(thresholds[6])};
+  }
+
+  ShotDetector detector;
+  detector.begin(detection_thresholds);
+  size_t num_shots = 0;
+  bool in_shot = false;
+  for (size_t i = 0; i < n; ++i) {
+    detector.update(times[i], basket_temperatures[i], group_temperatures[i]);
+    if (detector.in_shot() && !in_shot && num_shots < max_shots) {
+      shots[3 * num_shots] = detector.start_time();
+      shots[3 * num_shots + 1] = detector.detection_time();
+    }
+    if (!detector.in_shot() && in_shot && num_shots < max_shots)
+      shots[3 * num_shots + 2] = detector.end_time();
+    if (detector.in_shot() != in_shot) {
+      num_shots += in_shot;
+      in_shot = detector.in_shot();
+    }
+  }
+  if (in_shot) {
+    if (num_shots < max_shots)
+      shots[3 * num_shots + 2] = times[n - 1];
+    ++num_shots;
+  }
+  return num_shots;
+}
+
+}  // extern "C"
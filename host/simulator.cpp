@@ -0,0 +1,507 @@
+/*
+  Simulates espresso shot devices speaking the real wire protocol over Linux
+  pseudo-terminals.
+
+  The sketch's functions.cpp is built natively against minimal host versions
+  of the Arduino core and libraries (host/shims), and driven with the same task
+  periods as espresso-shot.ino. Thermistor voltages come from a simple thermal
+  model of the grouphead and basket, and the brew lever alternates between
+  pulling shots and idling. The tilt switch can be made to miss shots, which
+  the sketch then detects from the temperatures (see shot_detection.h), and
+  the fan, whose tachometer is wired (see tachometer.h), can be made to stall.
+  Every device gets its own pseudo-terminal, which host tools can open like a
+  real serial port, e.g.:
+
+    $ g++ -O2 -std=c++14 -Ihost/shims -o host/build/simulator \
+        host/simulator.cpp host/shims/arduino_shim.cpp functions.cpp \
+        diagnostics.cpp bus.cpp timebase.cpp history.cpp storage.cpp \
+        shot_detection.cpp puck_estimator.cpp ready_predictor.cpp \
+        tachometer.cpp
+    $ host/build/simulator --devices 2 --speed 100
+    Device 0: /dev/pts/3
+    Device 1: /dev/pts/4
+    $ python3 espresso-shot.py -p /dev/pts/3
+
+  Options:
+
+    --devices N          Number of simulated devices (default 1).
+    --speed X            Simulated time runs X times faster than real time
+                         (default 1). 0 runs as fast as possible.
+    --noise C            Standard deviation of the thermistor noise, in degrees
+                         Celsius (default 0.05).
+    --dropout P          Probability that a frame is lost (default 0).
+    --bit_error_rate P   Probability that a transmitted bit is flipped
+                         (default 0).
+    --shot_duration S    Duration of simulated shots in seconds (default 30).
+    --idle_duration S    Idle time between simulated shots in seconds
+                         (default 60).
+    --tilt_failure P     Probability that the tilt switch misses a shot
+                         (default 0).
+    --fan_stall S        The fan jams after S simulated seconds (default:
+                         never).
+    --duration S         Stop after S simulated seconds (default: never).
+    --seed N             Random seed (default 0).
+*/
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <Adafruit_ADS1015.h>
+#include <Arduino.h>
+#include <Button.h>
+#include <EEPROM.h>
+#include <U8g2lib.h>
+
+#include "../bus.h"
+#include "../config.h"
+#include "../constants.h"
+#include "../data_structures.h"
+#include "../functions.h"
+
+namespace {
+
+struct Options {
+  int num_devices = 1;
+  double speed = 1.0;
+  double noise = 0.05;
+  double dropout = 0.0;
+  double bit_error_rate = 0.0;
+  double shot_duration = 30.0;
+  double idle_duration = 60.0;
+  double tilt_failure = 0.0;
+  double fan_stall = INFINITY;
+  double duration = INFINITY;
+  unsigned seed = 0;
+};
+
+// ADS1115 input range and resolution used by read_voltage.
+constexpr double ADC_VOLTS_PER_CODE = 0.0001875;
+constexpr double REFERENCE_VOLTAGE = 3.3;
+
+// Simulated devices have the fan's tachometer wired.
+struct SimulatedConfig : DefaultConfig {
+  static constexpr bool has_fan_tachometer = true;
+};
+
+// Thermal model. The grouphead relaxes towards the boiler's idle temperature,
+// is cooled by the fan in proportion to its speed, and is heated by the water
+// flowing through it during shots. The basket thermistor follows the water
+// temperature during shots and relaxes towards ambient temperature otherwise.
+constexpr double AMBIENT_TEMPERATURE = 25.0;
+constexpr double IDLE_GROUP_TEMPERATURE = 97.0;
+constexpr double BREW_WATER_TEMPERATURE = 93.0;
+constexpr double GROUP_TIME_CONSTANT = 300.0;
+constexpr double FAN_COOLING_RATE = 0.05;
+constexpr double SHOT_GROUP_HEATING = 0.02;
+constexpr double BASKET_SHOT_TIME_CONSTANT = 3.0;
+constexpr double BASKET_IDLE_TIME_CONSTANT = 60.0;
+
+// Fan model. The fan spins up towards its nominal speed and coasts down with
+// these time constants, in seconds.
+constexpr double FAN_SPIN_UP_TIME_CONSTANT = 0.3;
+constexpr double FAN_COAST_TIME_CONSTANT = 1.0;
+
+// Simulated time step, in microseconds.
+constexpr uint64_t TIME_STEP = 1000;
+
+// Set by SIGINT and SIGTERM to stop the simulation.
+volatile sig_atomic_t interrupted = 0;
+
+void handle_interrupt(int signal) {
+  (void) signal;
+  interrupted = 1;
+}
+
+// Converts a temperature to a thermistor resistance by inverting the
+// Steinhart-Hart model, which is a depressed cubic in ln(R).
+double temperature_to_resistance(double temperature, double sh_a, double sh_b,
+                                 double sh_c) {
+  double p = sh_b / sh_c;
+  double q = (sh_a - 1.0 / (temperature + 273.15)) / sh_c;
+  double discriminant = sqrt(q * q / 4.0 + p * p * p / 27.0);
+  return exp(cbrt(-q / 2.0 + discriminant) + cbrt(-q / 2.0 - discriminant));
+}
+
+// Converts a thermistor resistance to the ADC code read by read_voltage in
+// the pull-up voltage divider circuit.
+uint16_t resistance_to_code(double resistance, double known_resistance) {
+  double voltage = REFERENCE_VOLTAGE * resistance /
+                   (resistance + known_resistance);
+  return uint16_t(lround(voltage / ADC_VOLTS_PER_CODE));
+}
+
+// A simulated device: the sketch's state and peripherals, the environment it
+// measures, and the pseudo-terminal it writes to.
+struct Device {
+  Adafruit_ADS1115 ads1115;
+  U8G2_SSD1306_128X64_NONAME_1_HW_I2C u8g2{U8G2_R0};
+  Button temperature_increase_button{
+      SimulatedConfig::target_temperature_increase_pin, 100};
+  Button temperature_decrease_button{
+      SimulatedConfig::target_temperature_decrease_pin, 100};
+  Button tilt_switch{SimulatedConfig::tilt_pin, 100};
+  SimulatedPins pins;
+  SimulatedEEPROM eeprom;
+  DeviceState<SimulatedConfig> state;
+  BusScheduler bus;
+  ShotHistory history;
+
+  double group_temperature = IDLE_GROUP_TEMPERATURE;
+  double basket_temperature = AMBIENT_TEMPERATURE;
+  bool lever_up = false;
+  // Whether the tilt switch misses the current shot.
+  bool tilt_failed = false;
+  // Fan speed, as a fraction of its nominal speed, and the tachometer output's
+  // progress towards its next edge.
+  double fan_speed = 0.0;
+  double tachometer_phase = 0.0;
+
+  int master_fd = -1;
+  int slave_fd = -1;
+  unsigned long num_frames = 0;
+  unsigned long num_dropped_frames = 0;
+  unsigned long num_overflowed_frames = 0;
+  // Bytes of a partially written frame, which are sent before anything else so
+  // that the stream stays aligned on frame boundaries.
+  std::vector<uint8_t> pending;
+};
+
+class Simulator {
+ public:
+  explicit Simulator(const Options& options)
+      : options_(options), generator_(options.seed), noise_(0.0, 1.0) {}
+
+  bool open_devices() {
+    for (int i = 0; i < options_.num_devices; ++i) {
+      std::unique_ptr<Device> device(new Device());
+      if (!open_pseudo_terminal(*device))
+        return false;
+      printf("Device %d: %s\n", i, ptsname(device->master_fd));
+      devices_.push_back(std::move(device));
+    }
+    fflush(stdout);
+    return true;
+  }
+
+  void run() {
+    // Same initialization as setup() in espresso-shot.ino.
+    for (auto& device : devices_) {
+      select(*device);
+      device->ads1115.begin();
+      device->u8g2.begin();
+      device->temperature_increase_button.begin();
+      device->temperature_decrease_button.begin();
+      device->tilt_switch.begin();
+      pinMode(SimulatedConfig::fan_pin, OUTPUT);
+      initialize_state(device->ads1115, device->state);
+      device->history.begin();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t end_time = isinf(options_.duration) ?
+        UINT64_MAX : uint64_t(options_.duration * 1e6);
+    for (uint64_t time = 0; time < end_time && !interrupted;
+         time += TIME_STEP) {
+      set_simulated_micros(time);
+      update_environment(time);
+      for (auto& device : devices_) {
+        select(*device);
+        run_tasks(*device, time);
+      }
+
+      // Keep simulated time `speed` times ahead of real time.
+      if (options_.speed > 0.0 && time % 10000 == 0) {
+        auto target = start + std::chrono::duration<double, std::micro>(
+            time / options_.speed);
+        std::this_thread::sleep_until(target);
+      }
+    }
+  }
+
+  void print_statistics() const {
+    for (size_t i = 0; i < devices_.size(); ++i) {
+      fprintf(stderr,
+              "Device %zu: %lu frames, %lu dropped, %lu overflowed, "
+              "%lu display bytes\n",
+              i, devices_[i]->num_frames, devices_[i]->num_dropped_frames,
+              devices_[i]->num_overflowed_frames,
+              devices_[i]->u8g2.getU8x8()->num_bytes_transferred);
+    }
+  }
+
+ private:
+  bool open_pseudo_terminal(Device& device) {
+    device.master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (device.master_fd < 0 || grantpt(device.master_fd) != 0 ||
+        unlockpt(device.master_fd) != 0) {
+      perror("posix_openpt");
+      return false;
+    }
+
+    // Keeping the slave side open lets host tools come and go without the
+    // pseudo-terminal being torn down. It is also put in raw mode so that the
+    // binary protocol goes through unmodified before a host configures it.
+    device.slave_fd = open(ptsname(device.master_fd), O_RDWR | O_NOCTTY);
+    if (device.slave_fd < 0) {
+      perror("open");
+      return false;
+    }
+    struct termios attributes;
+    tcgetattr(device.slave_fd, &attributes);
+    cfmakeraw(&attributes);
+    tcsetattr(device.slave_fd, TCSANOW, &attributes);
+    return true;
+  }
+
+  // Makes the device's pins, serial port and ADC current.
+  void select(Device& device) {
+    select_simulated_pins(&device.pins);
+    select_simulated_eeprom(&device.eeprom);
+    Serial.set_source([&device]() {
+      uint8_t value;
+      return read(device.master_fd, &value, 1) == 1 ? int(value) : -1;
+    });
+    Serial.set_sink([this, &device](const uint8_t* buffer, size_t size) {
+      transmit(device, buffer, size);
+    });
+    // The transmit buffer is full while the host doesn't read.
+    Serial.set_free_space([this, &device]() {
+      return flush_pending(device) ? 63 : 0;
+    });
+    device.ads1115.set_source([this, &device](uint8_t channel) {
+      return read_adc(device, channel);
+    });
+  }
+
+  // Same tasks and periods as espresso-shot.ino.
+  void run_tasks(Device& device, uint64_t time) {
+    uint64_t time_ms = time / 1000;
+    device.pins.inputs[SimulatedConfig::tilt_pin] =
+        device.lever_up && !device.tilt_failed ? Button::RELEASED :
+                                                 Button::PRESSED;
+    if (time_ms % SimulatedConfig::default_task_period == 0) {
+      control_tick(device.temperature_increase_button,
+                   device.temperature_decrease_button, device.tilt_switch,
+                   device.state);
+      update_history(device.state, device.history);
+      handle_serial_commands(device.history);
+    }
+    if (time_ms % SimulatedConfig::sensing_period == 0)
+      device.bus.enqueue(ADC_DEVICE, &sense_step, &device, ADC_PRIORITY);
+    if (time_ms % SimulatedConfig::display_period == 0) {
+      update_display(device.state);
+      device.bus.enqueue(DISPLAY_DEVICE, &refresh_display_step, &device,
+                         DISPLAY_PRIORITY);
+    }
+    if (time_ms % SimulatedConfig::diagnostics_period == 0 &&
+        !device.history.sending()) {
+      write_diagnostics(device.state);
+      write_bus_usage(device.bus, SimulatedConfig::i2c_clock);
+      write_task_usage(device.state);
+      write_shot_detection(device.state);
+      write_fan(device.state);
+    }
+
+    // The device's main loop runs many times per millisecond, so the bus
+    // transactions queued so far all run before the next time step. Simulated
+    // time doesn't advance during bus transfers, so bus times are reported as
+    // zero.
+    while (device.bus.run()) {}
+  }
+
+  static bool sense_step(void* context) {
+    Device& device = *static_cast<Device*>(context);
+    update_resistances(device.ads1115, device.state);
+    if (!device.history.sending())
+      write_measurement(device.state);
+    return false;
+  }
+
+  static bool refresh_display_step(void* context) {
+    Device& device = *static_cast<Device*>(context);
+    return refresh_display(device.u8g2, device.state.display);
+  }
+
+  void update_environment(uint64_t time) {
+    double seconds = time / 1e6;
+    double dt = TIME_STEP / 1e6;
+    double cycle = options_.shot_duration + options_.idle_duration;
+    // Devices start their shots at staggered times.
+    for (size_t i = 0; i < devices_.size(); ++i) {
+      Device& device = *devices_[i];
+      double phase = fmod(seconds + i * cycle / devices_.size(), cycle);
+      bool lever_up = phase >= options_.idle_duration;
+      if (lever_up && !device.lever_up)
+        device.tilt_failed = uniform_(generator_) < options_.tilt_failure;
+      device.lever_up = lever_up;
+
+      // The fan is driven through a BJT, so LOW turns it on. A jammed fan
+      // doesn't turn at all.
+      bool fan_on = device.pins.outputs[SimulatedConfig::fan_pin] == LOW;
+      if (seconds >= options_.fan_stall) {
+        device.fan_speed = 0.0;
+      } else {
+        device.fan_speed += ((fan_on ? 1.0 : 0.0) - device.fan_speed) * dt /
+                            (fan_on ? FAN_SPIN_UP_TIME_CONSTANT :
+                                      FAN_COAST_TIME_CONSTANT);
+      }
+      // Edges reach the sketch as they would through the tachometer pin's
+      // interrupt handler.
+      device.tachometer_phase += device.fan_speed * TACHOMETER_NOMINAL_RPM *
+                                 TACHOMETER_PULSES_PER_REVOLUTION * dt / 60.0;
+      if (device.tachometer_phase >= 1.0) {
+        device.tachometer_phase -= floor(device.tachometer_phase);
+        device.state.tachometer.record_edge(uint32_t(time));
+      }
+
+      double group_rate = (IDLE_GROUP_TEMPERATURE - device.group_temperature) /
+                          GROUP_TIME_CONSTANT;
+      group_rate -= FAN_COOLING_RATE * device.fan_speed;
+      if (device.lever_up) {
+        group_rate += SHOT_GROUP_HEATING *
+                      (BREW_WATER_TEMPERATURE + 5.0 - device.group_temperature);
+      }
+      device.group_temperature += group_rate * dt;
+
+      double basket_target = device.lever_up ? BREW_WATER_TEMPERATURE :
+                                               AMBIENT_TEMPERATURE;
+      double basket_time_constant = device.lever_up ?
+          BASKET_SHOT_TIME_CONSTANT : BASKET_IDLE_TIME_CONSTANT;
+      device.basket_temperature += (basket_target - device.basket_temperature) *
+                                   dt / basket_time_constant;
+    }
+  }
+
+  uint16_t read_adc(Device& device, uint8_t channel) {
+    switch (channel) {
+      case REFERENCE_VOLTAGE_CHANNEL:
+        return uint16_t(lround(REFERENCE_VOLTAGE / ADC_VOLTS_PER_CODE));
+      case BASKET_VOLTAGE_CHANNEL:
+        return resistance_to_code(temperature_to_resistance(
+            device.basket_temperature + options_.noise * noise_(generator_),
+            BASKET_SH_A, BASKET_SH_B, BASKET_SH_C), BASKET_KNOWN_RESISTANCE);
+      case GROUP_VOLTAGE_CHANNEL:
+        return resistance_to_code(temperature_to_resistance(
+            device.group_temperature + options_.noise * noise_(generator_),
+            GROUP_SH_A, GROUP_SH_B, GROUP_SH_C), GROUP_KNOWN_RESISTANCE);
+      default:
+        return 0;
+    }
+  }
+
+  // Sends a frame written by the sketch, subject to dropouts and bit errors.
+  void transmit(Device& device, const uint8_t* buffer, size_t size) {
+    ++device.num_frames;
+    if (uniform_(generator_) < options_.dropout) {
+      ++device.num_dropped_frames;
+      return;
+    }
+
+    std::vector<uint8_t> frame(buffer, buffer + size);
+    if (options_.bit_error_rate > 0.0) {
+      // Draw the gaps between bit errors rather than testing every bit.
+      std::geometric_distribution<size_t> gap(options_.bit_error_rate);
+      for (size_t bit = gap(generator_); bit < 8 * size;
+           bit += 1 + gap(generator_))
+        frame[bit / 8] ^= 1 << (bit % 8);
+    }
+
+    // Like a real serial port, frames are lost when the host doesn't read fast
+    // enough for the pseudo-terminal's buffer.
+    if (!flush_pending(device)) {
+      ++device.num_overflowed_frames;
+      return;
+    }
+    ssize_t written = write(device.master_fd, frame.data(), frame.size());
+    if (written < 0)
+      written = 0;
+    device.pending.assign(frame.begin() + written, frame.end());
+  }
+
+  // Writes the rest of a partially written frame, returning whether it was
+  // written completely.
+  bool flush_pending(Device& device) {
+    if (device.pending.empty())
+      return true;
+    ssize_t written = write(device.master_fd, device.pending.data(),
+                            device.pending.size());
+    if (written > 0)
+      device.pending.erase(device.pending.begin(),
+                           device.pending.begin() + written);
+    return device.pending.empty();
+  }
+
+  Options options_;
+  std::vector<std::unique_ptr<Device>> devices_;
+  std::mt19937 generator_;
+  std::normal_distribution<double> noise_;
+  std::uniform_real_distribution<double> uniform_{0.0, 1.0};
+};
+
+bool parse_options(int argc, char** argv, Options& options) {
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 >= argc) {
+      fprintf(stderr, "Missing value for %s\n", argv[i]);
+      return false;
+    }
+    const char* name = argv[i];
+    const char* value = argv[++i];
+    if (strcmp(name, "--devices") == 0) {
+      options.num_devices = atoi(value);
+    } else if (strcmp(name, "--speed") == 0) {
+      options.speed = atof(value);
+    } else if (strcmp(name, "--noise") == 0) {
+      options.noise = atof(value);
+    } else if (strcmp(name, "--dropout") == 0) {
+      options.dropout = atof(value);
+    } else if (strcmp(name, "--bit_error_rate") == 0) {
+      options.bit_error_rate = atof(value);
+    } else if (strcmp(name, "--shot_duration") == 0) {
+      options.shot_duration = atof(value);
+    } else if (strcmp(name, "--idle_duration") == 0) {
+      options.idle_duration = atof(value);
+    } else if (strcmp(name, "--tilt_failure") == 0) {
+      options.tilt_failure = atof(value);
+    } else if (strcmp(name, "--fan_stall") == 0) {
+      options.fan_stall = atof(value);
+    } else if (strcmp(name, "--duration") == 0) {
+      options.duration = atof(value);
+    } else if (strcmp(name, "--seed") == 0) {
+      options.seed = strtoul(value, nullptr, 10);
+    } else {
+      fprintf(stderr, "Unknown option %s\n", name);
+      return false;
+    }
+  }
+  return options.num_devices > 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parse_options(argc, argv, options))
+    return 1;
+
+  Simulator simulator(options);
+  if (!simulator.open_devices())
+    return 1;
+
+  signal(SIGINT, handle_interrupt);
+  signal(SIGTERM, handle_interrupt);
+  simulator.run();
+  simulator.print_statistics();
+  return 0;
+}
@@ -0,0 +1,192 @@
+/*
+  Batch Steinhart-Hart conversions for host-side tools.
+*/
+#include "steinhart_hart.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ESPRESSO_SHOT_HAS_AVX2_PATH 1
+#endif
+
+namespace {
+
+// The logarithm is approximated with the Cephes logf algorithm: the argument
+// is decomposed as m * 2^e with m in [sqrt(1/2), sqrt(2)), and log(m) is
+// approximated with a degree 9 polynomial in (m - 1). ln(2) is split into a
+// coarse and a fine part to keep e * ln(2) accurate.
+constexpr float SQRT_HALF = 0.707106781186547524f;
+constexpr float LOG_P0 = 7.0376836292e-2f;
+constexpr float LOG_P1 = -1.1514610310e-1f;
+constexpr float LOG_P2 = 1.1676998740e-1f;
+constexpr float LOG_P3 = -1.2420140846e-1f;
+constexpr float LOG_P4 = 1.4249322787e-1f;
+constexpr float LOG_P5 = -1.6668057665e-1f;
+constexpr float LOG_P6 = 2.0000714765e-1f;
+constexpr float LOG_P7 = -2.4999993993e-1f;
+constexpr float LOG_P8 = 3.3333331174e-1f;
+constexpr float LN2_FINE = -2.12194440e-4f;
+constexpr float LN2_COARSE = 0.693359375f;
+
+constexpr float KELVIN_OFFSET = 273.15f;
+
+// Resistances that are not normal positive floats (disconnected thermistors,
+// shorts, NaNs) are converted with the standard library instead of the
+// polynomial logarithm, which only handles normal positive floats.
+inline bool is_regular(float resistance) {
+  return resistance >= FLT_MIN && resistance <= FLT_MAX;
+}
+
+inline float polynomial_log(float x) {
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  float exponent = float(int(bits >> 23) - 126);
+  bits = (bits & 0x007FFFFF) | 0x3F000000;
+  float m;
+  memcpy(&m, &bits, sizeof(m));
+
+  // m is now in [1/2, 1). Rescale it to [sqrt(1/2), sqrt(2)) and subtract one.
+  if (m < SQRT_HALF) {
+    exponent -= 1.0f;
+    m = (m - 1.0f) + m;
+  } else {
+    m = m - 1.0f;
+  }
+
+  float z = m * m;
+  float y = LOG_P0;
+  y = y * m + LOG_P1;
+  y = y * m + LOG_P2;
+  y = y * m + LOG_P3;
+  y = y * m + LOG_P4;
+  y = y * m + LOG_P5;
+  y = y * m + LOG_P6;
+  y = y * m + LOG_P7;
+  y = y * m + LOG_P8;
+  y = y * m * z;
+  y += exponent * LN2_FINE;
+  y -= 0.5f * z;
+  return m + y + exponent * LN2_COARSE;
+}
+
+inline float log_resistance_to_temperature(
+    float log_resistance, const SteinhartHartCoefficients& coefficients) {
+  float inverse_temperature_kelvin = coefficients.a + log_resistance * (
+      coefficients.b + coefficients.c * log_resistance * log_resistance);
+  return 1.0f / inverse_temperature_kelvin - KELVIN_OFFSET;
+}
+
+inline float convert(float resistance,
+                     const SteinhartHartCoefficients& coefficients) {
+  return log_resistance_to_temperature(
+      is_regular(resistance) ? polynomial_log(resistance) : logf(resistance),
+      coefficients);
+}
+
+#ifdef ESPRESSO_SHOT_HAS_AVX2_PATH
+
+// Converts resistances eight at a time and returns the number of resistances
+// converted, which is n rounded down to a multiple of eight.
+__attribute__((target("avx2,fma")))
+size_t convert_avx2(const float* resistances, float* temperatures, size_t n,
+                    const SteinhartHartCoefficients& coefficients) {
+  const __m256 min_regular = _mm256_set1_ps(FLT_MIN);
+  const __m256 max_regular = _mm256_set1_ps(FLT_MAX);
+  const __m256i mantissa_mask = _mm256_set1_epi32(0x007FFFFF);
+  const __m256i half_exponent = _mm256_set1_epi32(0x3F000000);
+  const __m256i exponent_bias = _mm256_set1_epi32(126);
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 sqrt_half = _mm256_set1_ps(SQRT_HALF);
+  const __m256 sh_a = _mm256_set1_ps(coefficients.a);
+  const __m256 sh_b = _mm256_set1_ps(coefficients.b);
+  const __m256 sh_c = _mm256_set1_ps(coefficients.c);
+  const __m256 kelvin_offset = _mm256_set1_ps(KELVIN_OFFSET);
+
+  size_t num_vectors = n / 8;
+  for (size_t v = 0; v < num_vectors; ++v) {
+    size_t offset = v * 8;
+    __m256 x = _mm256_loadu_ps(resistances + offset);
+
+    // Vectors containing irregular resistances are rare (they only occur
+    // while a thermistor is disconnected), so we simply hand them over to the
+    // scalar path.
+    __m256 regular = _mm256_and_ps(_mm256_cmp_ps(x, min_regular, _CMP_GE_OQ),
+                                   _mm256_cmp_ps(x, max_regular, _CMP_LE_OQ));
+    if (_mm256_movemask_ps(regular) != 0xFF) {
+      for (size_t i = offset; i < offset + 8; ++i)
+        temperatures[i] = convert(resistances[i], coefficients);
+      continue;
+    }
+
+    __m256i bits = _mm256_castps_si256(x);
+    __m256 exponent = _mm256_cvtepi32_ps(
+        _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), exponent_bias));
+    __m256 m = _mm256_castsi256_ps(_mm256_or_si256(
+        _mm256_and_si256(bits, mantissa_mask), half_exponent));
+
+    __m256 small = _mm256_cmp_ps(m, sqrt_half, _CMP_LT_OQ);
+    exponent = _mm256_sub_ps(exponent, _mm256_and_ps(small, one));
+    m = _mm256_add_ps(_mm256_sub_ps(m, one), _mm256_and_ps(small, m));
+
+    __m256 z = _mm256_mul_ps(m, m);
+    __m256 y = _mm256_set1_ps(LOG_P0);
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(LOG_P1));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(LOG_P2));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(LOG_P3));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(LOG_P4));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(LOG_P5));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(LOG_P6));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(LOG_P7));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(LOG_P8));
+    y = _mm256_mul_ps(_mm256_mul_ps(y, m), z);
+    y = _mm256_fmadd_ps(exponent, _mm256_set1_ps(LN2_FINE), y);
+    y = _mm256_fnmadd_ps(half, z, y);
+    __m256 log_x = _mm256_fmadd_ps(exponent, _mm256_set1_ps(LN2_COARSE),
+                                   _mm256_add_ps(m, y));
+
+    __m256 inverse_temperature_kelvin = _mm256_fmadd_ps(
+        log_x, _mm256_fmadd_ps(_mm256_mul_ps(sh_c, log_x), log_x, sh_b), sh_a);
+    _mm256_storeu_ps(temperatures + offset, _mm256_sub_ps(
+        _mm256_div_ps(one, inverse_temperature_kelvin), kelvin_offset));
+  }
+  return num_vectors * 8;
+}
+
+#endif  // ESPRESSO_SHOT_HAS_AVX2_PATH
+
+}  // namespace
+
+void resistance_to_temperature_batch(const float* resistances,
+                                     float* temperatures, size_t n,
+                                     SteinhartHartCoefficients coefficients) {
+  size_t num_converted = 0;
+#ifdef ESPRESSO_SHOT_HAS_AVX2_PATH
+  static const bool has_avx2 = __builtin_cpu_supports("avx2") &&
+                               __builtin_cpu_supports("fma");
+  if (has_avx2)
+    num_converted = convert_avx2(resistances, temperatures, n, coefficients);
+#endif
+  resistance_to_temperature_batch_scalar(
+      resistances + num_converted, temperatures + num_converted,
+      n - num_converted, coefficients);
+}
+
+void resistance_to_temperature_batch_scalar(
+    const float* resistances, float* temperatures, size_t n,
+    SteinhartHartCoefficients coefficients) {
+  for (size_t i = 0; i < n; ++i)
+    temperatures[i] = convert(resistances[i], coefficients);
+}
+
+void espresso_shot_resistance_to_temperature_batch(const float* resistances,
+                                                   float* temperatures,
+                                                   size_t n, float sh_a,
+                                                   float sh_b, float sh_c) {
+  resistance_to_temperature_batch(resistances, temperatures, n,
+                                  {sh_a, sh_b, sh_c});
+}
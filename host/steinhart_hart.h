@@ -0,0 +1,53 @@
+/*
+  Batch Steinhart-Hart conversions for host-side tools.
+
+  The device converts one resistance at a time with resistance_to_temperature
+  (functions.cpp). Host-side tools such as recalibrate.py convert millions of
+  recorded resistances at once, so this module provides a batch version which
+  replaces log and pow with a polynomial logarithm evaluated eight samples at a
+  time on AVX2 CPUs.
+*/
+#ifndef ESPRESSO_SHOT_HOST_STEINHART_HART_H_
+#define ESPRESSO_SHOT_HOST_STEINHART_HART_H_
+
+#include <stddef.h>
+
+// Steinhart-Hart model coefficients of a thermistor.
+struct SteinhartHartCoefficients {
+  float a;
+  float b;
+  float c;
+};
+
+// Converts n thermistor resistances to temperatures (in degrees Celsius).
+//
+// The AVX2 path is selected at runtime when the CPU supports it, and a scalar
+// loop using the same polynomial logarithm handles other CPUs as well as the
+// samples left over after the last full vector. Results stay within 32 ULP
+// (about 1.5e-4 degrees) of the scalar resistance_to_temperature for
+// resistances between 100 and 100k ohms, as measured by
+// host/steinhart_hart_benchmark.cpp. Most of that difference comes from
+// subtracting 273.15 from the Kelvin temperature in single precision.
+// Infinite, zero, negative and NaN resistances are converted with the standard
+// library and behave exactly like the scalar path (e.g. a disconnected
+// thermistor reads as -273.15 degrees).
+void resistance_to_temperature_batch(const float* resistances,
+                                     float* temperatures, size_t n,
+                                     SteinhartHartCoefficients coefficients);
+
+// Same as resistance_to_temperature_batch, but never uses the AVX2 path.
+void resistance_to_temperature_batch_scalar(
+    const float* resistances, float* temperatures, size_t n,
+    SteinhartHartCoefficients coefficients);
+
+extern "C" {
+
+// C interface used by the Python bindings (host.py).
+void espresso_shot_resistance_to_temperature_batch(const float* resistances,
+                                                   float* temperatures,
+                                                   size_t n, float sh_a,
+                                                   float sh_b, float sh_c);
+
+}  // extern "C"
+
+#endif  // ESPRESSO_SHOT_HOST_STEINHART_HART_H_
@@ -0,0 +1,128 @@
+/*
+  Benchmarks the batch Steinhart-Hart conversions against the device's scalar
+  conversion and measures how far apart their results are. The rows are the
+  device's conversion (reference), the batch conversion's scalar loop
+  (batch-scalar), and the batch conversion with its runtime dispatch, which
+  takes the AVX2 path on CPUs that support it (batch-dispatch).
+
+  Build and run from the repository root with:
+
+    $ g++ -O2 -std=c++14 -o host/build/steinhart_hart_benchmark \
+        host/steinhart_hart.cpp host/steinhart_hart_benchmark.cpp
+    $ host/build/steinhart_hart_benchmark
+*/
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "../constants.h"
+#include "steinhart_hart.h"
+
+namespace {
+
+// Number of resistances converted per run, and number of timed runs.
+constexpr size_t NUM_RESISTANCES = 1 << 22;
+constexpr int NUM_RUNS = 10;
+
+// The benchmark covers resistances between 100 ohms and 100k ohms, which spans
+// temperatures from about 25C to 300C for the default coefficients. Below
+// 25C temperatures approach zero and their ULPs become meaningless.
+constexpr float MIN_RESISTANCE = 100.0f;
+constexpr float MAX_RESISTANCE = 100000.0f;
+
+// Same computation as resistance_to_temperature in functions.cpp.
+float resistance_to_temperature(float resistance, float sh_a, float sh_b,
+                                float sh_c) {
+  float inverse_temperature_kelvin = (
+    sh_a + sh_b * log(resistance) + sh_c * pow(log(resistance), 3)
+  );
+
+  return 1.0 / inverse_temperature_kelvin - 273.15;
+}
+
+// Returns the distance in units in the last place between two floats of the
+// same sign.
+int64_t ulp_distance(float a, float b) {
+  int32_t a_bits, b_bits;
+  memcpy(&a_bits, &a, sizeof(a_bits));
+  memcpy(&b_bits, &b, sizeof(b_bits));
+  return llabs(int64_t(a_bits) - int64_t(b_bits));
+}
+
+template <typename Function>
+double time_per_conversion_ns(Function function) {
+  auto start = std::chrono::steady_clock::now();
+  for (int run = 0; run < NUM_RUNS; ++run)
+    function();
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / (double(NUM_RUNS) * NUM_RESISTANCES);
+}
+
+void report(const char* name, double ns, double reference_ns,
+            const std::vector<float>& temperatures,
+            const std::vector<float>& reference_temperatures) {
+  int64_t max_ulp = 0;
+  double max_error = 0.0;
+  for (size_t i = 0; i < temperatures.size(); ++i) {
+    int64_t ulp = ulp_distance(temperatures[i], reference_temperatures[i]);
+    if (ulp > max_ulp)
+      max_ulp = ulp;
+    double error = fabs(double(temperatures[i]) - reference_temperatures[i]);
+    if (error > max_error)
+      max_error = error;
+  }
+  printf("%-14s %12.2f %8.1fx %8lld %12.3g\n", name, ns, reference_ns / ns,
+         (long long) max_ulp, max_error);
+}
+
+}  // namespace
+
+int main() {
+  SteinhartHartCoefficients coefficients = {
+      GROUP_SH_A, GROUP_SH_B, GROUP_SH_C};
+
+  std::mt19937 generator(0);
+  std::uniform_real_distribution<float> log_resistance(
+      logf(MIN_RESISTANCE), logf(MAX_RESISTANCE));
+  std::vector<float> resistances(NUM_RESISTANCES);
+  for (float& resistance : resistances)
+    resistance = expf(log_resistance(generator));
+
+  std::vector<float> reference(NUM_RESISTANCES);
+  std::vector<float> batch_scalar(NUM_RESISTANCES);
+  std::vector<float> batch_dispatch(NUM_RESISTANCES);
+
+  double reference_ns = time_per_conversion_ns([&]() {
+    for (size_t i = 0; i < NUM_RESISTANCES; ++i)
+      reference[i] = resistance_to_temperature(
+          resistances[i], coefficients.a, coefficients.b, coefficients.c);
+  });
+  double batch_scalar_ns = time_per_conversion_ns([&]() {
+    resistance_to_temperature_batch_scalar(
+        resistances.data(), batch_scalar.data(), NUM_RESISTANCES,
+        coefficients);
+  });
+  double batch_dispatch_ns = time_per_conversion_ns([&]() {
+    resistance_to_temperature_batch(
+        resistances.data(), batch_dispatch.data(), NUM_RESISTANCES,
+        coefficients);
+  });
+
+  printf("%zu resistances between %g and %g ohms, %d runs.\n",
+         NUM_RESISTANCES, MIN_RESISTANCE, MAX_RESISTANCE, NUM_RUNS);
+  printf("%-14s %12s %9s %8s %12s\n", "", "ns/sample", "speedup", "max ULP",
+         "max error C");
+  report("reference", reference_ns, reference_ns, reference, reference);
+  report("batch-scalar", batch_scalar_ns, reference_ns, batch_scalar,
+         reference);
+  report("batch-dispatch", batch_dispatch_ns, reference_ns, batch_dispatch,
+         reference);
+  return 0;
+}
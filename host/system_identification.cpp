@@ -0,0 +1,718 @@
+/*
+  Fits thermal models of the grouphead and basket to the shot archive
+  (archive.py), and prints the coefficients of the puck temperature estimator
+  (puck_estimator.h) in the format of constants.h.
+
+  Every archived shot is replayed like on the device: resistances are averaged
+  over BUFFER_SIZE samples and converted to temperatures (shots recorded before
+  resistances were kept are averaged in temperature), and the averages are
+  sampled every PUCK_MODEL_STEP milliseconds. Two kinds of models are then
+  fitted by least squares over all shots at once:
+
+  - The estimator's ARX model of the basket temperature given the group
+    temperature (see PUCK_MODEL_* in constants.h).
+  - First-order-plus-dead-time (FOPDT) models, of the basket temperature given
+    the group temperature, and of the group temperature given the fan state
+    for shots that record it (in a "fan" column of zeros and ones). They are
+    fitted as first-order ARX models with a delayed input, for every dead time
+    up to --max_dead_time, and the dead time with the smallest residual wins.
+
+  The archive is memory-mapped and shots are shared among worker threads, which
+  accumulate their own normal equations (a few multiply-adds per step and
+  model) that are summed once all shots are scanned. A second pass runs the
+  device's estimator with the fitted and the current coefficients over every
+  shot, which is the error that matters on the device since the estimator never
+  sees the basket temperature.
+
+  The basket thermistor takes a few seconds to heat up at the start of a shot,
+  so the first --warm_up seconds of every shot are left out of the fits and of
+  the estimator's errors.
+
+  Build and run from the repository root with:
+
+    $ g++ -O2 -std=c++14 -pthread -o host/build/system_identification \
+        host/system_identification.cpp host/steinhart_hart.cpp \
+        puck_estimator.cpp
+    $ host/build/system_identification --path data/shots
+
+  Options:
+
+    --path PREFIX        Path prefix of the archive files (default data/shots).
+    --threads N          Number of worker threads (default: one per CPU).
+    --warm_up S          Seconds left out at the start of every shot
+                         (default 5).
+    --max_dead_time S    Longest dead time tried for FOPDT models, in seconds
+                         (default 5).
+*/
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../constants.h"
+#include "../puck_estimator.h"
+#include "steinhart_hart.h"
+
+namespace {
+
+struct Options {
+  std::string path = "data/shots";
+  unsigned num_threads = 0;
+  double warm_up = 5.0;
+  double max_dead_time = 5.0;
+};
+
+// Layout of the archive's files (see INDEX_DTYPE, SHOT_HEADER_DTYPE and
+// COLUMN_DTYPE in archive.py).
+#pragma pack(push, 1)
+struct IndexRecord {
+  uint64_t offset;
+  uint32_t num_samples;
+  uint32_t num_columns;
+  double posix_time;
+};
+
+struct ShotHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t num_columns;
+  uint32_t num_samples;
+  uint32_t calibration_version;
+  double posix_time;
+  char description[128];
+  char columns[8][32];
+};
+#pragma pack(pop)
+
+static_assert(sizeof(IndexRecord) == 24, "unexpected index record size");
+static_assert(sizeof(ShotHeader) == 408, "unexpected shot header size");
+
+// Read-only memory map of a whole file, which is empty if the file is.
+class MappedFile {
+ public:
+  MappedFile() = default;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    if (data_ != nullptr)
+      munmap(data_, size_);
+  }
+
+  bool open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      perror(path.c_str());
+      return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+      perror(path.c_str());
+      close(fd);
+      return false;
+    }
+    size_ = size_t(status.st_size);
+    if (size_ > 0) {
+      void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+      if (data == MAP_FAILED) {
+        perror(path.c_str());
+        close(fd);
+        return false;
+      }
+      data_ = data;
+    }
+    close(fd);
+    return true;
+  }
+
+  const uint8_t* data() const { return static_cast<const uint8_t*>(data_); }
+  size_t size() const { return size_; }
+
+ private:
+  void* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Columns of an archived shot, viewing the memory-mapped data file. Columns
+// that the shot doesn't have are null.
+struct ShotColumns {
+  size_t num_samples = 0;
+  const float* time = nullptr;
+  const float* basket_resistance = nullptr;
+  const float* group_resistance = nullptr;
+  const float* basket_temperature = nullptr;
+  const float* group_temperature = nullptr;
+  const float* fan = nullptr;
+};
+
+class Archive {
+ public:
+  bool open(const std::string& path) {
+    return data_.open(path + ".dat") && index_.open(path + ".idx");
+  }
+
+  size_t size() const { return index_.size() / sizeof(IndexRecord); }
+
+  // Finds the columns of the i-th shot, returning false if its block is
+  // corrupted.
+  bool shot(size_t i, ShotColumns& columns) const {
+    IndexRecord record;
+    memcpy(&record, index_.data() + i * sizeof(IndexRecord), sizeof(record));
+    if (record.offset + sizeof(ShotHeader) > data_.size())
+      return false;
+    const ShotHeader* header = reinterpret_cast<const ShotHeader*>(
+        data_.data() + record.offset);
+    size_t column_size = size_t(header->num_samples) * sizeof(float);
+    if (memcmp(header->magic, "SHOT", 4) != 0 || header->num_columns > 8 ||
+        record.offset + sizeof(ShotHeader) +
+            header->num_columns * column_size > data_.size())
+      return false;
+
+    columns = ShotColumns();
+    columns.num_samples = header->num_samples;
+    // Blocks are 8-byte aligned, so columns are naturally aligned floats.
+    const float* column = reinterpret_cast<const float*>(
+        data_.data() + record.offset + sizeof(ShotHeader));
+    for (int j = 0; j < header->num_columns;
+         ++j, column += columns.num_samples) {
+      std::string name(header->columns[j],
+                       strnlen(header->columns[j], sizeof(header->columns[j])));
+      if (name == "time")
+        columns.time = column;
+      else if (name == "basket_resistance")
+        columns.basket_resistance = column;
+      else if (name == "group_resistance")
+        columns.group_resistance = column;
+      else if (name == "basket_temperature")
+        columns.basket_temperature = column;
+      else if (name == "group_temperature")
+        columns.group_temperature = column;
+      else if (name == "fan")
+        columns.fan = column;
+    }
+    return true;
+  }
+
+ private:
+  MappedFile data_;
+  MappedFile index_;
+};
+
+// Averages every value with the BUFFER_SIZE - 1 values before it, like the
+// device's resistance buffers (which are filled with the first value at boot).
+// Averages that include an infinite value are infinite.
+void running_mean(const float* values, size_t n, std::vector<float>& means) {
+  // The averaged samples are the values preceded by BUFFER_SIZE - 1 copies of
+  // the first one.
+  constexpr size_t padding = BUFFER_SIZE - 1;
+  auto padded = [&](size_t j) { return values[j < padding ? 0 : j - padding]; };
+  means.resize(n);
+  double sum = 0.0;
+  size_t num_infinite = 0;
+  for (size_t j = 0; j < n + padding; ++j) {
+    float value = padded(j);
+    if (isinf(value))
+      ++num_infinite;
+    else
+      sum += value;
+    if (j >= BUFFER_SIZE) {
+      float removed = padded(j - BUFFER_SIZE);
+      if (isinf(removed))
+        --num_infinite;
+      else
+        sum -= removed;
+    }
+    if (j >= padding)
+      means[j - padding] = num_infinite > 0 ? INFINITY :
+                           float(sum / BUFFER_SIZE);
+  }
+}
+
+// Averages a thermistor's samples like the device, converting resistances
+// with the thermistor's Steinhart-Hart coefficients. Returns false if the shot
+// has neither column.
+bool average_temperatures(const float* resistances, const float* temperatures,
+                          size_t n, SteinhartHartCoefficients coefficients,
+                          std::vector<float>& averages) {
+  if (resistances != nullptr) {
+    std::vector<float> mean_resistances;
+    running_mean(resistances, n, mean_resistances);
+    averages.resize(n);
+    resistance_to_temperature_batch(mean_resistances.data(), averages.data(),
+                                    n, coefficients);
+    return true;
+  }
+  if (temperatures != nullptr) {
+    running_mean(temperatures, n, averages);
+    return true;
+  }
+  return false;
+}
+
+// Converts a temperature like the sketch's to_centidegrees.
+int16_t to_centidegrees(float temperature) {
+  if (!(temperature > -273.0f))
+    return DISCONNECTED_CENTIDEGREES;
+  float centidegrees = roundf(temperature * 100.0f);
+  return centidegrees < INT16_MAX ? int16_t(centidegrees) : INT16_MAX;
+}
+
+// Shot replayed like on the device: the averaged temperatures after every
+// sample, and the samples at which the device's estimator steps (see
+// PuckEstimator::update).
+struct Replay {
+  std::vector<uint32_t> times;
+  std::vector<float> basket;
+  std::vector<float> group;
+  // Step samples, and the segment that each one belongs to. Segments are
+  // broken by disconnected thermistors and gaps in the samples, and models
+  // only relate steps of the same segment.
+  std::vector<size_t> steps;
+  std::vector<uint32_t> segments;
+};
+
+bool replay(const ShotColumns& columns, Replay& shot) {
+  static const SteinhartHartCoefficients basket_coefficients = {
+      BASKET_SH_A, BASKET_SH_B, BASKET_SH_C};
+  static const SteinhartHartCoefficients group_coefficients = {
+      GROUP_SH_A, GROUP_SH_B, GROUP_SH_C};
+  size_t n = columns.num_samples;
+  if (n == 0 || columns.time == nullptr ||
+      !average_temperatures(columns.basket_resistance,
+                            columns.basket_temperature, n, basket_coefficients,
+                            shot.basket) ||
+      !average_temperatures(columns.group_resistance,
+                            columns.group_temperature, n, group_coefficients,
+                            shot.group))
+    return false;
+
+  shot.times.resize(n);
+  for (size_t i = 0; i < n; ++i)
+    shot.times[i] = uint32_t(lround((columns.time[i] - columns.time[0]) * 1e3));
+
+  shot.steps.clear();
+  shot.segments.clear();
+  uint32_t segment = 0;
+  bool stepped = false;
+  uint32_t last_step_time = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (!(shot.basket[i] > -273.0f) || !(shot.group[i] > -273.0f)) {
+      stepped = false;
+      continue;
+    }
+    uint32_t time = shot.times[i];
+    if (stepped && time - last_step_time < PUCK_MODEL_STEP)
+      continue;
+    if (!stepped || time - last_step_time >= 2 * PUCK_MODEL_STEP) {
+      if (!shot.steps.empty())
+        ++segment;
+      last_step_time = time;
+    } else {
+      last_step_time += PUCK_MODEL_STEP;
+    }
+    stepped = true;
+    shot.steps.push_back(i);
+    shot.segments.push_back(segment);
+  }
+  return true;
+}
+
+// Normal equations of a linear least-squares fit with N parameters.
+template <int N>
+struct NormalEquations {
+  double matrix[N][N] = {};
+  double vector[N] = {};
+  double sum_of_squares = 0.0;
+  size_t num_rows = 0;
+
+  void add(const double (&row)[N], double value) {
+    for (int i = 0; i < N; ++i) {
+      for (int j = 0; j <= i; ++j)
+        matrix[i][j] += row[i] * row[j];
+      vector[i] += row[i] * value;
+    }
+    sum_of_squares += value * value;
+    ++num_rows;
+  }
+
+  void merge(const NormalEquations& other) {
+    for (int i = 0; i < N; ++i) {
+      for (int j = 0; j <= i; ++j)
+        matrix[i][j] += other.matrix[i][j];
+      vector[i] += other.vector[i];
+    }
+    sum_of_squares += other.sum_of_squares;
+    num_rows += other.num_rows;
+  }
+
+  // Solves the equations like solve_steinhart_hart (calibration.cpp), by
+  // Gaussian elimination with partial pivoting on the equilibrated system.
+  // Returns false if they are (numerically) degenerate.
+  bool solve(double (&solution)[N]) const {
+    if (num_rows < size_t(N))
+      return false;
+    double scale[N];
+    double system[N][N + 1];
+    for (int i = 0; i < N; ++i) {
+      if (!(matrix[i][i] > 0.0))
+        return false;
+      scale[i] = 1.0 / sqrt(matrix[i][i]);
+    }
+    for (int i = 0; i < N; ++i) {
+      for (int j = 0; j < N; ++j) {
+        system[i][j] = (j <= i ? matrix[i][j] : matrix[j][i]) * scale[i] *
+                       scale[j];
+      }
+      system[i][N] = vector[i] * scale[i];
+    }
+
+    for (int column = 0; column < N; ++column) {
+      int pivot = column;
+      for (int row = column + 1; row < N; ++row) {
+        if (fabs(system[row][column]) > fabs(system[pivot][column]))
+          pivot = row;
+      }
+      if (fabs(system[pivot][column]) < 1e-12)
+        return false;
+      if (pivot != column) {
+        for (int j = 0; j <= N; ++j)
+          std::swap(system[column][j], system[pivot][j]);
+      }
+      for (int row = column + 1; row < N; ++row) {
+        double factor = system[row][column] / system[column][column];
+        for (int j = column; j <= N; ++j)
+          system[row][j] -= factor * system[column][j];
+      }
+    }
+
+    for (int row = N - 1; row >= 0; --row) {
+      double sum = system[row][N];
+      for (int j = row + 1; j < N; ++j)
+        sum -= system[row][j] * solution[j];
+      solution[row] = sum / system[row][row];
+    }
+    for (int i = 0; i < N; ++i)
+      solution[i] *= scale[i];
+    return true;
+  }
+
+  // Root mean square of the residuals of a solution.
+  double rms_residual(const double (&solution)[N]) const {
+    double residuals = sum_of_squares;
+    for (int i = 0; i < N; ++i)
+      residuals -= solution[i] * vector[i];
+    return sqrt(std::max(residuals, 0.0) / num_rows);
+  }
+};
+
+// Temperatures are fitted relative to a reference, so that the normal
+// equations' sums stay small next to the differences between temperatures
+// that the models rely on.
+constexpr double REFERENCE_TEMPERATURE = TARGET_TEMPERATURE_DEFAULT;
+
+// Normal equations accumulated by a worker thread, summed once all shots are
+// scanned. The ARX model's rows are (basket[k-1], basket[k-2], group[k],
+// group[k-1], 1) and the FOPDT models' rows are (output[k-1], input[k-d], 1),
+// with one set of equations per dead time d.
+struct Accumulators {
+  NormalEquations<5> arx;
+  std::vector<NormalEquations<3>> basket_fopdt;
+  std::vector<NormalEquations<3>> fan_fopdt;
+  size_t num_shots = 0;
+  size_t num_fan_shots = 0;
+  size_t num_skipped_shots = 0;
+  size_t num_samples = 0;
+
+  explicit Accumulators(int max_delay)
+      : basket_fopdt(max_delay + 1), fan_fopdt(max_delay + 1) {}
+
+  void merge(const Accumulators& other) {
+    arx.merge(other.arx);
+    for (size_t d = 0; d < basket_fopdt.size(); ++d) {
+      basket_fopdt[d].merge(other.basket_fopdt[d]);
+      fan_fopdt[d].merge(other.fan_fopdt[d]);
+    }
+    num_shots += other.num_shots;
+    num_fan_shots += other.num_fan_shots;
+    num_skipped_shots += other.num_skipped_shots;
+    num_samples += other.num_samples;
+  }
+};
+
+void accumulate(const Replay& shot, const float* fan, uint32_t warm_up,
+                Accumulators& accumulators) {
+  const std::vector<size_t>& steps = shot.steps;
+  int max_delay = int(accumulators.basket_fopdt.size()) - 1;
+  for (size_t k = 1; k < steps.size(); ++k) {
+    if (shot.times[steps[k]] < warm_up || shot.segments[k - 1] !=
+                                          shot.segments[k])
+      continue;
+    double basket = shot.basket[steps[k]] - REFERENCE_TEMPERATURE;
+    double last_basket = shot.basket[steps[k - 1]] - REFERENCE_TEMPERATURE;
+    double group = shot.group[steps[k]] - REFERENCE_TEMPERATURE;
+    double last_group = shot.group[steps[k - 1]] - REFERENCE_TEMPERATURE;
+
+    if (k >= 2 && shot.segments[k - 2] == shot.segments[k]) {
+      double row[5] = {last_basket,
+                       shot.basket[steps[k - 2]] - REFERENCE_TEMPERATURE,
+                       group, last_group, 1.0};
+      accumulators.arx.add(row, basket);
+    }
+
+    for (int d = 0; d <= max_delay && size_t(d) <= k; ++d) {
+      if (shot.segments[k - d] != shot.segments[k])
+        break;
+      double basket_row[3] = {
+          last_basket, shot.group[steps[k - d]] - REFERENCE_TEMPERATURE, 1.0};
+      accumulators.basket_fopdt[d].add(basket_row, basket);
+      if (fan != nullptr) {
+        double fan_row[3] = {last_group, double(fan[steps[k - d]]), 1.0};
+        accumulators.fan_fopdt[d].add(fan_row, group);
+      }
+    }
+  }
+}
+
+// Errors of the device's estimator over the samples after the warm-up.
+struct EstimatorErrors {
+  double sum_of_squares = 0.0;
+  double max_error = 0.0;
+  size_t num_samples = 0;
+
+  void merge(const EstimatorErrors& other) {
+    sum_of_squares += other.sum_of_squares;
+    max_error = std::max(max_error, other.max_error);
+    num_samples += other.num_samples;
+  }
+
+  double rms() const {
+    return num_samples > 0 ? sqrt(sum_of_squares / num_samples) : NAN;
+  }
+};
+
+void measure_estimator(const Replay& shot, const PuckModel& model,
+                       uint32_t warm_up, EstimatorErrors& errors) {
+  PuckEstimator estimator;
+  estimator.begin(model);
+  for (size_t i = 0; i < shot.times.size(); ++i) {
+    estimator.update(shot.times[i], to_centidegrees(shot.group[i]));
+    if (shot.times[i] < warm_up || !(shot.basket[i] > -273.0f) ||
+        estimator.temperature() == DISCONNECTED_CENTIDEGREES)
+      continue;
+    double error = fabs(estimator.temperature() * 0.01 - shot.basket[i]);
+    errors.sum_of_squares += error * error;
+    errors.max_error = std::max(errors.max_error, error);
+    ++errors.num_samples;
+  }
+}
+
+// Runs a function on every shot of the archive, with the worker's index, from
+// num_threads worker threads that take shots one at a time.
+template <typename Function>
+void for_each_shot(const Archive& archive, unsigned num_threads,
+                   Function function) {
+  std::atomic<size_t> next_shot(0);
+  std::vector<std::thread> workers;
+  for (unsigned worker = 0; worker < num_threads; ++worker) {
+    workers.emplace_back([&, worker]() {
+      ShotColumns columns;
+      Replay shot;
+      for (size_t i = next_shot++; i < archive.size(); i = next_shot++) {
+        bool valid = archive.shot(i, columns) && replay(columns, shot);
+        function(worker, valid, columns, shot);
+      }
+    });
+  }
+  for (std::thread& worker : workers)
+    worker.join();
+}
+
+// First-order-plus-dead-time model: output = gain * input + offset at steady
+// state, reached with the given time constant after the dead time.
+struct FirstOrderModel {
+  double gain;
+  double offset;
+  double time_constant;
+  double dead_time;
+  double rms_residual;
+  size_t num_rows;
+};
+
+// Picks the dead time whose first-order ARX fit has the smallest residual, and
+// converts it to a FOPDT model. Returns false if no dead time fits a stable
+// first-order response. input_reference is the reference subtracted from the
+// input (zero for the fan state).
+bool fit_first_order(const std::vector<NormalEquations<3>>& equations,
+                     double input_reference, FirstOrderModel& model) {
+  bool found = false;
+  for (size_t d = 0; d < equations.size(); ++d) {
+    double solution[3];
+    if (!equations[d].solve(solution) || !(solution[0] > 0.0) ||
+        !(solution[0] < 1.0))
+      continue;
+    double rms_residual = equations[d].rms_residual(solution);
+    if (found && !(rms_residual < model.rms_residual))
+      continue;
+    found = true;
+    double a = solution[0];
+    model.gain = solution[1] / (1.0 - a);
+    // At steady state, output - R = gain * (input - input_reference) +
+    // c / (1 - a), with R the reference temperature.
+    model.offset = REFERENCE_TEMPERATURE + solution[2] / (1.0 - a) -
+                   model.gain * input_reference;
+    model.time_constant = -1e-3 * PUCK_MODEL_STEP / log(a);
+    model.dead_time = 1e-3 * PUCK_MODEL_STEP * d;
+    model.rms_residual = rms_residual;
+    model.num_rows = equations[d].num_rows;
+  }
+  return found;
+}
+
+void print_first_order(const char* name, const char* input_unit,
+                       const FirstOrderModel& model) {
+  printf("%s FOPDT model (%zu steps): gain %.4g C/%s, offset %+.2fC, time "
+         "constant %.2f s, dead time %.1f s, RMS residual %.3fC\n",
+         name, model.num_rows, model.gain, input_unit, model.offset,
+         model.time_constant, model.dead_time, model.rms_residual);
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 >= argc) {
+      fprintf(stderr, "Missing value for %s\n", argv[i]);
+      return false;
+    }
+    const char* name = argv[i];
+    const char* value = argv[++i];
+    if (strcmp(name, "--path") == 0) {
+      options.path = value;
+    } else if (strcmp(name, "--threads") == 0) {
+      options.num_threads = strtoul(value, nullptr, 10);
+    } else if (strcmp(name, "--warm_up") == 0) {
+      options.warm_up = atof(value);
+    } else if (strcmp(name, "--max_dead_time") == 0) {
+      options.max_dead_time = atof(value);
+    } else {
+      fprintf(stderr, "Unknown option %s\n", name);
+      return false;
+    }
+  }
+  return options.warm_up >= 0.0 && options.max_dead_time >= 0.0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parse_options(argc, argv, options))
+    return 1;
+  if (options.num_threads == 0)
+    options.num_threads = std::max(1u, std::thread::hardware_concurrency());
+  uint32_t warm_up = uint32_t(lround(options.warm_up * 1e3));
+  int max_delay = int(lround(options.max_dead_time * 1e3 / PUCK_MODEL_STEP));
+
+  Archive archive;
+  if (!archive.open(options.path))
+    return 1;
+
+  // Fit the models.
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Accumulators> accumulators(options.num_threads,
+                                         Accumulators(max_delay));
+  for_each_shot(archive, options.num_threads,
+                [&](unsigned worker, bool valid, const ShotColumns& columns,
+                    const Replay& shot) {
+    Accumulators& worker_accumulators = accumulators[worker];
+    if (!valid) {
+      ++worker_accumulators.num_skipped_shots;
+      return;
+    }
+    accumulate(shot, columns.fan, warm_up, worker_accumulators);
+    ++worker_accumulators.num_shots;
+    worker_accumulators.num_fan_shots += columns.fan != nullptr;
+    worker_accumulators.num_samples += columns.num_samples;
+  });
+  Accumulators total(max_delay);
+  for (const Accumulators& worker_accumulators : accumulators)
+    total.merge(worker_accumulators);
+
+  double arx[5];
+  bool has_arx = total.arx.solve(arx);
+  // Back from temperatures relative to the reference: the constant term
+  // absorbs the reference, since basket - R = a1 (basket[k-1] - R) + ... + c'.
+  double arx_c = has_arx ? arx[4] + REFERENCE_TEMPERATURE * (
+      1.0 - arx[0] - arx[1] - arx[2] - arx[3]) : 0.0;
+
+  // Measure the device's estimator with the fitted and current coefficients.
+  std::vector<EstimatorErrors> fitted_errors(options.num_threads);
+  std::vector<EstimatorErrors> current_errors(options.num_threads);
+  if (has_arx) {
+    PuckModel fitted_model(arx[0], arx[1], arx[2], arx[3], arx_c);
+    for_each_shot(archive, options.num_threads,
+                  [&](unsigned worker, bool valid, const ShotColumns& columns,
+                      const Replay& shot) {
+      (void) columns;
+      if (!valid)
+        return;
+      measure_estimator(shot, fitted_model, warm_up, fitted_errors[worker]);
+      measure_estimator(shot, DEFAULT_PUCK_MODEL, warm_up,
+                        current_errors[worker]);
+    });
+  }
+  EstimatorErrors fitted;
+  EstimatorErrors current;
+  for (unsigned worker = 0; worker < options.num_threads; ++worker) {
+    fitted.merge(fitted_errors[worker]);
+    current.merge(current_errors[worker]);
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  printf("Scanned %zu shots (%zu samples) in %.2f s with %u threads",
+         total.num_shots, total.num_samples, elapsed.count(),
+         options.num_threads);
+  if (total.num_skipped_shots > 0)
+    printf(", skipped %zu corrupted or empty shots", total.num_skipped_shots);
+  printf(".\n\n");
+
+  FirstOrderModel model = FirstOrderModel();
+  if (fit_first_order(total.basket_fopdt, REFERENCE_TEMPERATURE, model))
+    print_first_order("Group to basket", "C", model);
+  else
+    printf("Group to basket FOPDT model: no stable fit.\n");
+  if (total.num_fan_shots == 0)
+    printf("Fan to group FOPDT model: no shots record the fan state.\n");
+  else if (fit_first_order(total.fan_fopdt, 0.0, model))
+    print_first_order("Fan to group", "on", model);
+  else
+    printf("Fan to group FOPDT model: no stable fit.\n");
+
+  if (!has_arx) {
+    printf("\nGroup to basket ARX model: not enough data to fit.\n");
+    return 1;
+  }
+  printf("\nGroup to basket ARX model (%zu steps): RMS residual %.3fC\n",
+         total.arx.num_rows, total.arx.rms_residual(arx));
+  printf("  Estimated puck temperature: RMS error %.2fC, max %.2fC "
+         "(current coefficients: RMS error %.2fC, max %.2fC)\n",
+         fitted.rms(), fitted.max_error, current.rms(), current.max_error);
+  printf("\nCoefficients for constants.h:\n\n");
+  printf("#define PUCK_MODEL_A1 %.9g\n", arx[0]);
+  printf("#define PUCK_MODEL_A2 %.9g\n", arx[1]);
+  printf("#define PUCK_MODEL_B0 %.9g\n", arx[2]);
+  printf("#define PUCK_MODEL_B1 %.9g\n", arx[3]);
+  printf("#define PUCK_MODEL_C %.9g\n", arx_c);
+  return 0;
+}
@@ -0,0 +1,28 @@
+/*
+  Low-power idling between scheduler ticks.
+*/
+#include "power.h"
+
+#include <Arduino.h>
+
+#include "timebase.h"
+
+#ifdef __AVR__
+#include <avr/sleep.h>
+#endif
+
+unsigned long idle(unsigned long duration) {
+  if (duration == 0)
+    return 0;
+  Timestamp start_time = monotonic_micros();
+#if defined(__AVR__)
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_enable();
+  sleep_cpu();
+  sleep_disable();
+#elif defined(ARDUINO_ARCH_MBED)
+  // The Mbed core's delay() sleeps the thread rather than spinning.
+  delay(duration);
+#endif
+  return elapsed_micros(start_time, monotonic_micros());
+}
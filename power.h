@@ -0,0 +1,24 @@
+/*
+  Low-power idling between scheduler ticks.
+
+  The main loop used to poll the task scheduler continuously, keeping the MCU
+  at full power (and warming the enclosure next to the grouphead) even though
+  it only has work to do every few milliseconds. Instead, it sleeps whenever no
+  task is due and no bus transaction is queued.
+*/
+#ifndef ESPRESSO_SHOT_POWER_H_
+#define ESPRESSO_SHOT_POWER_H_
+
+// Sleeps for up to `duration` milliseconds, in a sleep mode that keeps millis()
+// and the serial port running, and returns how long it slept (in
+// microseconds).
+//
+// On ATmega-based boards, this is the CPU's idle mode, which any interrupt ends:
+// the millis() timer's wakes the CPU every 1.024 ms, so callers should sleep
+// again until their deadline. On Mbed-based boards, the thread sleeps for the
+// whole duration and the OS idles the CPU. Other boards don't sleep. The
+// switches are polled by the control tick, so they don't need to wake the CPU
+// by themselves.
+unsigned long idle(unsigned long duration);
+
+#endif  // ESPRESSO_SHOT_POWER_H_
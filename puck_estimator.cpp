@@ -0,0 +1,74 @@
+/*
+  Estimation of the puck temperature from the group temperature.
+*/
+#include "puck_estimator.h"
+
+namespace {
+
+// Multiplies a temperature by a coefficient, keeping the temperature's format.
+int64_t multiply(int32_t coefficient, int32_t temperature) {
+  return int64_t(coefficient) * temperature;
+}
+
+}  // namespace
+
+void PuckEstimator::begin(const PuckModel& model) {
+  model_ = model;
+  stepped_ = false;
+  last_step_time_ = 0;
+  puck_[0] = 0;
+  puck_[1] = 0;
+  last_group_temperature_ = DISCONNECTED_CENTIDEGREES;
+  temperature_ = DISCONNECTED_CENTIDEGREES;
+}
+
+void PuckEstimator::update(uint32_t time, int16_t group_temperature) {
+  if (group_temperature == DISCONNECTED_CENTIDEGREES) {
+    last_group_temperature_ = DISCONNECTED_CENTIDEGREES;
+    temperature_ = DISCONNECTED_CENTIDEGREES;
+    return;
+  }
+
+  // Samples between steps are skipped, like in the shot detector.
+  if (stepped_ && last_group_temperature_ != DISCONNECTED_CENTIDEGREES &&
+      uint32_t(time - last_step_time_) < PUCK_MODEL_STEP)
+    return;
+  if (!stepped_ || uint32_t(time - last_step_time_) >= 2 * PUCK_MODEL_STEP)
+    last_step_time_ = time;
+  else
+    last_step_time_ += PUCK_MODEL_STEP;
+  stepped_ = true;
+  step(group_temperature);
+}
+
+void PuckEstimator::step(int16_t group_temperature) {
+  int32_t group = int32_t(group_temperature) << PUCK_STATE_FRACTIONAL_BITS;
+  int32_t puck;
+  if (last_group_temperature_ == DISCONNECTED_CENTIDEGREES) {
+    puck = int32_t(multiply(model_.gain, group) >>
+                   PUCK_MODEL_FRACTIONAL_BITS) + model_.offset;
+    puck_[1] = puck;
+  } else {
+    int32_t last_group = int32_t(last_group_temperature_)
+                         << PUCK_STATE_FRACTIONAL_BITS;
+    puck = int32_t((multiply(model_.a1, puck_[0]) +
+                    multiply(model_.a2, puck_[1]) +
+                    multiply(model_.b0, group) +
+                    multiply(model_.b1, last_group)) >>
+                   PUCK_MODEL_FRACTIONAL_BITS) + model_.c;
+    puck_[1] = puck_[0];
+  }
+
+  // The estimate is kept within the temperatures that the sketch represents, so
+  // that a model that diverges can't wrap around.
+  constexpr int32_t max_puck = int32_t(INT16_MAX) << PUCK_STATE_FRACTIONAL_BITS;
+  constexpr int32_t min_puck = -max_puck;
+  puck = puck > max_puck ? max_puck : puck < min_puck ? min_puck : puck;
+  puck_[0] = puck;
+  last_group_temperature_ = group_temperature;
+
+  constexpr int32_t half = INT32_C(1) << (PUCK_STATE_FRACTIONAL_BITS - 1);
+  int32_t rounded = (puck + half) >> PUCK_STATE_FRACTIONAL_BITS;
+  temperature_ = int16_t(rounded > INT16_MAX ? INT16_MAX :
+                         rounded < -INT16_MAX ? -INT16_MAX : rounded);
+}
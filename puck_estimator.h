@@ -0,0 +1,107 @@
+/*
+  Estimation of the puck temperature from the group temperature.
+
+  The group thermistor sits a few centimeters above the puck, so brewing by
+  group temperature relies on knowing how the puck temperature follows it. That
+  relationship is learned by pulling throwaway shots with the basket thermistor,
+  and captured by a small ARX (autoregressive with exogenous input) model whose
+  coefficients are kept in constants.h like the Steinhart-Hart coefficients:
+
+    puck[k] = a1 puck[k-1] + a2 puck[k-2] + b0 group[k] + b1 group[k-1] + c
+
+  The estimator runs the model on the averaged group temperature, one step every
+  PUCK_MODEL_STEP milliseconds, so that the estimate is the temperature the puck
+  would be brewed at. A step takes four multiply-adds, in integer arithmetic
+  so that boards without a floating point unit don't need floats. Like the shot
+  detector (see shot_detection.h), the estimator has no dependency on the
+  Arduino core so that it can run both on the device and on the host (see
+  host.py for its Python bindings).
+*/
+#ifndef ESPRESSO_SHOT_PUCK_ESTIMATOR_H_
+#define ESPRESSO_SHOT_PUCK_ESTIMATOR_H_
+
+#include <stdint.h>
+
+#include "constants.h"
+#include "shot_detection.h"
+
+// Number of fractional bits of the model's coefficients, and of the estimator's
+// temperatures in hundredths of degrees.
+constexpr int PUCK_MODEL_FRACTIONAL_BITS = 24;
+constexpr int PUCK_STATE_FRACTIONAL_BITS = 8;
+
+// ARX model coefficients (see above), converted from degrees Celsius at compile
+// time. The model's steady state (the puck temperature that a constant group
+// temperature leads to) starts the estimate off.
+struct PuckModel {
+  int32_t a1;
+  int32_t a2;
+  int32_t b0;
+  int32_t b1;
+  // Constant term, in hundredths of degrees with PUCK_STATE_FRACTIONAL_BITS
+  // fractional bits.
+  int32_t c;
+  // Steady-state gain and offset, in the same formats as b0 and c.
+  int32_t gain;
+  int32_t offset;
+
+  constexpr PuckModel(double a1, double a2, double b0, double b1, double c)
+      : a1(to_raw(a1, PUCK_MODEL_FRACTIONAL_BITS)),
+        a2(to_raw(a2, PUCK_MODEL_FRACTIONAL_BITS)),
+        b0(to_raw(b0, PUCK_MODEL_FRACTIONAL_BITS)),
+        b1(to_raw(b1, PUCK_MODEL_FRACTIONAL_BITS)),
+        c(to_raw(100.0 * c, PUCK_STATE_FRACTIONAL_BITS)),
+        gain(to_raw((b0 + b1) / steady_state_divisor(a1, a2),
+                    PUCK_MODEL_FRACTIONAL_BITS)),
+        offset(to_raw(100.0 * c / steady_state_divisor(a1, a2),
+                      PUCK_STATE_FRACTIONAL_BITS)) {}
+
+  // Rounds a constant to a fixed-point number.
+  static constexpr int32_t to_raw(double value, int fractional_bits) {
+    return int32_t(value * (INT32_C(1) << fractional_bits) +
+                   (value < 0.0 ? -0.5 : 0.5));
+  }
+
+  // Models without a steady state (a1 + a2 = 1) start off at the group
+  // temperature.
+  static constexpr double steady_state_divisor(double a1, double a2) {
+    return a1 + a2 == 1.0 ? 1.0 : 1.0 - a1 - a2;
+  }
+};
+
+constexpr PuckModel DEFAULT_PUCK_MODEL(PUCK_MODEL_A1, PUCK_MODEL_A2,
+                                       PUCK_MODEL_B0, PUCK_MODEL_B1,
+                                       PUCK_MODEL_C);
+
+class PuckEstimator {
+ public:
+  // Forgets all samples.
+  void begin(const PuckModel& model = DEFAULT_PUCK_MODEL);
+
+  // Adds a sample of the averaged group temperature, in hundredths of degrees
+  // (DISCONNECTED_CENTIDEGREES for a disconnected thermistor), taken at the
+  // given time in milliseconds. Times may wrap around. The estimate starts over
+  // at the model's steady state once the thermistor is connected again.
+  void update(uint32_t time, int16_t group_temperature);
+
+  // Estimated puck temperature, in hundredths of degrees, or
+  // DISCONNECTED_CENTIDEGREES until the group thermistor has been read.
+  int16_t temperature() const { return temperature_; }
+
+ private:
+  void step(int16_t group_temperature);
+
+  PuckModel model_ = DEFAULT_PUCK_MODEL;
+
+  bool stepped_;
+  uint32_t last_step_time_;
+
+  // Estimates at the last two steps (with PUCK_STATE_FRACTIONAL_BITS fractional
+  // bits), and group temperature at the last step.
+  int32_t puck_[2];
+  int16_t last_group_temperature_;
+
+  int16_t temperature_;
+};
+
+#endif  // ESPRESSO_SHOT_PUCK_ESTIMATOR_H_
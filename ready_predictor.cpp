@@ -0,0 +1,99 @@
+/*
+  Prediction of the time until the controlled temperature is ready.
+*/
+#include "ready_predictor.h"
+
+namespace {
+
+// Scale of the slopes' moving averages, and their weight, as powers of two.
+constexpr int SLOPE_SCALE_SHIFT = 8;
+constexpr int SLOPE_WEIGHT_SHIFT = 3;
+
+}  // namespace
+
+void ReadyPredictor::begin() {
+  stepped_ = false;
+  last_step_time_ = 0;
+  last_temperature_ = DISCONNECTED_CENTIDEGREES;
+  last_fan_on_ = false;
+  fan_changed_ = false;
+  slopes_[0] = 0;
+  slopes_[1] = 0;
+  has_slope_[0] = false;
+  has_slope_[1] = false;
+  ready_ = true;
+  time_to_ready_ = 0;
+}
+
+void ReadyPredictor::update(uint32_t time, int16_t temperature,
+                            int16_t target_temperature, bool fan_on,
+                            uint8_t airflow) {
+  if (temperature == DISCONNECTED_CENTIDEGREES) {
+    stepped_ = false;
+    time_to_ready_ = UNKNOWN_TIME_TO_READY;
+    return;
+  }
+  if (stepped_ && fan_on != last_fan_on_)
+    fan_changed_ = true;
+  last_fan_on_ = fan_on;
+
+  // Samples between steps are skipped, like in the shot detector. After a
+  // gap, the slopes start over from the sample.
+  bool gap = !stepped_ ||
+             uint32_t(time - last_step_time_) >= 2 * READY_STEP;
+  if (!gap && uint32_t(time - last_step_time_) < READY_STEP)
+    return;
+  if (gap) {
+    last_step_time_ = time;
+    last_temperature_ = temperature;
+    fan_changed_ = true;
+  } else {
+    last_step_time_ += READY_STEP;
+  }
+  stepped_ = true;
+  step(temperature, target_temperature, fan_on, airflow);
+}
+
+void ReadyPredictor::step(int16_t temperature, int16_t target_temperature,
+                          bool fan_on, uint8_t airflow) {
+  // With the fan on, the slope is the one without the fan plus the fan's
+  // cooling, in proportion to its airflow. A fan that doesn't turn yet isn't
+  // learned from.
+  int32_t fan_off_slope = has_slope_[0] ? slopes_[0] : 0;
+  if (!fan_changed_ && (!fan_on || airflow > 0)) {
+    int32_t slope = (int32_t(temperature) - last_temperature_)
+                    << SLOPE_SCALE_SHIFT;
+    if (fan_on)
+      slope = (slope - fan_off_slope) * 100 / airflow;
+    if (has_slope_[fan_on]) {
+      slopes_[fan_on] += (slope - slopes_[fan_on]) / (1 << SLOPE_WEIGHT_SHIFT);
+    } else {
+      slopes_[fan_on] = slope;
+      has_slope_[fan_on] = true;
+    }
+  }
+  fan_changed_ = false;
+  last_temperature_ = temperature;
+
+  int32_t error = int32_t(temperature) - target_temperature;
+  int32_t distance = error < 0 ? -error : error;
+  ready_ = distance <= (ready_ ? 2 * READY_BAND : READY_BAND);
+  if (distance <= READY_BAND) {
+    time_to_ready_ = 0;
+    return;
+  }
+
+  // The slope towards the band, in the slopes' scale.
+  int32_t slope = fan_on ? fan_off_slope + slopes_[1] * airflow / 100 :
+                           slopes_[0];
+  int32_t approach = error > 0 ? -slope : slope;
+  if (!has_slope_[fan_on] || approach <= 0) {
+    time_to_ready_ = UNKNOWN_TIME_TO_READY;
+    return;
+  }
+  int32_t scaled_distance = (distance - READY_BAND) << SLOPE_SCALE_SHIFT;
+  int32_t steps = (scaled_distance + approach - 1) / approach;
+  int32_t seconds = int32_t((int64_t(steps) * READY_STEP + 999) / 1000);
+  time_to_ready_ = seconds <= INT16_MAX ? int16_t(seconds) :
+                                          UNKNOWN_TIME_TO_READY;
+}
@@ -0,0 +1,75 @@
+/*
+  Prediction of the time until the controlled temperature is ready, i.e. within
+  READY_BAND of the target temperature.
+
+  The controlled temperature's slope is followed with one moving average per
+  fan state, since the grouphead moves at very different rates with and
+  without the fan: right after the fan turns on or off, the prediction uses the
+  slope that the temperature had the last time the fan was in that state. With
+  the fan on, the average is of the fan's cooling at its nominal airflow (the
+  slope beyond the one without the fan, over the measured airflow), and the
+  slope is predicted at the current airflow, so that a fan that slows down
+  lengthens the countdown right away. The time to ready is the distance to the
+  band over the slope towards it, and is unknown while the temperature doesn't
+  move towards the band.
+
+  The predictor takes one step every READY_STEP milliseconds with the slope
+  over that step, so every sample takes constant time and memory. Like the
+  shot detector (see shot_detection.h), it has no dependency on the Arduino
+  core and works in hundredths of degrees.
+*/
+#ifndef ESPRESSO_SHOT_READY_PREDICTOR_H_
+#define ESPRESSO_SHOT_READY_PREDICTOR_H_
+
+#include <stdint.h>
+
+#include "constants.h"
+#include "shot_detection.h"
+
+// Time to ready while it is unknown.
+constexpr int16_t UNKNOWN_TIME_TO_READY = -1;
+
+class ReadyPredictor {
+ public:
+  // Forgets all samples and slopes.
+  void begin();
+
+  // Adds a sample of the controlled temperature (DISCONNECTED_CENTIDEGREES for
+  // a disconnected thermistor) and of the target temperature, in hundredths of
+  // degrees, whether the fan is on and its airflow (as a percentage of the
+  // nominal airflow, see tachometer.h), taken at the given time in
+  // milliseconds.
+  void update(uint32_t time, int16_t temperature, int16_t target_temperature,
+              bool fan_on, uint8_t airflow);
+
+  // Whether the temperature is ready. It stops being ready once it is more
+  // than twice READY_BAND away from the target, so that the small swings of
+  // the fan control don't toggle it.
+  bool ready() const { return ready_; }
+
+  // Predicted number of seconds until the temperature is ready (zero while it
+  // is), or UNKNOWN_TIME_TO_READY.
+  int16_t time_to_ready() const { return time_to_ready_; }
+
+ private:
+  void step(int16_t temperature, int16_t target_temperature, bool fan_on,
+            uint8_t airflow);
+
+  bool stepped_;
+  uint32_t last_step_time_;
+  int16_t last_temperature_;
+  // Whether the fan changed state since the last step, whose slope then
+  // belongs to neither state.
+  bool last_fan_on_;
+  bool fan_changed_;
+
+  // Slope with the fan off and the fan's cooling at its nominal airflow, as
+  // exponential moving averages (in 256ths of hundredths of degrees per step).
+  int32_t slopes_[2];
+  bool has_slope_[2];
+
+  bool ready_;
+  int16_t time_to_ready_;
+};
+
+#endif  // ESPRESSO_SHOT_READY_PREDICTOR_H_
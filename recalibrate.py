@@ -0,0 +1,131 @@
+"""Script to recompute recorded temperatures after recalibrating thermistors.
+
+Shots record raw thermistor resistances along with the version of the
+calibration that was used to compute their temperatures. After updating the
+Steinhart-Hart coefficients and `CALIBRATION_VERSION` in `constants.h`, this
+script recomputes the temperatures of every shot recorded with another
+calibration version, in the JSON shot files, the archive and its downsampled
+tier (in place) and the catalog. Conversions use the host library's SIMD
+Steinhart-Hart kernel (see `host/steinhart_hart.h`).
+
+Shots recorded without raw resistances cannot be recalibrated and are left
+untouched.
+
+Example usage:
+
+    $ python recalibrate.py
+"""
+import argparse
+import glob
+import json
+
+import numpy as np
+
+import archive
+import catalog
+import host
+import utils
+
+
+def recalibrate_shot(shot_data, version, coefficients):
+  """Recomputes a shot's temperatures in place.
+
+  Args:
+    shot_data: dict in the JSON shot file layout. Its temperature columns can be
+      lists or (writable) numpy arrays.
+    version: int, calibration version of `coefficients`.
+    coefficients: dict mapping 'basket' and 'group' to (sh_a, sh_b, sh_c)
+      tuples of Steinhart-Hart coefficients.
+
+  Returns:
+    bool, whether the shot was recalibrated.
+  """
+  if (shot_data.get('calibration version', 0) == version or
+      'basket_resistance' not in shot_data):
+    return False
+
+  for thermistor, (sh_a, sh_b, sh_c) in coefficients.items():
+    temperatures = host.resistance_to_temperature_batch(
+        shot_data[thermistor + '_resistance'], sh_a, sh_b, sh_c)
+    column = thermistor + '_temperature'
+    if isinstance(shot_data[column], np.ndarray):
+      shot_data[column][:] = temperatures
+    else:
+      shot_data[column] = temperatures.tolist()
+  shot_data['calibration version'] = version
+  return True
+
+
+def recalibrate_files(file_paths, version, coefficients):
+  """Recalibrates JSON shot files.
+
+  Args:
+    file_paths: sequence of str, paths to JSON shot files.
+    version: int, calibration version of `coefficients`.
+    coefficients: dict of Steinhart-Hart coefficients (see `recalibrate_shot`).
+
+  Returns:
+    int, number of recalibrated shots.
+  """
+  num_recalibrated = 0
+  for file_path in file_paths:
+    with open(file_path, 'r') as f:
+      shot_data = json.load(f)
+    if recalibrate_shot(shot_data, version, coefficients):
+      with open(file_path, 'w') as f:
+        json.dump(shot_data, f)
+      num_recalibrated += 1
+  return num_recalibrated
+
+
+def recalibrate_archive(shot_archive, shot_catalog, version, coefficients):
+  """Recalibrates an archive in place and refreshes its catalog summaries.
+
+  Args:
+    shot_archive: archive.Archive, archive opened in 'r+' mode.
+    shot_catalog: catalog.Catalog, catalog opened in 'r+' mode.
+    version: int, calibration version of `coefficients`.
+    coefficients: dict of Steinhart-Hart coefficients (see `recalibrate_shot`).
+
+  Returns:
+    int, number of recalibrated shots.
+  """
+  records = shot_catalog.records
+  num_recalibrated = 0
+  for shot in range(len(shot_archive)):
+    shot_data = shot_archive.shot(shot)
+    if not recalibrate_shot(shot_data, version, coefficients):
+      continue
+    shot_archive.header(shot)['calibration_version'] = version
+    shot_archive.refresh_downsampled(shot)
+    if shot < len(records):
+      records[shot] = catalog.summarize(
+          shot_data, shot, records[shot]['device'].decode('utf-8'))
+    num_recalibrated += 1
+
+  if isinstance(records, np.memmap):
+    records.flush()
+  shot_archive.flush()
+  return num_recalibrated
+
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser(
+      description='Recompute recorded temperatures from raw resistances.')
+  parser.add_argument(
+      '--archive_path', type=str, default=archive.DEFAULT_PATH,
+      help='Path prefix of the archive files.')
+  parser.add_argument(
+      '--catalog_path', type=str, default=catalog.DEFAULT_PATH,
+      help='Path to the catalog file.')
+  args = parser.parse_args()
+
+  version, coefficients = utils.read_calibration()
+  num_files = recalibrate_files(
+      sorted(glob.glob('data/*.json')), version, coefficients)
+  num_shots = recalibrate_archive(
+      archive.Archive(args.archive_path, mode='r+'),
+      catalog.Catalog(args.catalog_path, mode='r+'),
+      version, coefficients)
+  print('Recalibrated {} JSON files and {} archived shots to calibration '
+        'version {}.'.format(num_files, num_shots, version))
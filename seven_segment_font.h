@@ -0,0 +1,195 @@
+/*
+  Pre-rendered seven-segment glyphs for the display's timer and temperature
+  fields, stored as SSD1306 tiles (see draw_glyph in functions.cpp).
+
+  Generated by host/generate_seven_segment_font.py; do not edit by hand.
+*/
+#ifndef ESPRESSO_SHOT_SEVEN_SEGMENT_FONT_H_
+#define ESPRESSO_SHOT_SEVEN_SEGMENT_FONT_H_
+
+#include <Arduino.h>
+
+// Characters with a glyph, in the order of the glyph tables.
+#define SEVEN_SEGMENT_CHARACTERS "0123456789 -.:C"
+
+// Glyph sizes, in tiles of 8x8 pixels. Narrow characters ('.' and ':') only use
+// their glyph's first tile column.
+#define SMALL_GLYPH_WIDTH 1
+#define SMALL_GLYPH_HEIGHT 2
+#define LARGE_GLYPH_WIDTH 2
+#define LARGE_GLYPH_HEIGHT 3
+
+// Glyphs used for temperatures (8x16 pixels).
+const uint8_t SMALL_GLYPHS[][2][8] PROGMEM = {
+    // '0'
+    {
+        {0xFC, 0xFC, 0x06, 0x06, 0x06, 0xFC, 0xFC, 0x00},
+        {0x3F, 0x3F, 0x60, 0x60, 0x60, 0x3F, 0x3F, 0x00},
+    },
+    // '1'
+    {
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0xFC, 0xFC, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x3F, 0x3F, 0x00},
+    },
+    // '2'
+    {
+        {0x00, 0x00, 0x86, 0x86, 0x86, 0xFC, 0xFC, 0x00},
+        {0x3F, 0x3F, 0x61, 0x61, 0x61, 0x00, 0x00, 0x00},
+    },
+    // '3'
+    {
+        {0x00, 0x00, 0x86, 0x86, 0x86, 0xFC, 0xFC, 0x00},
+        {0x00, 0x00, 0x61, 0x61, 0x61, 0x3F, 0x3F, 0x00},
+    },
+    // '4'
+    {
+        {0xFC, 0xFC, 0x80, 0x80, 0x80, 0xFC, 0xFC, 0x00},
+        {0x00, 0x00, 0x01, 0x01, 0x01, 0x3F, 0x3F, 0x00},
+    },
+    // '5'
+    {
+        {0xFC, 0xFC, 0x86, 0x86, 0x86, 0x00, 0x00, 0x00},
+        {0x00, 0x00, 0x61, 0x61, 0x61, 0x3F, 0x3F, 0x00},
+    },
+    // '6'
+    {
+        {0xFC, 0xFC, 0x86, 0x86, 0x86, 0x00, 0x00, 0x00},
+        {0x3F, 0x3F, 0x61, 0x61, 0x61, 0x3F, 0x3F, 0x00},
+    },
+    // '7'
+    {
+        {0x00, 0x00, 0x06, 0x06, 0x06, 0xFC, 0xFC, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x3F, 0x3F, 0x00},
+    },
+    // '8'
+    {
+        {0xFC, 0xFC, 0x86, 0x86, 0x86, 0xFC, 0xFC, 0x00},
+        {0x3F, 0x3F, 0x61, 0x61, 0x61, 0x3F, 0x3F, 0x00},
+    },
+    // '9'
+    {
+        {0xFC, 0xFC, 0x86, 0x86, 0x86, 0xFC, 0xFC, 0x00},
+        {0x00, 0x00, 0x61, 0x61, 0x61, 0x3F, 0x3F, 0x00},
+    },
+    // ' '
+    {
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+    },
+    // '-'
+    {
+        {0x00, 0x00, 0x80, 0x80, 0x80, 0x00, 0x00, 0x00},
+        {0x00, 0x00, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00},
+    },
+    // '.'
+    {
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x00, 0x00, 0x00, 0x60, 0x60, 0x00, 0x00, 0x00},
+    },
+    // ':'
+    {
+        {0x00, 0x00, 0x00, 0x30, 0x30, 0x00, 0x00, 0x00},
+        {0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00, 0x00, 0x00},
+    },
+    // 'C'
+    {
+        {0xFC, 0xFC, 0x06, 0x06, 0x06, 0x00, 0x00, 0x00},
+        {0x3F, 0x3F, 0x60, 0x60, 0x60, 0x00, 0x00, 0x00},
+    },
+};
+
+// Glyphs used for the timer (16x24 pixels).
+const uint8_t LARGE_GLYPHS[][3][16] PROGMEM = {
+    // '0'
+    {
+        {0x00, 0xF0, 0xF0, 0xF0, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0xF0, 0xF0, 0xF0, 0x00},
+        {0x00, 0xC7, 0xC7, 0xC7, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xC7, 0xC7, 0xC7, 0x00},
+        {0x00, 0x1F, 0x1F, 0x1F, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0x1F, 0x1F, 0x1F, 0x00},
+    },
+    // '1'
+    {
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF0, 0xF0, 0xF0, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xC7, 0xC7, 0xC7, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x1F, 0x1F, 0x00},
+    },
+    // '2'
+    {
+        {0x00, 0x00, 0x00, 0x00, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0xF0, 0xF0, 0xF0, 0x00},
+        {0x00, 0xC0, 0xC0, 0xC0, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x07, 0x07, 0x07, 0x00},
+        {0x00, 0x1F, 0x1F, 0x1F, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0x00, 0x00, 0x00, 0x00},
+    },
+    // '3'
+    {
+        {0x00, 0x00, 0x00, 0x00, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0xF0, 0xF0, 0xF0, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0xC7, 0xC7, 0xC7, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0x1F, 0x1F, 0x1F, 0x00},
+    },
+    // '4'
+    {
+        {0x00, 0xF0, 0xF0, 0xF0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF0, 0xF0, 0xF0, 0x00},
+        {0x00, 0x07, 0x07, 0x07, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0xC7, 0xC7, 0xC7, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x1F, 0x1F, 0x00},
+    },
+    // '5'
+    {
+        {0x00, 0xF0, 0xF0, 0xF0, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x00, 0x00, 0x00, 0x00},
+        {0x00, 0x07, 0x07, 0x07, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0xC0, 0xC0, 0xC0, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0x1F, 0x1F, 0x1F, 0x00},
+    },
+    // '6'
+    {
+        {0x00, 0xF0, 0xF0, 0xF0, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x00, 0x00, 0x00, 0x00},
+        {0x00, 0xC7, 0xC7, 0xC7, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0xC0, 0xC0, 0xC0, 0x00},
+        {0x00, 0x1F, 0x1F, 0x1F, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0x1F, 0x1F, 0x1F, 0x00},
+    },
+    // '7'
+    {
+        {0x00, 0x00, 0x00, 0x00, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0xF0, 0xF0, 0xF0, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xC7, 0xC7, 0xC7, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x1F, 0x1F, 0x00},
+    },
+    // '8'
+    {
+        {0x00, 0xF0, 0xF0, 0xF0, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0xF0, 0xF0, 0xF0, 0x00},
+        {0x00, 0xC7, 0xC7, 0xC7, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0xC7, 0xC7, 0xC7, 0x00},
+        {0x00, 0x1F, 0x1F, 0x1F, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0x1F, 0x1F, 0x1F, 0x00},
+    },
+    // '9'
+    {
+        {0x00, 0xF0, 0xF0, 0xF0, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0xF0, 0xF0, 0xF0, 0x00},
+        {0x00, 0x07, 0x07, 0x07, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0xC7, 0xC7, 0xC7, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0x1F, 0x1F, 0x1F, 0x00},
+    },
+    // ' '
+    {
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+    },
+    // '-'
+    {
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x00, 0x00, 0x00, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+    },
+    // '.'
+    {
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x00, 0x00, 0xE0, 0xE0, 0xE0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+    },
+    // ':'
+    {
+        {0x00, 0x00, 0xC0, 0xC0, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x00, 0x00, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x00, 0x00, 0x07, 0x07, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+    },
+    // 'C'
+    {
+        {0x00, 0xF0, 0xF0, 0xF0, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x00, 0x00, 0x00, 0x00},
+        {0x00, 0xC7, 0xC7, 0xC7, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x00, 0x1F, 0x1F, 0x1F, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0x00, 0x00, 0x00, 0x00},
+    },
+};
+
+#endif  // ESPRESSO_SHOT_SEVEN_SEGMENT_FONT_H_
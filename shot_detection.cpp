@@ -0,0 +1,136 @@
+/*
+  Detection of shots from the basket and group temperatures.
+*/
+#include "shot_detection.h"
+
+namespace {
+
+// Weight of the idle group slope's moving average, as a power of two.
+constexpr int IDLE_SLOPE_SHIFT = 4;
+
+int32_t absolute(int32_t value) {
+  return value < 0 ? -value : value;
+}
+
+}  // namespace
+
+void ShotDetector::begin(const ShotDetectionThresholds& thresholds) {
+  thresholds_ = thresholds;
+  next_entry_ = 0;
+  num_entries_ = 0;
+  stepped_ = false;
+  last_step_time_ = 0;
+  idle_group_slope_ = 0;
+  has_idle_group_slope_ = false;
+  in_shot_ = false;
+  onset_ = false;
+  onset_time_ = 0;
+  hold_ = 0;
+  start_time_ = 0;
+  detection_time_ = 0;
+  end_time_ = 0;
+  num_shots_ = 0;
+}
+
+void ShotDetector::update(uint32_t time, int16_t basket_temperature,
+                          int16_t group_temperature) {
+  if (basket_temperature == DISCONNECTED_CENTIDEGREES ||
+      group_temperature == DISCONNECTED_CENTIDEGREES) {
+    if (in_shot_) {
+      in_shot_ = false;
+      end_time_ = time;
+    }
+    num_entries_ = 0;
+    onset_ = false;
+    hold_ = 0;
+    return;
+  }
+
+  // Samples between steps are skipped. After a gap (e.g. a disconnected
+  // thermistor), steps start over from the sample.
+  if (stepped_ && uint32_t(time - last_step_time_) < SHOT_DETECTION_STEP)
+    return;
+  if (!stepped_ || uint32_t(time - last_step_time_) >= 2 * SHOT_DETECTION_STEP)
+    last_step_time_ = time;
+  else
+    last_step_time_ += SHOT_DETECTION_STEP;
+  stepped_ = true;
+  step(time, basket_temperature, group_temperature);
+}
+
+void ShotDetector::step(uint32_t time, int16_t basket_temperature,
+                        int16_t group_temperature) {
+  // The oldest entry is replaced once the window is full, so it's read first.
+  bool full = num_entries_ == SHOT_DETECTION_WINDOW;
+  int32_t basket_slope = int32_t(basket_temperature) -
+                         basket_window_[next_entry_];
+  int32_t group_slope = int32_t(group_temperature) - group_window_[next_entry_];
+  basket_window_[next_entry_] = basket_temperature;
+  group_window_[next_entry_] = group_temperature;
+  next_entry_ = (next_entry_ + 1) % SHOT_DETECTION_WINDOW;
+  if (!full) {
+    ++num_entries_;
+    return;
+  }
+
+  if (!in_shot_) {
+    if (basket_slope >= thresholds_.onset_rise) {
+      if (!onset_) {
+        onset_ = true;
+        onset_time_ = time;
+      }
+    } else {
+      // The idle group slope is only followed while the basket isn't rising,
+      // so that a starting shot doesn't drag it along.
+      onset_ = false;
+      if (has_idle_group_slope_) {
+        idle_group_slope_ += group_slope -
+                             (idle_group_slope_ >> IDLE_SLOPE_SHIFT);
+      } else {
+        idle_group_slope_ = group_slope << IDLE_SLOPE_SHIFT;
+        has_idle_group_slope_ = true;
+      }
+    }
+
+    int32_t group_slope_change = absolute(
+        (group_slope << IDLE_SLOPE_SHIFT) - idle_group_slope_);
+    int32_t min_group_slope_change =
+        int32_t(thresholds_.group_slope_change) << IDLE_SLOPE_SHIFT;
+    bool starting = onset_ && has_idle_group_slope_ &&
+                    basket_slope >= thresholds_.detection_rise &&
+                    group_slope_change >= min_group_slope_change;
+    hold_ = starting ? hold_ + 1 : 0;
+    if (hold_ >= thresholds_.hold_steps) {
+      in_shot_ = true;
+      start_time_ = onset_time_ - thresholds_.lag;
+      detection_time_ = time;
+      ++num_shots_;
+      onset_ = false;
+      hold_ = 0;
+    }
+    return;
+  }
+
+  // During a shot, the onset is when the basket temperature stopped rising,
+  // which is when the shot ends if it then falls.
+  if (basket_slope <= 0) {
+    if (!onset_) {
+      onset_ = true;
+      onset_time_ = time;
+    }
+  } else {
+    onset_ = false;
+  }
+  hold_ = basket_slope <= -thresholds_.end_fall ? hold_ + 1 : 0;
+  if (hold_ >= thresholds_.hold_steps) {
+    in_shot_ = false;
+    end_time_ = onset_time_;
+  } else if (uint32_t(time - start_time_) >= thresholds_.max_duration) {
+    in_shot_ = false;
+    end_time_ = time;
+  }
+  if (!in_shot_) {
+    onset_ = false;
+    hold_ = 0;
+  }
+}
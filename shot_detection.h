@@ -0,0 +1,124 @@
+/*
+  Detection of shots from the basket and group temperatures, as a fallback to
+  the tilt switch.
+
+  When water starts flowing through the puck, the basket temperature rises
+  sharply and the group temperature departs from the slope it had while idle
+  (the water heats or cools the grouphead). The detector follows both slopes
+  over a one-second window of the averaged temperatures, and detects a shot
+  once the basket rises fast enough and the group slope has changed, for a few
+  steps in a row. The shot ends once the basket temperature falls.
+
+  The detector only sees a shot after its temperatures have moved, and the
+  temperatures it's given are averages (see update_resistances), so detected
+  shots are back-dated: their start is when the basket first started rising,
+  less the averaging lag.
+
+  The detector takes one sample at a time in constant time and memory, and
+  only keeps one entry per step (SHOT_DETECTION_STEP milliseconds) of the
+  window. It has no dependency on the Arduino core so that it can run both on
+  the device and on the host (see host.py for its Python bindings, and
+  shot_detection.py for its offline evaluation).
+*/
+#ifndef ESPRESSO_SHOT_SHOT_DETECTION_H_
+#define ESPRESSO_SHOT_SHOT_DETECTION_H_
+
+#include <stdint.h>
+
+#include "constants.h"
+
+// Temperature of a disconnected thermistor, in hundredths of degrees.
+constexpr int16_t DISCONNECTED_CENTIDEGREES = INT16_MIN;
+
+// Slopes are the differences between the newest and oldest temperatures of the
+// window, so they are in hundredths of degrees per second.
+static_assert(SHOT_DETECTION_STEP * SHOT_DETECTION_WINDOW == 1000,
+              "the shot detection window must span one second");
+
+// Thresholds of the detector. Slopes are in hundredths of degrees per second
+// and times in milliseconds.
+struct ShotDetectionThresholds {
+  // Basket temperature rise at which a shot may be starting (which dates the
+  // shot's start), and at which it is detected.
+  int16_t onset_rise;
+  int16_t detection_rise;
+  // Change of the group temperature's slope from its idle slope at which a
+  // shot is detected.
+  int16_t group_slope_change;
+  // Basket temperature fall that ends a shot.
+  int16_t end_fall;
+  // Number of steps in a row over which a shot's start or end must be seen.
+  uint8_t hold_steps;
+  // Averaging lag subtracted from the start of detected shots.
+  uint16_t lag;
+  // Shots longer than this end regardless of the temperatures.
+  uint32_t max_duration;
+};
+
+constexpr ShotDetectionThresholds DEFAULT_SHOT_DETECTION_THRESHOLDS = {
+    SHOT_DETECTION_ONSET_RISE, SHOT_DETECTION_RISE,
+    SHOT_DETECTION_GROUP_SLOPE_CHANGE, SHOT_DETECTION_END_FALL,
+    SHOT_DETECTION_HOLD_STEPS, SHOT_DETECTION_LAG,
+    SHOT_DETECTION_MAX_DURATION};
+
+class ShotDetector {
+ public:
+  // Forgets all samples and any shot in progress.
+  void begin(const ShotDetectionThresholds& thresholds =
+                 DEFAULT_SHOT_DETECTION_THRESHOLDS);
+
+  // Adds a sample of the averaged basket and group temperatures, in hundredths
+  // of degrees (DISCONNECTED_CENTIDEGREES for a disconnected thermistor), taken
+  // at the given time in milliseconds. Times may wrap around. Shots can't be
+  // detected without the basket thermistor, and a shot in progress ends when
+  // it is disconnected.
+  void update(uint32_t time, int16_t basket_temperature,
+              int16_t group_temperature);
+
+  // Whether a shot is in progress.
+  bool in_shot() const { return in_shot_; }
+
+  // Back-dated start of the shot in progress or of the last shot, when the
+  // shot was detected, and when the last shot ended.
+  uint32_t start_time() const { return start_time_; }
+  uint32_t detection_time() const { return detection_time_; }
+  uint32_t end_time() const { return end_time_; }
+
+  // Number of shots detected since begin().
+  uint16_t num_shots() const { return num_shots_; }
+
+ private:
+  void step(uint32_t time, int16_t basket_temperature,
+            int16_t group_temperature);
+
+  ShotDetectionThresholds thresholds_;
+
+  // Temperatures at the last SHOT_DETECTION_WINDOW steps, as a circular buffer
+  // whose next entry is the oldest once it's full.
+  int16_t basket_window_[SHOT_DETECTION_WINDOW];
+  int16_t group_window_[SHOT_DETECTION_WINDOW];
+  uint8_t next_entry_;
+  uint8_t num_entries_;
+  bool stepped_;
+  uint32_t last_step_time_;
+
+  // Group temperature slope while idle, as an exponential moving average (in
+  // sixteenths of hundredths of degrees per second).
+  int32_t idle_group_slope_;
+  bool has_idle_group_slope_;
+
+  bool in_shot_;
+  // Whether the basket started rising (or, during a shot, stopped rising), and
+  // since when.
+  bool onset_;
+  uint32_t onset_time_;
+  // Number of steps in a row over which a shot's start or end was seen.
+  uint8_t hold_;
+
+  uint32_t start_time_;
+  uint32_t detection_time_;
+  uint32_t end_time_;
+  uint16_t num_shots_;
+};
+
+#endif  // ESPRESSO_SHOT_SHOT_DETECTION_H_
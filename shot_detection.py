@@ -0,0 +1,245 @@
+"""Offline evaluation of the sketch's shot detector against the shot archive.
+
+The device detects shots from the basket and group temperatures when the tilt
+switch misses them (see the sketch's shot_detection.h). This script replays
+archived shots through the same detector (through the host library, see
+host.py) and reports how well it finds them: its recall (the share of shots it
+detects), its precision (the share of its detections that are shots), and how
+far its back-dated starts are from the lever's and how long it takes to detect
+a shot.
+
+Archived shots only hold the samples taken while the lever was up, so every
+shot is replayed on its own, preceded and followed by `--padding` seconds of
+idle samples that repeat the shot's first and last readings. Samples are
+averaged like on the device before being given to the detector. Shot ends
+can't be evaluated, since the archive holds nothing after the lever goes down.
+
+The detector's thresholds default to the sketch's (`SHOT_DETECTION_*` in
+constants.h) and can be overridden to try others before changing them.
+
+Example usage:
+
+    $ python shot_detection.py evaluate
+    $ python shot_detection.py evaluate --onset_rise 20 --lag 500
+"""
+import argparse
+import datetime
+
+import numpy as np
+
+import archive
+import host
+import utils
+
+# Fields of the sketch's `ShotDetectionThresholds`, in order, and the constants
+# that hold their defaults.
+THRESHOLDS = (
+    ('onset_rise', 'SHOT_DETECTION_ONSET_RISE'),
+    ('detection_rise', 'SHOT_DETECTION_RISE'),
+    ('group_slope_change', 'SHOT_DETECTION_GROUP_SLOPE_CHANGE'),
+    ('end_fall', 'SHOT_DETECTION_END_FALL'),
+    ('hold_steps', 'SHOT_DETECTION_HOLD_STEPS'),
+    ('lag', 'SHOT_DETECTION_LAG'),
+    ('max_duration', 'SHOT_DETECTION_MAX_DURATION'),
+)
+
+# Temperature of a disconnected thermistor, in hundredths of degrees.
+DISCONNECTED_CENTIDEGREES = -32768
+
+
+def default_thresholds(constants=None):
+  """Returns the sketch's detector thresholds as a dict."""
+  if constants is None:
+    constants = utils.read_constants()
+  return {name: constants[constant] for name, constant in THRESHOLDS}
+
+
+def to_centidegrees(temperatures):
+  """Converts temperatures like the sketch's `to_centidegrees`."""
+  temperatures = np.asarray(temperatures, dtype=np.float64)
+  connected = temperatures > -273.0
+  centidegrees = np.round(np.where(connected, temperatures, 0.0) * 100.0)
+  return np.where(connected, np.minimum(centidegrees, 32767),
+                  DISCONNECTED_CENTIDEGREES).astype(np.int16)
+
+
+def running_mean(values, window):
+  """Averages every value with the `window - 1` values before it, like the
+  device's resistance buffers (which are filled with the first value at boot).
+  Averages that include an infinite value are infinite."""
+  values = np.asarray(values, dtype=np.float64)
+  padded = np.concatenate([np.full(window - 1, values[0]), values])
+  infinite = np.isinf(padded)
+  sums = np.cumsum(np.concatenate([[0.0], np.where(infinite, 0.0, padded)]))
+  num_infinite = np.cumsum(np.concatenate([[0], infinite]))
+  means = (sums[window:] - sums[:-window]) / window
+  means[num_infinite[window:] > num_infinite[:-window]] = np.inf
+  return means
+
+
+def replay(shot_data, constants, coefficients, padding):
+  """Builds the detector's input stream for an archived shot.
+
+  Args:
+    shot_data: dict, archived shot.
+    constants: dict, the sketch's constants (see `utils.read_constants`).
+    coefficients: dict mapping 'basket' and 'group' to Steinhart-Hart
+      coefficients.
+    padding: float, seconds of idle samples before and after the shot.
+
+  Returns:
+    tuple (times, basket, group, shot_start, shot_end) of the sample times (in
+    milliseconds), the averaged temperatures (in hundredths of degrees), and the
+    times the lever went up and down.
+  """
+  period = 1000 // constants['SENSING_FREQUENCY']
+  num_padding = int(round(padding * 1000 / period))
+  shot_times = np.asarray(shot_data['time'], dtype=np.float64) * 1000.0
+  shot_start = num_padding * period
+  shot_end = shot_start + int(round(shot_times[-1] - shot_times[0]))
+  times = np.concatenate([
+      np.arange(num_padding) * period,
+      shot_start + np.round(shot_times - shot_times[0]),
+      shot_end + (np.arange(num_padding) + 1) * period,
+  ]).astype(np.uint32)
+
+  temperatures = {}
+  for thermistor in ('basket', 'group'):
+    # Shots recorded before resistances were kept are averaged in temperature.
+    if thermistor + '_resistance' in shot_data:
+      values = np.asarray(shot_data[thermistor + '_resistance'])
+    else:
+      values = np.asarray(shot_data[thermistor + '_temperature'])
+    values = np.concatenate([np.full(num_padding, values[0]), values,
+                             np.full(num_padding, values[-1])])
+    averages = running_mean(values, constants['BUFFER_SIZE'])
+    if thermistor + '_resistance' in shot_data:
+      with np.errstate(divide='ignore', invalid='ignore'):
+        averages = utils.resistance_to_temperature(
+            averages, *coefficients[thermistor])
+      averages = np.where(np.isfinite(averages), averages, -273.15)
+    temperatures[thermistor] = to_centidegrees(averages)
+  return (times, temperatures['basket'], temperatures['group'], shot_start,
+          shot_end)
+
+
+def evaluate(shot_archive, thresholds, padding=10.0, tolerance=2.0):
+  """Replays archived shots through the detector.
+
+  Args:
+    shot_archive: `archive.Archive`, shots to replay.
+    thresholds: dict, detector thresholds (see `default_thresholds`).
+    padding: float, seconds of idle samples before and after every shot.
+    tolerance: float, seconds before the lever went up in which a detected
+      start still counts as the shot's.
+
+  Returns:
+    dict with the number of shots and detections, the recall and precision
+    (None without shots or detections), the start errors and detection delays
+    of detected shots (in milliseconds, as numpy arrays), and the indices of
+    missed shots and of shots with spurious detections.
+  """
+  constants = utils.read_constants()
+  _, coefficients = utils.read_calibration()
+  threshold_values = [thresholds[name] for name, _ in THRESHOLDS]
+  num_shots = 0
+  num_detections = 0
+  num_true_detections = 0
+  start_errors = []
+  detection_delays = []
+  missed = []
+  spurious = []
+  for i in range(len(shot_archive)):
+    shot_data = shot_archive.shot(i)
+    if len(shot_data.get('time', ())) == 0:
+      continue
+    num_shots += 1
+    times, basket, group, shot_start, shot_end = replay(
+        shot_data, constants, coefficients, padding)
+    detections = host.detect_shots(times, basket, group, threshold_values)
+    num_detections += len(detections)
+
+    # A shot is found by the first detection that starts while the lever is
+    # up (or shortly before), and every other detection is spurious.
+    starts = detections[:, 0].astype(np.int64)
+    found = np.flatnonzero((starts >= shot_start - tolerance * 1000) &
+                           (starts <= shot_end))
+    if found.size:
+      num_true_detections += 1
+      start, detection_time, _ = detections[found[0]].astype(np.int64)
+      start_errors.append(start - shot_start)
+      detection_delays.append(detection_time - shot_start)
+    else:
+      missed.append(i)
+    if len(detections) > min(found.size, 1):
+      spurious.append(i)
+
+  return {
+      'num_shots': num_shots,
+      'num_detections': num_detections,
+      'recall': num_true_detections / num_shots if num_shots else None,
+      'precision': (num_true_detections / num_detections
+                    if num_detections else None),
+      'start_errors': np.array(start_errors),
+      'detection_delays': np.array(detection_delays),
+      'missed': missed,
+      'spurious': spurious,
+  }
+
+
+def print_evaluation(evaluation, shot_archive):
+  """Prints the evaluation returned by `evaluate`."""
+  print('{num_shots} shots, {num_detections} detections'.format(**evaluation))
+  if evaluation['recall'] is not None:
+    print('  Recall: {:.1%}'.format(evaluation['recall']))
+  if evaluation['precision'] is not None:
+    print('  Precision: {:.1%}'.format(evaluation['precision']))
+  start_errors = evaluation['start_errors']
+  if start_errors.size:
+    print('  Start error: {:+.0f} ms on average, {:.0f} ms median absolute, '
+          '{:.0f} ms 90th percentile absolute'.format(
+              start_errors.mean(), np.median(np.abs(start_errors)),
+              np.percentile(np.abs(start_errors), 90)))
+    delays = evaluation['detection_delays']
+    print('  Detected after {:.0f} ms median, {:.0f} ms 90th percentile, '
+          '{:.0f} ms at most'.format(np.median(delays),
+                                     np.percentile(delays, 90), delays.max()))
+  for label, key in (('Missed', 'missed'), ('Spurious detections in',
+                                            'spurious')):
+    for i in evaluation[key]:
+      posix_time = float(shot_archive.index[i]['posix_time'])
+      print('  {} shot {} ({})'.format(
+          label, i, datetime.datetime.fromtimestamp(posix_time).isoformat(
+              ' ', timespec='seconds')))
+
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser(
+      description='Evaluate the shot detector against the shot archive.')
+  parser.add_argument(
+      '--path', type=str, default=archive.DEFAULT_PATH,
+      help='Path prefix of the archive files.')
+  subparsers = parser.add_subparsers(dest='command', required=True)
+  evaluate_parser = subparsers.add_parser(
+      'evaluate', help='Replay the archived shots through the detector.')
+  evaluate_parser.add_argument(
+      '--padding', type=float, default=10.0,
+      help='Seconds of idle samples before and after every shot.')
+  evaluate_parser.add_argument(
+      '--tolerance', type=float, default=2.0,
+      help='Seconds before the lever went up in which a detected start still '
+           'counts as the shot\'s.')
+  for name, constant in THRESHOLDS:
+    evaluate_parser.add_argument(
+        '--' + name, type=int, default=None,
+        help='Overrides {} (see constants.h).'.format(constant))
+  args = parser.parse_args()
+
+  if args.command == 'evaluate':
+    thresholds = default_thresholds()
+    thresholds.update({name: getattr(args, name) for name, _ in THRESHOLDS
+                       if getattr(args, name) is not None})
+    shot_archive = archive.Archive(args.path)
+    print_evaluation(
+        evaluate(shot_archive, thresholds, args.padding, args.tolerance),
+        shot_archive)
@@ -0,0 +1,98 @@
+/*
+  Non-volatile storage of the shot history (see history.h).
+*/
+#include "storage.h"
+
+#include <Arduino.h>
+
+#include "constants.h"
+
+#if defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_HOST)
+
+#include <EEPROM.h>
+
+void begin_storage() {}
+
+uint16_t storage_size() { return EEPROM.length(); }
+
+// The EEPROM is written a byte at a time, so it is a single sector.
+uint16_t storage_sector_size() { return EEPROM.length(); }
+
+void read_storage(uint16_t address, void* data, uint16_t size) {
+  uint8_t* bytes = static_cast<uint8_t*>(data);
+  for (uint16_t i = 0; i < size; ++i)
+    bytes[i] = EEPROM.read(address + i);
+}
+
+uint16_t write_storage(uint16_t address, const void* data, uint16_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  // Unchanged bytes are skipped, which also spares the EEPROM's write cycles.
+  for (uint16_t i = 0; i < size; ++i) {
+    if (EEPROM.read(address + i) != bytes[i]) {
+      EEPROM.write(address + i, bytes[i]);
+      return i + 1;
+    }
+  }
+  return size;
+}
+
+#elif defined(ARDUINO_ARCH_MBED)
+
+#include <FlashIAP.h>
+
+namespace {
+
+mbed::FlashIAP flash;
+// Flash address of the storage, at the end of the flash memory, far from the
+// sketch.
+uint32_t storage_start = 0;
+
+}  // namespace
+
+void begin_storage() {
+  flash.init();
+  storage_start = flash.get_flash_start() + flash.get_flash_size() -
+                  HISTORY_FLASH_SIZE;
+}
+
+uint16_t storage_size() { return HISTORY_FLASH_SIZE; }
+
+uint16_t storage_sector_size() {
+  return flash.get_sector_size(storage_start);
+}
+
+void read_storage(uint16_t address, void* data, uint16_t size) {
+  flash.read(data, storage_start + address, size);
+}
+
+uint16_t write_storage(uint16_t address, const void* data, uint16_t size) {
+  if (address % storage_sector_size() == 0)
+    flash.erase(storage_start + address, storage_sector_size());
+  flash.program(data, storage_start + address, size);
+  return size;
+}
+
+#else
+
+namespace {
+
+uint8_t storage[HISTORY_RAM_SIZE];
+
+}  // namespace
+
+void begin_storage() { memset(storage, 0xFF, sizeof(storage)); }
+
+uint16_t storage_size() { return sizeof(storage); }
+
+uint16_t storage_sector_size() { return sizeof(storage); }
+
+void read_storage(uint16_t address, void* data, uint16_t size) {
+  memcpy(data, storage + address, size);
+}
+
+uint16_t write_storage(uint16_t address, const void* data, uint16_t size) {
+  memcpy(storage + address, data, size);
+  return size;
+}
+
+#endif
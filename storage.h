@@ -0,0 +1,35 @@
+/*
+  Non-volatile storage of the shot history (see history.h).
+
+  ATmega-based boards keep the history in their EEPROM. Mbed-based boards
+  (e.g. the Nano 33 BLE) have none, and keep it in the last sectors of their
+  flash memory instead. Other boards keep it in RAM, which doesn't survive
+  resets.
+
+  Storage is divided into sectors, which records never straddle. Flash memory
+  can only be rewritten after its whole sector is erased, so writes that start
+  at the beginning of a sector erase it first (which takes tens of
+  milliseconds). Erased storage reads as 0xFF bytes.
+*/
+#ifndef ESPRESSO_SHOT_STORAGE_H_
+#define ESPRESSO_SHOT_STORAGE_H_
+
+#include <stdint.h>
+
+// Prepares the storage for use.
+void begin_storage();
+
+// Size of the storage and of its sectors, in bytes.
+uint16_t storage_size();
+uint16_t storage_sector_size();
+
+// Reads `size` bytes at `address`.
+void read_storage(uint16_t address, void* data, uint16_t size);
+
+// Writes the beginning of `size` bytes at `address`, and returns how many bytes
+// were written. Writing an EEPROM byte takes about 3.3 ms, so EEPROM writes
+// stop after the first byte that changed rather than block; other storage is
+// written at once.
+uint16_t write_storage(uint16_t address, const void* data, uint16_t size);
+
+#endif  // ESPRESSO_SHOT_STORAGE_H_
@@ -0,0 +1,94 @@
+/*
+  Fan speed measurement from the fan's tachometer output, and stall detection.
+*/
+#include "tachometer.h"
+
+#include <Arduino.h>
+
+namespace {
+
+constexpr uint32_t MICROS_PER_MINUTE = 60000000UL;
+
+// Longest interval between edges at the stall speed. Edges older than that
+// are forgotten, so that a fan that starts again isn't averaged with the
+// edges from before it stopped.
+constexpr uint32_t STALL_INTERVAL =
+    MICROS_PER_MINUTE /
+    (uint32_t(TACHOMETER_PULSES_PER_REVOLUTION) * TACHOMETER_STALL_RPM);
+
+}  // namespace
+
+void Tachometer::begin() {
+  for (uint8_t i = 0; i < TACHOMETER_RING_SIZE; ++i)
+    edges_[i] = 0;
+  head_ = 0;
+  num_edges_ = 0;
+  rpm_ = 0;
+  fan_on_ = false;
+  fan_on_time_ = 0;
+  spun_up_ = false;
+  stalled_ = false;
+  num_stalls_ = 0;
+}
+
+void Tachometer::update(uint32_t time, bool fan_on) {
+  // The newest and oldest edges are read with interrupts disabled, so that
+  // the interrupt handler doesn't write them halfway through.
+  noInterrupts();
+  uint8_t num_edges = num_edges_;
+  uint8_t head = head_;
+  if (num_edges > TACHOMETER_RING_SIZE - 1)
+    num_edges = TACHOMETER_RING_SIZE - 1;
+  uint32_t newest = edges_[uint8_t(head - 1) & (TACHOMETER_RING_SIZE - 1)];
+  uint32_t oldest =
+      edges_[uint8_t(head - num_edges) & (TACHOMETER_RING_SIZE - 1)];
+  interrupts();
+
+  uint32_t rpm = 0;
+  if (num_edges > 0) {
+    // Edges may be recorded after the time was read.
+    uint32_t since = int32_t(time - newest) > 0 ? time - newest : 0;
+    if (since > STALL_INTERVAL) {
+      // The edges are forgotten, unless one was recorded since they were read.
+      noInterrupts();
+      if (head_ == head)
+        num_edges_ = 0;
+      interrupts();
+    } else if (num_edges > 1) {
+      uint32_t intervals = num_edges - 1;
+      uint32_t span = newest - oldest;
+      // The interval in progress is at least as long as the time since the
+      // newest edge.
+      if (since > span / intervals) {
+        intervals = 1;
+        span = since;
+      }
+      if (span > 0) {
+        rpm = intervals * MICROS_PER_MINUTE /
+              (uint32_t(TACHOMETER_PULSES_PER_REVOLUTION) * span);
+      }
+    }
+  }
+  rpm_ = uint16_t(rpm < UINT16_MAX ? rpm : UINT16_MAX);
+
+  if (fan_on && !fan_on_) {
+    fan_on_time_ = time;
+    spun_up_ = false;
+  }
+  fan_on_ = fan_on;
+  if (fan_on && !spun_up_ &&
+      time - fan_on_time_ >= TACHOMETER_SPIN_UP * 1000UL)
+    spun_up_ = true;
+
+  if (rpm_ >= TACHOMETER_STALL_RPM) {
+    stalled_ = false;
+  } else if (fan_on && spun_up_ && !stalled_) {
+    stalled_ = true;
+    ++num_stalls_;
+  }
+}
+
+uint8_t Tachometer::airflow() const {
+  uint32_t airflow = uint32_t(rpm_) * 100 / TACHOMETER_NOMINAL_RPM;
+  return uint8_t(airflow < UINT8_MAX ? airflow : UINT8_MAX);
+}
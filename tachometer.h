@@ -0,0 +1,104 @@
+/*
+  Fan speed measurement from the fan's tachometer output, and stall detection.
+
+  The tachometer output pulses TACHOMETER_PULSES_PER_REVOLUTION times per
+  revolution. The pin's interrupt handler only records the time of every edge
+  in a ring of TACHOMETER_RING_SIZE timestamps, and the control tick derives
+  the speed from the ring: the number of intervals between the recorded edges
+  over the time they span. The time since the latest edge bounds the speed
+  from above, so that a fan that stops reads as stopped without waiting for
+  another edge.
+
+  The fan is stalled when it has been switched on for TACHOMETER_SPIN_UP
+  milliseconds and still turns slower than TACHOMETER_STALL_RPM, and stays
+  stalled (even once switched off) until it turns faster than that again.
+
+  The sketch attaches the interrupt and passes micros() to record_edge. The
+  interrupt handler owns the ring, which the control tick only reads and
+  clears with interrupts disabled, since 32-bit timestamps don't read
+  atomically on 8-bit boards.
+*/
+#ifndef ESPRESSO_SHOT_TACHOMETER_H_
+#define ESPRESSO_SHOT_TACHOMETER_H_
+
+#include <stdint.h>
+
+#include "constants.h"
+
+// Number of edge timestamps kept, a power of two. Speeds are averaged over up
+// to one less interval than that.
+constexpr uint8_t TACHOMETER_RING_SIZE = 16;
+
+class Tachometer {
+ public:
+  // Forgets all edges, and the stalls.
+  void begin();
+
+  // Records an edge of the tachometer output at the given time in
+  // microseconds. Called from the pin's interrupt handler.
+  void record_edge(uint32_t time) {
+    edges_[head_ & (TACHOMETER_RING_SIZE - 1)] = time;
+    head_ = head_ + 1;
+    if (num_edges_ < TACHOMETER_RING_SIZE)
+      num_edges_ = num_edges_ + 1;
+  }
+
+  // Measures the speed at the given time in microseconds (the low 32 bits of
+  // monotonic_micros(), which are micros()), and updates the stall state given
+  // whether the fan is switched on.
+  void update(uint32_t time, bool fan_on);
+
+  // Measured speed, in revolutions per minute.
+  uint16_t rpm() const { return rpm_; }
+
+  // Measured airflow, as a percentage of the airflow at TACHOMETER_NOMINAL_RPM
+  // (to which airflow is proportional), saturated at 255%.
+  uint8_t airflow() const;
+
+  bool stalled() const { return stalled_; }
+
+  // Number of times the fan stalled since begin().
+  uint16_t num_stalls() const { return num_stalls_; }
+
+ private:
+  // Written by the interrupt handler. The head only grows (wrapping around at
+  // 256, a multiple of the ring size).
+  volatile uint32_t edges_[TACHOMETER_RING_SIZE];
+  volatile uint8_t head_;
+  volatile uint8_t num_edges_;
+
+  uint16_t rpm_;
+  // Whether the fan is switched on, when it was, and whether it has been on for
+  // TACHOMETER_SPIN_UP since.
+  bool fan_on_;
+  uint32_t fan_on_time_;
+  bool spun_up_;
+  bool stalled_;
+  uint16_t num_stalls_;
+};
+
+// Stands in for the tachometer of a fan without one: the fan never stalls, and
+// its airflow is nominal.
+class NoTachometer {
+ public:
+  void begin() {}
+  void record_edge(uint32_t) {}
+  void update(uint32_t, bool) {}
+  uint16_t rpm() const { return 0; }
+  uint8_t airflow() const { return 100; }
+  bool stalled() const { return false; }
+  uint16_t num_stalls() const { return 0; }
+};
+
+// Tachometer type of a fan, given whether its tachometer output is wired.
+template <bool HAS_TACHOMETER>
+struct TachometerType {
+  typedef Tachometer type;
+};
+
+template <>
+struct TachometerType<false> {
+  typedef NoTachometer type;
+};
+
+#endif  // ESPRESSO_SHOT_TACHOMETER_H_
@@ -0,0 +1,36 @@
+/*
+  Monotonic 64-bit microsecond clock shared by every part of the sketch.
+*/
+#include "timebase.h"
+
+namespace {
+
+// Latest reading of micros(), and how many times micros() wrapped around
+// before it.
+uint32_t last_micros = 0;
+uint32_t num_wraparounds = 0;
+
+// Milliseconds since the device started, and the microseconds elapsed since
+// the latest millisecond.
+uint32_t uptime = 0;
+uint32_t uptime_micros = 0;
+
+}  // namespace
+
+Timestamp monotonic_micros() {
+  uint32_t current_micros = micros();
+  if (current_micros < last_micros)
+    ++num_wraparounds;
+  uptime_micros += current_micros - last_micros;
+  if (uptime_micros >= 1000) {
+    uptime += uptime_micros / 1000;
+    uptime_micros %= 1000;
+  }
+  last_micros = current_micros;
+  return (Timestamp(num_wraparounds) << 32) | current_micros;
+}
+
+uint32_t uptime_millis() {
+  monotonic_micros();
+  return uptime;
+}
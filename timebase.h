@@ -0,0 +1,53 @@
+/*
+  Monotonic 64-bit microsecond clock shared by every part of the sketch.
+
+  millis() and micros() are 32-bit and wrap around (after 49.7 days and 71.6
+  minutes respectively), so comparing timestamps taken from them, or adding a
+  duration to one, goes wrong on a machine that is never power-cycled. The
+  clock extends micros() to 64 bits by counting its wraparounds, which makes
+  timestamps strictly comparable for as long as the device runs.
+*/
+#ifndef ESPRESSO_SHOT_TIMEBASE_H_
+#define ESPRESSO_SHOT_TIMEBASE_H_
+
+#include <Arduino.h>
+
+// Microseconds since the device started.
+typedef uint64_t Timestamp;
+
+// Returns the current time. The clock only notices micros()' wraparounds when
+// it is read, so it must be read at least once every 71 minutes (the control
+// tick reads it every 10 ms). It isn't safe to read from interrupt handlers.
+Timestamp monotonic_micros();
+
+// Milliseconds since the device started, wrapping around at 32 bits like
+// millis(). Reads the clock, and is kept by it in 32 bits, so that it stays
+// cheap on 8-bit boards for as long as the device runs (unlike
+// elapsed_millis(0, monotonic_micros()), which takes a 64-bit division after
+// 71 minutes).
+uint32_t uptime_millis();
+
+// Microseconds elapsed between two timestamps.
+inline uint64_t elapsed_micros(Timestamp since, Timestamp until) {
+  return until - since;
+}
+
+// Milliseconds elapsed between two timestamps. Intervals shorter than 71
+// minutes, which are most of them, take a 32-bit division rather than a much
+// slower 64-bit one on 8-bit boards.
+inline uint64_t elapsed_millis(Timestamp since, Timestamp until) {
+  uint64_t elapsed = until - since;
+  return elapsed >> 32 ? elapsed / 1000 : uint32_t(elapsed) / UINT32_C(1000);
+}
+
+// Whether at least `duration` microseconds elapsed between two timestamps.
+inline bool has_elapsed(Timestamp since, Timestamp until, uint64_t duration) {
+  return until - since >= duration;
+}
+
+// Converts a duration in milliseconds to microseconds, e.g. for has_elapsed.
+constexpr uint64_t millis_to_micros(uint64_t duration) {
+  return duration * 1000;
+}
+
+#endif  // ESPRESSO_SHOT_TIMEBASE_H_
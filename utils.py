@@ -1,6 +1,10 @@
 """Utility functions."""
+import collections
 import enum
 import json
+import math
+import os
+import re
 import struct
 import subprocess
 import time
@@ -10,8 +14,93 @@ import numpy as np
 # Measurements contain 5 floats (elapsed_time, basket_resistance,
 # group_resistance, basket_temperature, and group_temperature) and an int
 # (state, for which 0, 1, 2, and 3 map to START, RUNNING, STOP, and STOPPED,
-# respectively).
+# respectively). The state's `FAN_ON_FLAG` bit is set while the fan is
+# switched on (see `MEASUREMENT_FAN_ON` in the sketch's data_structures.h).
 FORMAT_STRING = 'fffffi'
+FAN_ON_FLAG = 0x100
+
+# Every few seconds, the device also sends a diagnostics frame of the same size
+# (see `Diagnostics` in the sketch's data_structures.h), whose last field holds
+# `DIAGNOSTICS_MARKER` where measurements hold their state.
+DIAGNOSTICS_FORMAT_STRING = '<IHHHHHHBBHi'
+DIAGNOSTICS_MARKER = 0x47414944
+
+Diagnostics = collections.namedtuple('Diagnostics', [
+    'uptime', 'ram_size', 'static_ram', 'heap_used', 'free_ram',
+    'max_stack_used', 'min_free_ram', 'reset_flags', 'buffer_entry_size',
+    'buffer_size'])
+
+# Bus usage frames (see `BusUsageFrame` in the sketch's data_structures.h) are
+# sent along with diagnostics frames, with `BUS_USAGE_MARKER` as their last
+# field. Times are in microseconds since the previous bus usage frame, and the
+# bus clock is in kHz.
+BUS_USAGE_FORMAT_STRING = '<IIIHHHHi'
+BUS_USAGE_MARKER = 0x55535542
+
+BusUsage = collections.namedtuple('BusUsage', [
+    'uptime', 'adc_time', 'display_time', 'max_adc_wait', 'max_display_step',
+    'num_missed_adc_reads', 'clock'])
+
+# Task usage frames (see `TaskUsageFrame` in the sketch's data_structures.h) are
+# also sent along with diagnostics frames, with `TASK_USAGE_MARKER` as their
+# last field. Times are in microseconds since the previous task usage frame,
+# except for task delays, which are in milliseconds.
+TASK_USAGE_FORMAT_STRING = '<IIHHIHHi'
+TASK_USAGE_MARKER = 0x4B534154
+
+TaskUsage = collections.namedtuple('TaskUsage', [
+    'uptime', 'control_time', 'max_control_time', 'num_control_ticks',
+    'idle_time', 'max_control_delay', 'max_sensing_delay'])
+
+# Shot detection frames (see `ShotDetectionFrame` in the sketch's
+# data_structures.h) are also sent along with diagnostics frames, with
+# `SHOT_DETECTION_MARKER` as their last field. They compare the shots detected
+# from the temperatures with the lever's since the device started, and the
+# start error and detection delay of the last lever shot that was detected are
+# in milliseconds.
+SHOT_DETECTION_FORMAT_STRING = '<IHHHHhH4xi'
+SHOT_DETECTION_MARKER = 0x544F4853
+
+ShotDetection = collections.namedtuple('ShotDetection', [
+    'uptime', 'num_lever_shots', 'num_detected_shots', 'num_confirmed_shots',
+    'num_fallback_shots', 'last_start_error', 'last_detection_delay'])
+
+# Devices whose fan has a tachometer also send fan frames (see `FanFrame` in
+# the sketch's data_structures.h) along with diagnostics frames, with
+# `FAN_MARKER` as their last field. They hold the fan's measured speed in RPM,
+# its airflow as a percentage of the nominal airflow, whether it is switched on
+# and stalled, and the stalls since the device started.
+FAN_FORMAT_STRING = '<IHHBBB9xi'
+FAN_MARKER = 0x534E4146
+
+Fan = collections.namedtuple('Fan', [
+    'uptime', 'rpm', 'num_stalls', 'airflow', 'fan_on', 'stalled'])
+
+# When asked for it, the device sends its shot history as a header frame (see
+# `HistoryHeader` in the sketch's data_structures.h) with `HISTORY_MARKER` as
+# its last field, followed by `num_records` records of `record_size` bytes (see
+# history.py). The header also holds the calibration version that the device's
+# firmware was built with.
+HISTORY_HEADER_FORMAT_STRING = '<IHHHBBH6xi'
+HISTORY_MARKER = 0x54534948
+
+HistoryHeader = collections.namedtuple('HistoryHeader', [
+    'uptime', 'num_records', 'record_size', 'capacity', 'version',
+    'curve_size', 'calibration_version'])
+
+# Frames sent along with measurements, by marker: their format string and the
+# tuple they are read into.
+DIAGNOSTICS_FRAMES = {
+    DIAGNOSTICS_MARKER: (DIAGNOSTICS_FORMAT_STRING, Diagnostics),
+    BUS_USAGE_MARKER: (BUS_USAGE_FORMAT_STRING, BusUsage),
+    TASK_USAGE_MARKER: (TASK_USAGE_FORMAT_STRING, TaskUsage),
+    SHOT_DETECTION_MARKER: (SHOT_DETECTION_FORMAT_STRING, ShotDetection),
+    FAN_MARKER: (FAN_FORMAT_STRING, Fan),
+}
+
+# Path to the sketch's constants, which hold the thermistors' calibration.
+CONSTANTS_PATH = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                              'constants.h')
 
 
 class State(enum.IntEnum):
@@ -51,6 +140,11 @@ def find_port_if_not_specified(fqbn, port):
     RuntimeError, if `port` is None and no board with the specified fully
     qualified board name is connected to the computer.
   """
+  # Ports that don't belong to a board (e.g. the simulator's pseudo-terminals)
+  # wouldn't show up in the board list anyway.
+  if port is not None:
+    return port
+
   process = subprocess.Popen(
       ['arduino-cli', 'board', 'list', '--format', 'json'],
       stdout=subprocess.PIPE)
@@ -59,7 +153,7 @@ def find_port_if_not_specified(fqbn, port):
   for device in devices:
     if 'boards' in device and any(board['FQBN'] == fqbn
                                   for board in device['boards']):
-      port = port or device['address']
+      port = device['address']
       break
 
   if port is None:
@@ -69,19 +163,156 @@ def find_port_if_not_specified(fqbn, port):
   return port
 
 
-def read_measurement(serial_port):
+def read_constants(constants_path=CONSTANTS_PATH):
+  """Reads the numeric constants defined in the Arduino sketch's header.
+
+  Args:
+    constants_path: str, path to the sketch's constants header.
+
+  Returns:
+    dict mapping constant names to ints or floats. Constants defined as another
+    constant (e.g. `BUFFER_SIZE`) take its value, and integer suffixes (e.g.
+    `UL`) are dropped.
+  """
+  with open(constants_path, 'r') as f:
+    definitions = dict(re.findall(r'^#define\s+(\w+)\s+(\S+)', f.read(), re.M))
+  constants = {}
+  for name, value in definitions.items():
+    while value in definitions:
+      value = definitions[value]
+    value = re.sub(r'(?<=\d)[uUlL]+$', '', value)
+    try:
+      constants[name] = int(value)
+    except ValueError:
+      try:
+        constants[name] = float(value)
+      except ValueError:
+        pass
+  return constants
+
+
+def read_calibration(constants_path=CONSTANTS_PATH):
+  """Reads the thermistor calibration compiled into the Arduino sketch.
+
+  Args:
+    constants_path: str, path to the sketch's constants header.
+
+  Returns:
+    tuple (version, coefficients), where `version` is the calibration version
+    and `coefficients` maps 'basket' and 'group' to (sh_a, sh_b, sh_c) tuples of
+    Steinhart-Hart coefficients.
+  """
+  constants = read_constants(constants_path)
+  version = int(constants['CALIBRATION_VERSION'])
+  coefficients = {
+      thermistor: tuple(float(constants['{}_SH_{}'.format(prefix, c)])
+                        for c in 'ABC')
+      for thermistor, prefix in (('basket', 'BASKET'), ('group', 'GROUP'))
+  }
+  return version, coefficients
+
+
+def resistance_to_temperature(resistance, sh_a, sh_b, sh_c):
+  """Converts thermistor resistances to temperatures.
+
+  Vectorized counterpart of the sketch's `resistance_to_temperature`.
+
+  Args:
+    resistance: float or numpy array, thermistor resistances.
+    sh_a: float, Steinhart-Hart model A coefficient.
+    sh_b: float, Steinhart-Hart model B coefficient.
+    sh_c: float, Steinhart-Hart model C coefficient.
+
+  Returns:
+    float or numpy array of temperatures in degrees Celsius.
+  """
+  # Disconnected thermistors read as infinite resistances, which convert to
+  # absolute zero just like on the device.
+  with np.errstate(divide='ignore', invalid='ignore'):
+    log_resistance = np.log(resistance)
+    return 1.0 / (sh_a + sh_b * log_resistance +
+                  sh_c * log_resistance ** 3) - 273.15
+
+
+def read_measurement(serial_port, on_diagnostics=None, on_history=None):
   """Reads a measurement from the serial port.
 
+  Diagnostics, bus usage and task usage frames, and shot history transfers,
+  read before the measurement are skipped.
+
   Args:
     serial_port: Serial, serial port to read from.
+    on_diagnostics: function or None, called with a `Diagnostics`, `BusUsage`,
+      `TaskUsage`, `ShotDetection` or `Fan` tuple for every such frame read.
+    on_history: function or None, called with a `HistoryHeader` tuple and the
+      records' bytes for every shot history transfer read.
 
   Returns:
-    tuple of (float, float, float, float, float, int) of form (elapsed_time,
-    basket_resistance, group_resistance, basket_temperature, group_temperature,
-    state).
+    tuple of (float, float, float, float, float, int, bool) of form
+    (elapsed_time, basket_resistance, group_resistance, basket_temperature,
+    group_temperature, state, fan_on).
+  """
+  while True:
+    frame = serial_port.read(struct.calcsize(FORMAT_STRING))
+    measurement = struct.unpack(FORMAT_STRING, frame)
+    if measurement[-1] == HISTORY_MARKER:
+      header = HistoryHeader._make(
+          struct.unpack(HISTORY_HEADER_FORMAT_STRING, frame)[:-1])
+      records = serial_port.read(header.num_records * header.record_size)
+      if on_history is not None:
+        on_history(header, records)
+      continue
+    if measurement[-1] not in DIAGNOSTICS_FRAMES:
+      state = measurement[-1]
+      return measurement[:-1] + (state & ~FAN_ON_FLAG,
+                                 bool(state & FAN_ON_FLAG))
+    if on_diagnostics is not None:
+      format_string, frame_type = DIAGNOSTICS_FRAMES[measurement[-1]]
+      on_diagnostics(frame_type._make(
+          struct.unpack(format_string, frame)[:-1]))
+
+
+class RunningMean:
+  """Mean over a sliding window of the most recent values, updated in O(1).
+
+  Disconnected thermistors can produce non-finite values, which would
+  contaminate a running sum forever. Instead, non-finite values are counted
+  separately and make the mean NaN while they are in the window, like
+  `np.mean` would. The sum is recomputed exactly once per window length to keep
+  floating point error from accumulating, which keeps updates O(1) amortized.
   """
-  return struct.unpack(
-      FORMAT_STRING, serial_port.read(struct.calcsize(FORMAT_STRING)))
+
+  def __init__(self, maxlen):
+    self._values = collections.deque(maxlen=maxlen)
+    self._sum = 0.0
+    self._num_non_finite = 0
+    self._num_updates = 0
+
+  def append(self, value):
+    """Adds a value to the window, evicting the oldest value if it is full."""
+    if len(self._values) == self._values.maxlen:
+      evicted = self._values[0]
+      if math.isfinite(evicted):
+        self._sum -= evicted
+      else:
+        self._num_non_finite -= 1
+    self._values.append(value)
+    if math.isfinite(value):
+      self._sum += value
+    else:
+      self._num_non_finite += 1
+
+    self._num_updates += 1
+    if self._num_updates == self._values.maxlen:
+      self._sum = math.fsum(v for v in self._values if math.isfinite(v))
+      self._num_updates = 0
+
+  @property
+  def mean(self):
+    """Mean of the values in the window (NaN if it is empty)."""
+    if not self._values or self._num_non_finite:
+      return math.nan
+    return self._sum / len(self._values)
 
 
 class MockSerial:
@@ -97,6 +328,10 @@ class MockSerial:
     self._period = 30
     self._running = True
 
+  def write(self, data):
+    # The mock device ignores commands.
+    return len(data)
+
   def read(self, size=1):
     # One simulated second lasts half a real-time second.
     time.sleep(0.5)